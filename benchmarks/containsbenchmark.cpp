@@ -0,0 +1,62 @@
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <cassert>
+
+#include "concise.h"
+
+/**
+ * Compares contains() backed by the skip index with a plain linear scan
+ * over the words (what contains() did before the skip index existed).
+ */
+
+template <bool wahmode> ConciseSet<wahmode> buildSet(size_t numberOfWords) {
+  ConciseSet<wahmode> answer;
+  uint32_t x = 0;
+  uint32_t seed = 2016;
+  while ((size_t)(answer.lastWordIndex + 1) < numberOfWords) {
+    seed = seed * 1103515245 + 12345;
+    // gaps of up to 64 values produce a mix of literals and short fills
+    x += 1 + (seed >> 16) % 64;
+    answer.add(x);
+  }
+  return answer;
+}
+
+template <bool wahmode> void benchmark(size_t numberOfWords) {
+  ConciseSet<wahmode> set = buildSet<wahmode>(numberOfWords);
+  const size_t queries = numberOfWords >= 1000000 ? 100 : 1000;
+  std::vector<uint32_t> values(queries);
+  uint32_t seed = 1;
+  for (size_t k = 0; k < queries; ++k) {
+    seed = seed * 1103515245 + 12345;
+    values[k] = (uint32_t)(((uint64_t)seed * (set.last + 1)) >> 32);
+  }
+
+  size_t found1 = 0, found2 = 0;
+  auto t0 = std::chrono::high_resolution_clock::now();
+  for (size_t k = 0; k < queries; ++k)
+    found1 += set.contains(values[k]);
+  auto t1 = std::chrono::high_resolution_clock::now();
+  for (size_t k = 0; k < queries; ++k)
+    found2 += set.containsFromWord(values[k], 0, 0);
+  auto t2 = std::chrono::high_resolution_clock::now();
+  assert(found1 == found2);
+  (void)found2;
+
+  double indexed =
+      std::chrono::duration<double, std::nano>(t1 - t0).count() / queries;
+  double scan =
+      std::chrono::duration<double, std::nano>(t2 - t1).count() / queries;
+  printf("%-5s %10zu words: skip index %10.1f ns/query, scan %12.1f ns/query "
+         "(index: %zu entries)\n",
+         wahmode ? "WAH" : "Conc.", numberOfWords, indexed, scan,
+         set.skipIndex.size());
+}
+
+int main() {
+  for (size_t n = 1000; n <= 10000000; n *= 10)
+    benchmark<false>(n);
+  for (size_t n = 1000; n <= 10000000; n *= 10)
+    benchmark<true>(n);
+}
@@ -0,0 +1,77 @@
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <cassert>
+
+#include "concise.h"
+
+/**
+ * Compares extracting the values of a set with the bit iterator, with
+ * batches of 256 values from ConciseSetBatchIterator, with toArray() on
+ * scalar kernels and with toArray() on AVX2 kernels, at several densities. Rates are in millions of values per second and in GB/s of
+ * output.
+ */
+
+template <bool wahmode, class word_t>
+ConciseSet<wahmode, word_t> buildSet(uint32_t universe, uint32_t gap) {
+  ConciseSet<wahmode, word_t> answer;
+  uint32_t seed = 2016;
+  for (uint32_t x = 0; x < universe;) {
+    answer.add(x);
+    seed = seed * 1103515245 + 12345;
+    x += 1 + (seed >> 16) % gap;
+  }
+  return answer;
+}
+
+template <class F> double timeit(F f) {
+  auto t0 = std::chrono::high_resolution_clock::now();
+  f();
+  auto t1 = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration<double>(t1 - t0).count();
+}
+
+template <bool wahmode, class word_t> void benchmark(uint32_t gap) {
+  const ConciseSet<wahmode, word_t> set =
+      buildSet<wahmode, word_t>(100000000, gap);
+  const ConciseView<wahmode, word_t> view(set);
+  const size_t card = set.size();
+  std::vector<uint32_t> out(card);
+  double times[4] = {0, 0, 0, 0};
+  times[0] = timeit([&]() {
+    size_t k = 0;
+    for (auto i = set.begin(); i != set.end(); ++i)
+      out[k++] = *i;
+  });
+  times[1] = timeit(
+      [&]() { assert(view.template decode<ScalarDecoder>(out.data()) == card); });
+  times[3] = timeit([&]() {
+    ConciseSetBatchIterator<wahmode, word_t> it(set);
+    size_t k = 0, n;
+    while ((n = it.nextBatch(out.data() + k, std::min<size_t>(256, card - k))))
+      k += n;
+    assert(k == card);
+  });
+#ifdef CONCISE_X86_DECODE
+  if (useAVX2Decoder())
+    times[2] =
+        timeit([&]() { assert(view.decodeAVX2(out.data()) == card); });
+#endif
+  printf("%-5s %2u-bit gap = %5u: %10zu values, iterator %8.1f, batches "
+         "%8.1f, scalar %8.1f",
+         wahmode ? "WAH" : "Conc.", ConciseWord<word_t>::WORD_BITS, gap, card,
+         card / times[0] / 1e6, card / times[3] / 1e6, card / times[1] / 1e6);
+  if (times[2] > 0)
+    printf(", AVX2 %8.1f M values/s (%.1f GB/s)", card / times[2] / 1e6,
+           card * sizeof(uint32_t) / times[2] / 1e9);
+  printf("\n");
+}
+
+int main() {
+  const uint32_t gaps[] = {1, 2, 8, 64, 1024};
+  for (uint32_t gap : gaps) {
+    benchmark<false, uint32_t>(gap);
+    benchmark<false, uint64_t>(gap);
+    benchmark<true, uint32_t>(gap);
+  }
+}
@@ -0,0 +1,80 @@
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <cassert>
+
+#include "concise.h"
+#include "conciseexpr.h"
+
+/**
+ * Compares evaluating ((s0 & s1) | (s2 - s3)) ^ ... over 4 to 20 sets with
+ * the binary operators, which build an intermediate set for every operator,
+ * and with a ConciseExpression, which walks all the sets in a single pass.
+ */
+
+template <bool wahmode, class word_t>
+ConciseSet<wahmode, word_t> buildSet(uint32_t seed, uint32_t universe,
+                                     uint32_t gap) {
+  std::vector<uint32_t> values;
+  uint32_t x = seed % gap;
+  while (x < universe) {
+    values.push_back(x);
+    seed = seed * 1103515245 + 12345;
+    x += 1 + (seed >> 16) % gap;
+  }
+  return ConciseSet<wahmode, word_t>::fromSorted(values.data(),
+                                                 values.data() + values.size());
+}
+
+template <class F> double timeit(F f, size_t &card) {
+  auto t0 = std::chrono::high_resolution_clock::now();
+  card = f();
+  auto t1 = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration<double, std::milli>(t1 - t0).count();
+}
+
+template <bool wahmode, class word_t>
+void benchmark(const std::vector<ConciseSet<wahmode, word_t>> &sets,
+               size_t leaves) {
+  typedef ConciseSet<wahmode, word_t> set_t;
+  size_t eagerCard, lazyCard, countCard;
+  const double eager = timeit(
+      [&]() {
+        set_t answer = (sets[0] & sets[1]) | (sets[2] - sets[3]);
+        for (size_t i = 4; i + 1 < leaves; i += 2)
+          answer = answer ^ (sets[i] & sets[i + 1]);
+        return (size_t)answer.size();
+      },
+      eagerCard);
+  auto expression = [&]() {
+    ConciseExpression<wahmode, word_t> e =
+        (lazy(sets[0]) & sets[1]) | (lazy(sets[2]) - sets[3]);
+    for (size_t i = 4; i + 1 < leaves; i += 2)
+      e = e ^ (lazy(sets[i]) & sets[i + 1]);
+    return e;
+  };
+  const double lazy = timeit(
+      [&]() { return (size_t)expression().evaluate().size(); }, lazyCard);
+  const double count =
+      timeit([&]() { return expression().count(); }, countCard);
+  assert(eagerCard == lazyCard && lazyCard == countCard);
+  printf("%-5s %2u-bit %2zu sets: %10zu values, eager %8.2f lazy %8.2f "
+         "lazy count %8.2f ms\n",
+         wahmode ? "WAH" : "Conc.", ConciseWord<word_t>::WORD_BITS, leaves,
+         lazyCard, eager, lazy, count);
+}
+
+template <bool wahmode, class word_t> void compare() {
+  std::vector<ConciseSet<wahmode, word_t>> sets;
+  for (uint32_t i = 0; i < 20; i++)
+    sets.push_back(buildSet<wahmode, word_t>(i + 1, 50000000, 8 + 16 * i));
+  const size_t leaves[] = {4, 8, 12, 20};
+  for (size_t n : leaves)
+    benchmark<wahmode, word_t>(sets, n);
+}
+
+int main() {
+  compare<false, uint32_t>();
+  compare<true, uint32_t>();
+  compare<false, uint64_t>();
+}
@@ -0,0 +1,65 @@
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <cassert>
+
+#include "concise.h"
+#include "conciseparallel.h"
+
+/**
+ * Measures how parallel_logicalor() scales with the number of threads on
+ * the union of many sets, against the single-threaded fast_logicalor().
+ */
+
+template <bool wahmode>
+ConciseSet<wahmode> buildSet(uint32_t seed, uint32_t universe, uint32_t gap) {
+  ConciseSet<wahmode> answer;
+  uint32_t x = seed % gap;
+  while (x < universe) {
+    answer.add(x);
+    seed = seed * 1103515245 + 12345;
+    x += 1 + (seed >> 16) % gap;
+  }
+  return answer;
+}
+
+template <bool wahmode> void benchmark(size_t n, uint32_t gap) {
+  const uint32_t universe = 10000000;
+  std::vector<ConciseSet<wahmode>> sets;
+  std::vector<const ConciseSet<wahmode> *> inputs;
+  size_t words = 0;
+  for (size_t i = 0; i < n; ++i)
+    sets.push_back(buildSet<wahmode>((uint32_t)i + 1, universe, gap));
+  for (size_t i = 0; i < n; ++i) {
+    inputs.push_back(&sets[i]);
+    words += sets[i].lastWordIndex + 1;
+  }
+  auto t0 = std::chrono::high_resolution_clock::now();
+  const size_t expected =
+      ConciseSet<wahmode>::fast_logicalor(n, inputs.data()).size();
+  auto t1 = std::chrono::high_resolution_clock::now();
+  const double serial =
+      std::chrono::duration<double, std::milli>(t1 - t0).count();
+  printf("%-5s n = %5zu gap = %6u (%10zu words): serial %9.2f ms\n",
+         wahmode ? "WAH" : "Conc.", n, gap, words, serial);
+  for (size_t threads = 1; threads <= 32; threads *= 2) {
+    t0 = std::chrono::high_resolution_clock::now();
+    const size_t card = parallel_logicalor(n, inputs.data(), threads).size();
+    t1 = std::chrono::high_resolution_clock::now();
+    assert(card == expected);
+    (void)card;
+    (void)expected;
+    const double parallel =
+        std::chrono::duration<double, std::milli>(t1 - t0).count();
+    printf("      %2zu threads: %9.2f ms (speedup %5.2f)\n", threads, parallel,
+           serial / parallel);
+  }
+}
+
+int main() {
+  printf("%u hardware threads\n", std::thread::hardware_concurrency());
+  benchmark<false>(4096, 4096);
+  benchmark<false>(1024, 64);
+  benchmark<true>(4096, 4096);
+  benchmark<true>(1024, 64);
+}
@@ -0,0 +1,69 @@
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <cassert>
+
+#include "concise.h"
+
+/**
+ * Compares the unions of n sets computed by merging pairs of sets with the
+ * single-pass multiway merge.
+ */
+
+template <bool wahmode>
+ConciseSet<wahmode> buildSet(uint32_t seed, uint32_t universe, uint32_t gap) {
+  ConciseSet<wahmode> answer;
+  uint32_t x = seed % gap;
+  while (x < universe) {
+    answer.add(x);
+    seed = seed * 1103515245 + 12345;
+    x += 1 + (seed >> 16) % gap;
+  }
+  return answer;
+}
+
+template <class F> double timeit(F f, size_t &card) {
+  auto t0 = std::chrono::high_resolution_clock::now();
+  card = f().size();
+  auto t1 = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration<double, std::milli>(t1 - t0).count();
+}
+
+template <bool wahmode> void benchmark(size_t n, uint32_t gap) {
+  const uint32_t universe = 10000000;
+  std::vector<ConciseSet<wahmode>> sets;
+  std::vector<const ConciseSet<wahmode> *> inputs;
+  size_t words = 0;
+  for (size_t i = 0; i < n; ++i)
+    sets.push_back(buildSet<wahmode>((uint32_t)i + 1, universe, gap));
+  for (size_t i = 0; i < n; ++i) {
+    inputs.push_back(&sets[i]);
+    words += sets[i].lastWordIndex + 1;
+  }
+  size_t card1 = 0, card2 = 0;
+  double pairwise = timeit(
+      [&]() {
+        return ConciseSet<wahmode>::pairwise_logicalor(n, inputs.data());
+      },
+      card1);
+  double multiway = timeit(
+      [&]() {
+        return ConciseSet<wahmode>::multiway_logicalor(n, inputs.data());
+      },
+      card2);
+  assert(card1 == card2);
+  (void)card2;
+  printf("%-5s n = %5zu gap = %6u (%10zu words): pairwise %9.2f ms, "
+         "multiway %9.2f ms\n",
+         wahmode ? "WAH" : "Conc.", n, gap, words, pairwise, multiway);
+}
+
+int main() {
+  const uint32_t gaps[] = {64, 4096, 262144};
+  for (uint32_t gap : gaps)
+    for (size_t n = 4; n <= 1024; n *= 4)
+      benchmark<false>(n, gap);
+  for (uint32_t gap : gaps)
+    for (size_t n = 4; n <= 1024; n *= 4)
+      benchmark<true>(n, gap);
+}
@@ -0,0 +1,79 @@
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <cassert>
+
+#include "concise.h"
+
+/**
+ * Compares sets made of 32-bit words (31-bit literals) with sets made of
+ * 64-bit words (63-bit literals): memory usage, and the time taken by the
+ * binary operations and by iteration, at several densities.
+ */
+
+template <bool wahmode, class word_t>
+ConciseSet<wahmode, word_t> buildSet(uint32_t seed, uint32_t universe,
+                                     uint32_t gap) {
+  std::vector<uint32_t> values;
+  uint32_t x = seed % gap;
+  while (x < universe) {
+    values.push_back(x);
+    seed = seed * 1103515245 + 12345;
+    x += 1 + (seed >> 16) % gap;
+  }
+  return ConciseSet<wahmode, word_t>::fromSorted(values.data(),
+                                                 values.data() + values.size());
+}
+
+template <class F> double timeit(F f, size_t &card) {
+  auto t0 = std::chrono::high_resolution_clock::now();
+  card = f();
+  auto t1 = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration<double, std::milli>(t1 - t0).count();
+}
+
+template <bool wahmode, class word_t>
+void benchmark(uint32_t gap, size_t *cards) {
+  const uint32_t universe = 100000000;
+  typedef ConciseSet<wahmode, word_t> set_t;
+  const set_t a = buildSet<wahmode, word_t>(1, universe, gap);
+  const set_t b = buildSet<wahmode, word_t>(2, universe, gap);
+  double times[5];
+  times[0] = timeit([&]() { return (size_t)a.logicaland(b).size(); },
+                    cards[0]);
+  times[1] = timeit([&]() { return (size_t)a.logicalor(b).size(); }, cards[1]);
+  times[2] = timeit([&]() { return (size_t)a.logicalxor(b).size(); },
+                    cards[2]);
+  times[3] = timeit([&]() { return (size_t)a.logicalandnot(b).size(); },
+                    cards[3]);
+  times[4] = timeit(
+      [&]() {
+        size_t count = 0;
+        for (auto i = a.begin(); i != a.end(); ++i)
+          count++;
+        return count;
+      },
+      cards[4]);
+  printf("%-5s %2u-bit gap = %5u: %10zu bytes, and %8.2f or %8.2f xor %8.2f "
+         "andnot %8.2f iterate %8.2f ms\n",
+         wahmode ? "WAH" : "Conc.", ConciseWord<word_t>::WORD_BITS, gap,
+         a.sizeInBytes() + b.sizeInBytes(), times[0], times[1], times[2],
+         times[3], times[4]);
+}
+
+template <bool wahmode> void compare(uint32_t gap) {
+  size_t narrow[5], wide[5];
+  benchmark<wahmode, uint32_t>(gap, narrow);
+  benchmark<wahmode, uint64_t>(gap, wide);
+  for (int k = 0; k < 5; ++k)
+    assert(narrow[k] == wide[k]);
+  (void)wide;
+}
+
+int main() {
+  const uint32_t gaps[] = {2, 16, 64, 256, 4096, 65536};
+  for (uint32_t gap : gaps)
+    compare<false>(gap);
+  for (uint32_t gap : gaps)
+    compare<true>(gap);
+}
@@ -1,39 +1,240 @@
+#ifndef CONCISE_H
+#define CONCISE_H
 #include <iostream>
 #include <cstdint>
 #include <vector>
 #include <stdexcept>
 #include <algorithm>
 #include <queue>
+#include <functional>
+#include <utility>
+#include <cassert>
+#include <cmath>
 
 #include "conciseutil.h"
+#include "concisedecode.h"
 
-template <bool wah_mode> class WordIterator;
+template <bool wah_mode, class word_t> class WordIterator;
 
-template <bool wah_mode> class ConciseSetBitForwardIterator;
+template <bool wah_mode, class word_t> class ConciseView;
+
+template <bool wah_mode, class word_t> class ConciseSetBitForwardIterator;
+
+template <bool wah_mode, class word_t> class ConciseSetBitReverseIterator;
+
+template <bool wah_mode, class word_t> class ConciseSetSink;
+
+/**
+ * Sink for ConciseSet::multiway() that only counts the elements
+ */
+class CardinalitySink {
+public:
+  CardinalitySink() : cardinality(0) {}
+
+  bool appendZeros(uint32_t) { return true; }
+
+  template <class word_t> bool append(const word_t *buffer, uint32_t length) {
+    for (uint32_t k = 0; k < length; k++)
+      cardinality += ConciseWord<word_t>::popcount(buffer[k]);
+    return true;
+  }
+
+  size_t getCardinality() const { return cardinality; }
+
+private:
+  size_t cardinality;
+};
+
+/**
+ * Cardinalities of the four regions of two sets A and B, as returned by
+ * ConciseSet::similarity(): from them follow the union and the usual
+ * similarity measures. A measure whose denominator is zero (e.g., the
+ * Jaccard index of two empty sets) is reported as zero.
+ */
+struct ConciseSimilarity {
+  ConciseSimilarity() : intersection(0), leftOnly(0), rightOnly(0) {}
+
+  size_t leftCount() const { return intersection + leftOnly; }
+
+  size_t rightCount() const { return intersection + rightOnly; }
+
+  size_t unionCount() const { return intersection + leftOnly + rightOnly; }
+
+  size_t xorCount() const { return leftOnly + rightOnly; }
+
+  /** |A & B| / |A | B| */
+  double jaccard() const { return ratio(intersection, unionCount()); }
+
+  /** 2 |A & B| / (|A| + |B|) */
+  double dice() const {
+    return ratio(2 * intersection, leftCount() + rightCount());
+  }
+
+  /** |A & B| / min(|A|, |B|) */
+  double overlap() const {
+    return ratio(intersection, std::min(leftCount(), rightCount()));
+  }
+
+  /** |A & B| / sqrt(|A| |B|) */
+  double cosine() const {
+    return ratio(intersection,
+                 std::sqrt((double)leftCount() * (double)rightCount()));
+  }
+
+  static double ratio(double numerator, double denominator) {
+    return denominator == 0 ? 0 : numerator / denominator;
+  }
+
+  size_t intersection; // |A & B|
+  size_t leftOnly;     // |A - B|
+  size_t rightOnly;    // |B - A|
+};
 
 /**
  * wah_mode:
  * true for a WAH bitset,
  * false for a Concise bitset,
+ * word_t:
+ * uint32_t for 31-bit literals,
+ * uint64_t for 63-bit literals and longer fills (see ConciseWord)
  */
-template <bool wah_mode = false> class ConciseSet {
+template <bool wah_mode = false, class word_t = uint32_t> class ConciseSet {
 
 public:
+  typedef ConciseWord<word_t> word_traits;
+
   /**
    * Creates an empty integer set
    */
-  ConciseSet() : words(), last(-1), lastWordIndex(-1) {}
+  ConciseSet()
+      : words(), last(-1), lastWordIndex(-1), cardinality(-1), skipIndex(),
+        scratch() {}
 
   ConciseSet(const ConciseSet &cs)
-      : words(cs.words), last(cs.last), lastWordIndex(cs.lastWordIndex) {}
+      : words(cs.words), last(cs.last), lastWordIndex(cs.lastWordIndex),
+        cardinality(cs.cardinality), skipIndex(cs.skipIndex), scratch() {}
+
+  /**
+   * Takes the words of another set, which is left empty
+   */
+  ConciseSet(ConciseSet &&cs) noexcept
+      : words(std::move(cs.words)), last(cs.last),
+        lastWordIndex(cs.lastWordIndex), cardinality(cs.cardinality),
+        skipIndex(std::move(cs.skipIndex)), scratch(std::move(cs.scratch)) {
+    cs.reset();
+  }
+
+  /**
+   * Copies the words of a view into a new set
+   */
+  explicit ConciseSet(const ConciseView<wah_mode, word_t> &v)
+      : words(), last(-1), lastWordIndex(-1), cardinality(-1), skipIndex(),
+        scratch() {
+    assign(v);
+  }
+
+  /**
+   * Copies the content of another set; the scratch buffer is not copied
+   */
+  ConciseSet &operator=(const ConciseSet &cs) {
+    if (this != &cs) {
+      words = cs.words;
+      last = cs.last;
+      lastWordIndex = cs.lastWordIndex;
+      cardinality = cs.cardinality;
+      skipIndex = cs.skipIndex;
+    }
+    return *this;
+  }
+
+  ConciseSet &operator=(ConciseSet &&cs) noexcept {
+    if (this != &cs) {
+      swap(cs);
+      scratch.swap(cs.scratch);
+      cs.reset();
+    }
+    return *this;
+  }
+
+  /**
+   * Replaces the content of this set by a copy of the given view
+   */
+  void assign(const ConciseView<wah_mode, word_t> &v) {
+    if (v.words == words.data())
+      return; // viewing ourselves
+    words.assign(v.words, v.words + v.lastWordIndex + 1);
+    last = v.last;
+    lastWordIndex = v.lastWordIndex;
+    cardinality = v.cardinality;
+    clearSkipIndex();
+    updateSkipIndex();
+  }
+
+  /**
+   * Number of bytes needed by serialize()
+   */
+  size_t serializedSizeInBytes() const {
+    return CONCISE_SERIAL_HEADER_WORDS * sizeof(uint32_t) +
+           (lastWordIndex + 1) * sizeof(word_t);
+  }
+
+  /**
+   * Writes the set to buffer, which must hold serializedSizeInBytes() bytes,
+   * in a portable little-endian format:
+   * cookie, version, flags (bit 0 set for WAH, bit 1 for 64-bit words),
+   * number of words, last, cardinality, followed by the words. All header
+   * fields are 32-bit and the words are of type word_t. Returns the
+   * number of bytes written. The result can be read back with deserialize()
+   * or, without copying, with ConciseView::fromBuffer().
+   */
+  size_t serialize(char *buffer) const {
+    writeLittleEndian32(buffer, CONCISE_SERIAL_COOKIE);
+    writeLittleEndian32(buffer + 4, CONCISE_SERIAL_VERSION);
+    writeLittleEndian32(buffer + 8,
+                        (wah_mode ? CONCISE_SERIAL_WAH_FLAG : 0) |
+                            (sizeof(word_t) == 8 ? CONCISE_SERIAL_WIDE_FLAG
+                                                 : 0));
+    writeLittleEndian32(buffer + 12, lastWordIndex + 1);
+    writeLittleEndian32(buffer + 16, (uint32_t)last);
+    writeLittleEndian32(buffer + 20, size());
+    char *out = buffer + CONCISE_SERIAL_HEADER_WORDS * sizeof(uint32_t);
+    for (int32_t i = 0; i <= lastWordIndex; i++, out += sizeof(word_t))
+      writeLittleEndianWord(out, words[i]);
+    return serializedSizeInBytes();
+  }
+
+  /**
+   * Reads a set written by serialize(). The buffer needs not be aligned.
+   * Throws std::runtime_error if the buffer (of size maxbytes) does not hold
+   * a valid set of the same mode and word size.
+   */
+  static ConciseSet<wah_mode, word_t> deserialize(const char *buffer,
+                                          size_t maxbytes) {
+    ConciseSet<wah_mode, word_t> answer;
+    uint32_t cardinality;
+    const uint32_t numberOfWords = ConciseView<wah_mode, word_t>::readHeader(
+        buffer, maxbytes, answer.last, cardinality);
+    const char *in = buffer + CONCISE_SERIAL_HEADER_WORDS * sizeof(uint32_t);
+    answer.words.resize(numberOfWords);
+    for (uint32_t i = 0; i < numberOfWords; i++, in += sizeof(word_t))
+      readLittleEndianWord(in, answer.words[i]);
+    answer.lastWordIndex = (int32_t)numberOfWords - 1;
+    answer.cardinality = cardinality;
+    answer.updateSkipIndex();
+    return answer;
+  }
 
   bool isEmpty() const { return lastWordIndex == -1; }
 
-  size_t sizeInBytes() const { return (words.size() + 1) * sizeof(uint32_t); }
+  size_t sizeInBytes() const { return (words.size() + 1) * sizeof(word_t); }
 
-  void compact() { words.shrink_to_fit(); }
+  void compact() {
+    words.shrink_to_fit();
+    scratch.clear();
+    scratch.shrink_to_fit();
+  }
 
-  void swap(ConciseSet<wah_mode> &other) {
+  void swap(ConciseSet<wah_mode, word_t> &other) {
     this->words.swap(other.words);
     uint32_t tmplast = this->last;
     this->last = other.last;
@@ -42,638 +243,480 @@ public:
     int32_t tmplwi = this->lastWordIndex;
     this->lastWordIndex = other.lastWordIndex;
     other.lastWordIndex = tmplwi;
+
+    int64_t tmpcard = this->cardinality;
+    this->cardinality = other.cardinality;
+    other.cardinality = tmpcard;
+
+    this->skipIndex.swap(other.skipIndex);
   }
 
-  ConciseSet<wah_mode> logicaland(const ConciseSet<wah_mode> &other) const {
-    ConciseSet<wah_mode> res;
+  ConciseSet<wah_mode, word_t> logicaland(
+      const ConciseView<wah_mode, word_t> &other) const {
+    ConciseSet<wah_mode, word_t> res;
     logicalandToContainer(other, res);
     return res;
   }
 
-  ConciseSet<wah_mode> operator&(const ConciseSet<wah_mode> &o) const {
+  ConciseSet<wah_mode, word_t> operator&(
+      const ConciseView<wah_mode, word_t> &o) const {
     return logicaland(o);
   }
 
-  void logicalandToContainer(const ConciseSet<wah_mode> &other,
-                             ConciseSet<wah_mode> &res) const {
-    if (isEmpty() || other.isEmpty()) {
-      res.clear();
-      return;
-    }
-    res.words.resize(3 + this->lastWordIndex + other.lastWordIndex);
-
-    // scan "this" and "other"
-    WordIterator<wah_mode> thisItr(*this);
-    WordIterator<wah_mode> otherItr(other);
-    while (true) {
-      if (!thisItr.IsLiteral) {
-        if (!otherItr.IsLiteral) {
-          int minCount = std::min(thisItr.count, otherItr.count);
-          res.appendFill(minCount, thisItr.word & otherItr.word);
-          if (!thisItr.prepareNext(minCount) |
-              !otherItr.prepareNext(minCount)) // NOT ||
-            break;
-        } else {
-          res.appendLiteral(thisItr.toLiteral() & otherItr.word);
-          thisItr.word--;
-          if (!thisItr.prepareNext(1) |
-              !otherItr.prepareNext()) // do NOT use "||"
-            break;
-        }
-      } else if (!otherItr.IsLiteral) {
-        res.appendLiteral(thisItr.word & otherItr.toLiteral());
-        otherItr.word--;
-        if (!thisItr.prepareNext() |
-            !otherItr.prepareNext(1)) // do NOT use  "||"
-          break;
-      } else {
-        // Java code simply does thisItr.word & otherItr.word below
-        res.appendLiteral(concise_and(thisItr.word , otherItr.word));
-        if (!thisItr.prepareNext() | !otherItr.prepareNext()) // do NOT use "||"
-          break;
-      }
-    }
-    bool invalidLast = true;
-    // remove trailing zeros
-    res.trimZeros();
-    if (res.isEmpty())
-      return;
-
-    // compute the greatest element
-    if (invalidLast)
-      res.updateLast();
-
-    return;
+  void logicalandToContainer(const ConciseView<wah_mode, word_t> &other,
+                             ConciseSet<wah_mode, word_t> &res) const {
+    ConciseView<wah_mode, word_t>(*this).logicalandToContainer(other, res);
   }
 
-  bool intersects(const ConciseSet<wah_mode> &other) const {
-    if (isEmpty() || other.isEmpty()) {
-      return 0;
-    }
-    // scan "this" and "other"
-    WordIterator<wah_mode> thisItr(*this);
-    WordIterator<wah_mode> otherItr(other);
-    while (true) {
-      if (!thisItr.IsLiteral) {
-        if (!otherItr.IsLiteral) {
-          int minCount = std::min(thisItr.count, otherItr.count);
-          if(concise_and(thisItr.word, otherItr.word) & SEQUENCE_BIT)
-                if(minCount > 0 ) return true;
-          if (!thisItr.prepareNext(minCount) |
-              !otherItr.prepareNext(minCount)) // NOT ||
-            break;
-        } else {
-          if( !isLiteralZero(thisItr.toLiteral() & otherItr.word)  ) return true;
-          thisItr.word--;
-          if (!thisItr.prepareNext(1) |
-              !otherItr.prepareNext()) // do NOT use "||"
-            break;
-        }
-      } else if (!otherItr.IsLiteral) {
-        if( !isLiteralZero(thisItr.word & otherItr.toLiteral())  ) return true;
-        otherItr.word--;
-        if (!thisItr.prepareNext() |
-            !otherItr.prepareNext(1)) // do NOT use  "||"
-          break;
-      } else {
-        // Java code simply does thisItr.word & otherItr.word below
-        if ( !isLiteralZero(concise_and(thisItr.word , otherItr.word))  ) return true;
-        if (!thisItr.prepareNext() | !otherItr.prepareNext()) // do NOT use "||"
-          break;
-      }
-    }
-    return false;
+  bool intersects(const ConciseView<wah_mode, word_t> &other) const {
+    return ConciseView<wah_mode, word_t>(*this).intersects(other);
   }
 
-  size_t logicalandCount(const ConciseSet<wah_mode> &other) const {
-    if (isEmpty() || other.isEmpty()) {
-      return 0;
-    }
-    size_t answer = 0;
-    // scan "this" and "other"
-    WordIterator<wah_mode> thisItr(*this);
-    WordIterator<wah_mode> otherItr(other);
-    while (true) {
-      if (!thisItr.IsLiteral) {
-        if (!otherItr.IsLiteral) {
-          int minCount = std::min(thisItr.count, otherItr.count);
-          if(concise_and(thisItr.word, otherItr.word) & SEQUENCE_BIT)
-                answer += 31 * minCount;
-          if (!thisItr.prepareNext(minCount) |
-              !otherItr.prepareNext(minCount)) // NOT ||
-            break;
-        } else {
-          answer += getLiteralBitCount(thisItr.toLiteral() & otherItr.word);
-          thisItr.word--;
-          if (!thisItr.prepareNext(1) |
-              !otherItr.prepareNext()) // do NOT use "||"
-            break;
-        }
-      } else if (!otherItr.IsLiteral) {
-        answer += getLiteralBitCount(thisItr.word & otherItr.toLiteral());
-        otherItr.word--;
-        if (!thisItr.prepareNext() |
-            !otherItr.prepareNext(1)) // do NOT use  "||"
-          break;
-      } else {
-        // Java code simply does thisItr.word & otherItr.word below
-        answer += getLiteralBitCount(concise_and(thisItr.word , otherItr.word));
-        if (!thisItr.prepareNext() | !otherItr.prepareNext()) // do NOT use "||"
-          break;
-      }
-    }
-    return answer;
+  size_t logicalandCount(const ConciseView<wah_mode, word_t> &other) const {
+    return ConciseView<wah_mode, word_t>(*this).logicalandCount(other);
   }
 
-  ConciseSet<wah_mode> logicalandnot(const ConciseSet<wah_mode> &other) const {
-    ConciseSet<wah_mode> res;
+  ConciseSet<wah_mode, word_t> logicalandnot(
+      const ConciseView<wah_mode, word_t> &other) const {
+    ConciseSet<wah_mode, word_t> res;
     logicalandnotToContainer(other, res);
     return res;
   }
 
-  ConciseSet<wah_mode> operator-(const ConciseSet<wah_mode> &o) const {
+  ConciseSet<wah_mode, word_t> operator-(
+      const ConciseView<wah_mode, word_t> &o) const {
     return logicalandnot(o);
   }
 
-  void logicalandnotToContainer(const ConciseSet<wah_mode> &other,
-                                ConciseSet<wah_mode> &res) const {
-    if (isEmpty()) {
-      res.clear();
-      return;
-    }
-    if (other.isEmpty()) {
-      res = *this;
-      return;
-    }
-    res.words.resize(3 + this->lastWordIndex + other.lastWordIndex);
-
-    // scan "this" and "other"
-    WordIterator<wah_mode> thisItr(*this);
-    WordIterator<wah_mode> otherItr(other);
-    while (true) {
-      if (!thisItr.IsLiteral) {
-        if (!otherItr.IsLiteral) {
-          int minCount = std::min(thisItr.count, otherItr.count);
-          res.appendFill(minCount, concise_andnot(thisItr.word, otherItr.word));
-          if (!thisItr.prepareNext(minCount) |
-              !otherItr.prepareNext(minCount)) // NOT ||
-            break;
-        } else {
-          res.appendLiteral(concise_andnot(thisItr.toLiteral(), otherItr.word));
-          thisItr.word--;
-          if (!thisItr.prepareNext(1) |
-              !otherItr.prepareNext()) // do NOT use "||"
-            break;
-        }
-      } else if (!otherItr.IsLiteral) {
-        res.appendLiteral(concise_andnot(thisItr.word, otherItr.toLiteral()));
-        otherItr.word--;
-        if (!thisItr.prepareNext() |
-            !otherItr.prepareNext(1)) // do NOT use  "||"
-          break;
-      } else {
-        res.appendLiteral(concise_andnot(thisItr.word, otherItr.word));
-        if (!thisItr.prepareNext() | !otherItr.prepareNext()) // do NOT use "||"
-          break;
-      }
-    }
-    bool invalidLast = true;
-    invalidLast |= thisItr.flush(res);
-    // remove trailing zeros
-    res.trimZeros();
-    if (res.isEmpty())
-      return;
-
-    // compute the greatest element
-    if (invalidLast)
-      res.updateLast();
-    return;
+  void logicalandnotToContainer(const ConciseView<wah_mode, word_t> &other,
+                                ConciseSet<wah_mode, word_t> &res) const {
+    ConciseView<wah_mode, word_t>(*this).logicalandnotToContainer(other, res);
   }
 
-  ConciseSet<wah_mode> logicalor(const ConciseSet<wah_mode> &other) const {
-    ConciseSet<wah_mode> res;
+  ConciseSet<wah_mode, word_t> logicalor(
+      const ConciseView<wah_mode, word_t> &other) const {
+    ConciseSet<wah_mode, word_t> res;
     logicalorToContainer(other, res);
     return res;
   }
 
-  ConciseSet<wah_mode> operator|(const ConciseSet<wah_mode> &o) const {
+  ConciseSet<wah_mode, word_t> operator|(
+      const ConciseView<wah_mode, word_t> &o) const {
     return logicalor(o);
   }
 
-  void logicalorToContainer(const ConciseSet<wah_mode> &other,
-                            ConciseSet &res) const {
-    if (this->isEmpty()) {
-      res = other;
-      return;
-    }
-    if (other.isEmpty()) {
-      res = *this;
-      return;
-    }
-    res.words.resize(3 + this->lastWordIndex + other.lastWordIndex);
-    // scan "this" and "other"
-    WordIterator<wah_mode> thisItr(*this);
-    WordIterator<wah_mode> otherItr(other);
-    while (true) {
-      if (!thisItr.IsLiteral) {
-        if (!otherItr.IsLiteral) {
-          int minCount = std::min(thisItr.count, otherItr.count);
-          res.appendFill(minCount, thisItr.word | otherItr.word);
-          if (!thisItr.prepareNext(minCount) |
-              !otherItr.prepareNext(minCount)) // NOT ||
-            break;
-        } else {
-          res.appendLiteral(thisItr.toLiteral() | otherItr.word);
-          thisItr.word--;
-          if (!thisItr.prepareNext(1) |
-              !otherItr.prepareNext()) // do NOT use "||"
-            break;
-        }
-      } else if (!otherItr.IsLiteral) {
-        res.appendLiteral(thisItr.word | otherItr.toLiteral());
-        otherItr.word--;
-        if (!thisItr.prepareNext() |
-            !otherItr.prepareNext(1)) // do NOT use  "||"
-          break;
-      } else {
-        res.appendLiteral(thisItr.word | otherItr.word);
-        if (!thisItr.prepareNext() | !otherItr.prepareNext()) // do NOT use "||"
-          break;
-      }
-    }
-    bool invalidLast = true;
-    res.last = std::max(this->last, other.last);
-    invalidLast = false;
-    invalidLast |= thisItr.flush(res);
-    invalidLast |= otherItr.flush(res);
-    // remove trailing zeros
-    res.trimZeros();
-    if (res.isEmpty())
-      return;
-    // compute the greatest element
-    if (invalidLast)
-      res.updateLast();
-    return;
+  void logicalorToContainer(const ConciseView<wah_mode, word_t> &other,
+                            ConciseSet<wah_mode, word_t> &res) const {
+    ConciseView<wah_mode, word_t>(*this).logicalorToContainer(other, res);
   }
 
-  ConciseSet<wah_mode> logicalxor(const ConciseSet<wah_mode> &other) const {
-    ConciseSet<wah_mode> res;
+  ConciseSet<wah_mode, word_t> logicalxor(
+      const ConciseView<wah_mode, word_t> &other) const {
+    ConciseSet<wah_mode, word_t> res;
     logicalxorToContainer(other, res);
     return res;
   }
 
-  ConciseSet<wah_mode> operator^(const ConciseSet<wah_mode> &o) const {
+  ConciseSet<wah_mode, word_t> operator^(
+      const ConciseView<wah_mode, word_t> &o) const {
     return logicalxor(o);
   }
 
-  void logicalxorToContainer(const ConciseSet<wah_mode> &other,
-                             ConciseSet &res) const {
-    if (this->isEmpty()) {
-      res = other;
-      return;
-    }
-    if (other.isEmpty()) {
-      res = *this;
-      return;
-    }
-    res.words.resize(3 + this->lastWordIndex + other.lastWordIndex);
-    // scan "this" and "other"
-    WordIterator<wah_mode> thisItr(*this);
-    WordIterator<wah_mode> otherItr(other);
-    while (true) {
-      if (!thisItr.IsLiteral) {
-        if (!otherItr.IsLiteral) {
-          int minCount = std::min(thisItr.count, otherItr.count);
-          res.appendFill(minCount, concise_xor(thisItr.word, otherItr.word));
-          if (!thisItr.prepareNext(minCount) |
-              !otherItr.prepareNext(minCount)) // NOT ||
-            break;
-        } else {
-          res.appendLiteral(concise_xor(thisItr.toLiteral(), otherItr.word));
-          thisItr.word--;
-          if (!thisItr.prepareNext(1) |
-              !otherItr.prepareNext()) // do NOT use "||"
-            break;
-        }
-      } else if (!otherItr.IsLiteral) {
-        res.appendLiteral(concise_xor(thisItr.word, otherItr.toLiteral()));
-        otherItr.word--;
-        if (!thisItr.prepareNext() |
-            !otherItr.prepareNext(1)) // do NOT use  "||"
-          break;
-      } else {
-        res.appendLiteral(concise_xor(thisItr.word, otherItr.word));
-        if (!thisItr.prepareNext() | !otherItr.prepareNext()) // do NOT use "||"
-          break;
-      }
-    }
-    bool invalidLast = true;
-    res.last = std::max(this->last, other.last);
-    invalidLast = false;
-    invalidLast |= thisItr.flush(res);
-    invalidLast |= otherItr.flush(res);
-    // remove trailing zeros
-    res.trimZeros();
-    if (res.isEmpty())
-      return;
-    // compute the greatest element
-    if (invalidLast)
-      res.updateLast();
-    return;
+  void logicalxorToContainer(const ConciseView<wah_mode, word_t> &other,
+                             ConciseSet<wah_mode, word_t> &res) const {
+    ConciseView<wah_mode, word_t>(*this).logicalxorToContainer(other, res);
   }
 
-  bool equals(const ConciseSet<wah_mode> &other) const {
+  bool equals(const ConciseView<wah_mode, word_t> &other) const {
     return logicalxorEmpty(other);
   }
 
-  bool logicalxorEmpty(const ConciseSet<wah_mode> &other) const {
-    if (this->isEmpty()) {
-      return other.isEmpty();
-    }
-    if (other.isEmpty()) {
-      return this->isEmpty();
-    }
-    // scan "this" and "other"
-    WordIterator<wah_mode> thisItr(*this);
-    WordIterator<wah_mode> otherItr(other);
-    while (true) {
-      if (!thisItr.IsLiteral) {
-        if (!otherItr.IsLiteral) {
-          int minCount = std::min(thisItr.count, otherItr.count);
-          if(concise_xor(thisItr.word, otherItr.word) & SEQUENCE_BIT)
-             return false;
-          if (!thisItr.prepareNext(minCount) |
-              !otherItr.prepareNext(minCount)) // NOT ||
-            break;
-        } else {
-          if(!isLiteralZero(concise_xor(thisItr.toLiteral(), otherItr.word))) return false;
-          thisItr.word--;
-          if (!thisItr.prepareNext(1) |
-              !otherItr.prepareNext()) // do NOT use "||"
-            break;
-        }
-      } else if (!otherItr.IsLiteral) {
-        if(!isLiteralZero(concise_xor(thisItr.word, otherItr.toLiteral()))) return false;
-        otherItr.word--;
-        if (!thisItr.prepareNext() |
-            !otherItr.prepareNext(1)) // do NOT use  "||"
-          break;
-      } else {
-        if(!isLiteralZero(concise_xor(thisItr.word, otherItr.word))) return false;
-        if (!thisItr.prepareNext() | !otherItr.prepareNext()) // do NOT use "||"
-          break;
-      }
-    }
-    if(thisItr.flushEmpty() && otherItr.flushEmpty()) return true;
-    return false;
+  bool logicalxorEmpty(const ConciseView<wah_mode, word_t> &other) const {
+    return ConciseView<wah_mode, word_t>(*this).logicalxorEmpty(other);
   }
 
-  size_t  logicalandnotCount(const ConciseSet<wah_mode> &other) const {
-      if (isEmpty()) {
-        return 0;
-      }
-      if (other.isEmpty()) {
-        return this->size();
-      }
-      size_t answer = 0;
-      // scan "this" and "other"
-      WordIterator<wah_mode> thisItr(*this);
-      WordIterator<wah_mode> otherItr(other);
-      while (true) {
-        if (!thisItr.IsLiteral) {
-          if (!otherItr.IsLiteral) {
-            int minCount = std::min(thisItr.count, otherItr.count);
-            if(concise_andnot(thisItr.word, otherItr.word) & SEQUENCE_BIT)
-               answer += 31 * minCount;
-            if (!thisItr.prepareNext(minCount) |
-                !otherItr.prepareNext(minCount)) // NOT ||
-              break;
-          } else {
-            answer += getLiteralBitCount(concise_andnot(thisItr.toLiteral(), otherItr.word));
-            thisItr.word--;
-            if (!thisItr.prepareNext(1) |
-                !otherItr.prepareNext()) // do NOT use "||"
-              break;
-          }
-        } else if (!otherItr.IsLiteral) {
-          answer += getLiteralBitCount(concise_andnot(thisItr.word, otherItr.toLiteral()));
-          otherItr.word--;
-          if (!thisItr.prepareNext() |
-              !otherItr.prepareNext(1)) // do NOT use  "||"
-            break;
-        } else {
-          answer += getLiteralBitCount(concise_andnot(thisItr.word, otherItr.word));
-          if (!thisItr.prepareNext() | !otherItr.prepareNext()) // do NOT use "||"
-            break;
-        }
-      }
-      answer += thisItr.flushCount();
-      return answer;
+  bool isSubsetOf(const ConciseView<wah_mode, word_t> &other) const {
+    return ConciseView<wah_mode, word_t>(*this).isSubsetOf(other);
   }
 
-  size_t logicalxorCount(const ConciseSet<wah_mode> &other) const {
-    if (this->isEmpty()) {
-      return other.size();
-    }
-    if (other.isEmpty()) {
-      return this->size();
-    }
-    size_t answer = 0;
-    // scan "this" and "other"
-    WordIterator<wah_mode> thisItr(*this);
-    WordIterator<wah_mode> otherItr(other);
-    while (true) {
-      if (!thisItr.IsLiteral) {
-        if (!otherItr.IsLiteral) {
-          int minCount = std::min(thisItr.count, otherItr.count);
-          if(concise_xor(thisItr.word, otherItr.word) & SEQUENCE_BIT)
-             answer += 31 * minCount;
-          if (!thisItr.prepareNext(minCount) |
-              !otherItr.prepareNext(minCount)) // NOT ||
-            break;
-        } else {
-          answer += getLiteralBitCount(concise_xor(thisItr.toLiteral(), otherItr.word));
-          thisItr.word--;
-          if (!thisItr.prepareNext(1) |
-              !otherItr.prepareNext()) // do NOT use "||"
-            break;
-        }
-      } else if (!otherItr.IsLiteral) {
-        answer += getLiteralBitCount(concise_xor(thisItr.word, otherItr.toLiteral()));
-        otherItr.word--;
-        if (!thisItr.prepareNext() |
-            !otherItr.prepareNext(1)) // do NOT use  "||"
-          break;
-      } else {
-        answer += getLiteralBitCount(concise_xor(thisItr.word, otherItr.word));
-        if (!thisItr.prepareNext() | !otherItr.prepareNext()) // do NOT use "||"
-          break;
-      }
-    }
-    answer += thisItr.flushCount();
-    answer += otherItr.flushCount();
-    return answer;
+  bool isSupersetOf(const ConciseView<wah_mode, word_t> &other) const {
+    return ConciseView<wah_mode, word_t>(*this).isSupersetOf(other);
   }
 
-  size_t logicalorCount(const ConciseSet<wah_mode> &other) const {
-    if (this->isEmpty()) {
-      return other.size();
-    }
-    if (other.isEmpty()) {
-      return this->size();
-    }
-    size_t answer = 0;
-    // scan "this" and "other"
-    WordIterator<wah_mode> thisItr(*this);
-    WordIterator<wah_mode> otherItr(other);
-    while (true) {
-      if (!thisItr.IsLiteral) {
-        if (!otherItr.IsLiteral) {
-          int minCount = std::min(thisItr.count, otherItr.count);
-          if((thisItr.word | otherItr.word) & SEQUENCE_BIT)
-             answer += 31 * minCount;
-          if (!thisItr.prepareNext(minCount) |
-              !otherItr.prepareNext(minCount)) // NOT ||
-            break;
-        } else {
-          answer += getLiteralBitCount(thisItr.toLiteral() | otherItr.word);
-          thisItr.word--;
-          if (!thisItr.prepareNext(1) |
-              !otherItr.prepareNext()) // do NOT use "||"
-            break;
-        }
-      } else if (!otherItr.IsLiteral) {
-        answer += getLiteralBitCount(thisItr.word | otherItr.toLiteral());
-        otherItr.word--;
-        if (!thisItr.prepareNext() |
-            !otherItr.prepareNext(1)) // do NOT use  "||"
-          break;
-      } else {
-        answer += getLiteralBitCount(thisItr.word | otherItr.word);
-        if (!thisItr.prepareNext() | !otherItr.prepareNext()) // do NOT use "||"
-          break;
-      }
-    }
-    answer += thisItr.flushCount();
-    answer += otherItr.flushCount();
-    return answer;
+  bool isDisjoint(const ConciseView<wah_mode, word_t> &other) const {
+    return ConciseView<wah_mode, word_t>(*this).isDisjoint(other);
   }
 
-  void clear() { reset(); }
+  size_t logicalandnotCount(const ConciseView<wah_mode, word_t> &other) const {
+    return ConciseView<wah_mode, word_t>(*this).logicalandnotCount(other);
+  }
 
-  void add(uint32_t e) {
-    // range check
-    if (e > MAX_ALLOWED_INTEGER) {
-      std::cerr << "max integer allowed is " << MAX_ALLOWED_INTEGER
-                << std::endl;
-      throw std::runtime_error("out of bound value");
-    }
-    // the element can be simply appended
-    if ((int32_t)e > last) {
-      append(e);
-      return;
-    }
-    if ((int32_t)e == last)
-      return;
-    // check if the element can be put in a literal word
-    uint32_t blockIndex = maxLiteralLengthDivision(e);
-    uint32_t bitPosition = maxLiteralLengthModulus(e);
-    for (int i = 0; i <= lastWordIndex && blockIndex >= 0; i++) {
-      uint32_t w = words[i];
-      if (isLiteral(w)) {
-        // check if the current literal word is the "right" one
-        if (blockIndex == 0) {
-          // bit already set
-          if ((w & (UINT32_C(1) << bitPosition)) != 0)
-            return;
-          // By adding the bit we potentially create a sequence:
-          // -- If the literal is made up of all zeros, it definitely
-          //    cannot be part of a sequence (otherwise it would not have
-          //    been created). Thus, we can create a 1-bit literal word
-          // -- If there are MAX_LITERAL_LENGTH - 2 set bits, by adding
-          //    the new one we potentially allow for a 1's sequence
-          //    together with the successive word
-          // -- If there are MAX_LITERAL_LENGTH - 1 set bits, by adding
-          //    the new one we potentially allow for a 1's sequence
-          //    together with the successive and/or the preceding words
-          if (!wah_mode) {
-            uint32_t bitCount = getLiteralBitCount(w);
-            if (bitCount >= MAX_LITERAL_LENGTH - 2)
-              break;
-          } else {
-            if (containsOnlyOneBit(~w) || w == ALL_ONES_LITERAL)
-              break;
-          }
-          // set the bit
-          words[i] |= UINT32_C(1) << bitPosition;
-          return;
-        }
-        blockIndex--;
-      } else {
-        if (wah_mode) {
-          if (isOneSequence(w) && (blockIndex <= getSequenceCount<wah_mode>(w)))
-            return;
-        } else {
-          // if we are at the beginning of a sequence, and it is
-          // a set bit, the bit already exists
-          if (blockIndex == 0 && (getLiteral(w) & (UINT32_C(1) << bitPosition)) != 0)
-            return;
-
-          // if we are in the middle of a sequence of 1's, the bit already exist
-          if ((blockIndex > 0) && (blockIndex <= getSequenceCount<wah_mode>(w)) &&
-              isOneSequence(w))
-            return;
-        }
-        // next word
-        blockIndex -= getSequenceCount<wah_mode>(w) + 1;
-      }
-    }
-    // the bit is in the middle of a sequence or it may cause a literal to
-    // become a sequence, thus the "easiest" way to add it is by ORing
-    ConciseSet<wah_mode> tmp;
-    tmp.add(e);
-    ConciseSet<wah_mode> newbitmap = this->logicalor(tmp);
-    this->swap(newbitmap);
+  size_t logicalxorCount(const ConciseView<wah_mode, word_t> &other) const {
+    return ConciseView<wah_mode, word_t>(*this).logicalxorCount(other);
   }
 
-  void dump_buffer_content() const {
-    printf("{buffer content  \n");
-    for (int i = 0; i <= lastWordIndex; i++) {
-            const uint32_t w = words[i];
-            std::cout << w << std::endl;
-    }
-    printf("}\n");
+  size_t logicalorCount(const ConciseView<wah_mode, word_t> &other) const {
+    return ConciseView<wah_mode, word_t>(*this).logicalorCount(other);
   }
 
-  void describe() const {
-    printf("{cardinality = %d, \n", size());
-    for (int i = 0; i <= lastWordIndex; i++) {
+  ConciseSimilarity
+  similarity(const ConciseView<wah_mode, word_t> &other) const {
+    return ConciseView<wah_mode, word_t>(*this).similarity(other);
+  }
 
-      const uint32_t w = words[i];
+  double jaccard(const ConciseView<wah_mode, word_t> &other) const {
+    return similarity(other).jaccard();
+  }
 
-      const uint32_t t = w & UINT32_C(0xC0000000); // the first two bits...
-      switch (t) {
-      case UINT32_C(0x80000000): // LITERAL
-      case UINT32_C(0xC0000000): // LITERAL
-        // check if the current literal word is the "right" one
-        printf("{literal word %u}\n", getLiteralBits(w));
+  double dice(const ConciseView<wah_mode, word_t> &other) const {
+    return similarity(other).dice();
+  }
+
+  double overlap(const ConciseView<wah_mode, word_t> &other) const {
+    return similarity(other).overlap();
+  }
+
+  double cosine(const ConciseView<wah_mode, word_t> &other) const {
+    return similarity(other).cosine();
+  }
+
+  /**
+   * Values of the set in increasing order, see ConciseView::toArray()
+   */
+  size_t toArray(uint32_t *out) const {
+    return ConciseView<wah_mode, word_t>(*this).toArray(out);
+  }
+
+  std::vector<uint32_t> toVector() const {
+    return ConciseView<wah_mode, word_t>(*this).toVector();
+  }
+
+  /**
+   * Replaces this set by its union with other. The result is computed into
+   * the scratch buffer, which then trades places with words: once warmed up,
+   * folding many sets into the same accumulator does not allocate.
+   */
+  void logicalorInPlace(const ConciseView<wah_mode, word_t> &other) {
+    if (other.isEmpty())
+      return;
+    ConciseSet<wah_mode, word_t> res;
+    res.words.swap(scratch);
+    logicalorToContainer(other, res);
+    recycle(res);
+  }
+
+  /**
+   * Replaces this set by its intersection with other (see logicalorInPlace)
+   */
+  void logicalandInPlace(const ConciseView<wah_mode, word_t> &other) {
+    if (isEmpty())
+      return;
+    if (other.isEmpty()) {
+      prepareOutput(0);
+      return;
+    }
+    ConciseSet<wah_mode, word_t> res;
+    res.words.swap(scratch);
+    logicalandToContainer(other, res);
+    recycle(res);
+  }
+
+  /**
+   * Replaces this set by its symmetric difference with other (see
+   * logicalorInPlace)
+   */
+  void logicalxorInPlace(const ConciseView<wah_mode, word_t> &other) {
+    if (other.isEmpty())
+      return;
+    ConciseSet<wah_mode, word_t> res;
+    res.words.swap(scratch);
+    logicalxorToContainer(other, res);
+    recycle(res);
+  }
+
+  /**
+   * Removes the elements of other from this set (see logicalorInPlace)
+   */
+  void logicalandnotInPlace(const ConciseView<wah_mode, word_t> &other) {
+    if (isEmpty() || other.isEmpty())
+      return;
+    ConciseSet<wah_mode, word_t> res;
+    res.words.swap(scratch);
+    logicalandnotToContainer(other, res);
+    recycle(res);
+  }
+
+  ConciseSet<wah_mode, word_t> &
+  operator|=(const ConciseView<wah_mode, word_t> &o) {
+    logicalorInPlace(o);
+    return *this;
+  }
+
+  ConciseSet<wah_mode, word_t> &
+  operator&=(const ConciseView<wah_mode, word_t> &o) {
+    logicalandInPlace(o);
+    return *this;
+  }
+
+  ConciseSet<wah_mode, word_t> &
+  operator^=(const ConciseView<wah_mode, word_t> &o) {
+    logicalxorInPlace(o);
+    return *this;
+  }
+
+  ConciseSet<wah_mode, word_t> &
+  operator-=(const ConciseView<wah_mode, word_t> &o) {
+    logicalandnotInPlace(o);
+    return *this;
+  }
+
+  /**
+   * Takes the content of res, which was computed in the scratch buffer, and
+   * keeps our previous words as the next scratch buffer
+   */
+  void recycle(ConciseSet<wah_mode, word_t> &res) {
+    swap(res);
+    scratch.swap(res.words);
+  }
+
+  void clear() { reset(); }
+
+  void add(uint32_t e) {
+    // range check
+    if (e > word_traits::MAX_ALLOWED_INTEGER) {
+      std::cerr << "max integer allowed is " << word_traits::MAX_ALLOWED_INTEGER
+                << std::endl;
+      throw std::runtime_error("out of bound value");
+    }
+    // the element can be simply appended
+    if ((int32_t)e > last) {
+      append(e);
+      return;
+    }
+    if ((int32_t)e == last)
+      return;
+    // find the word holding the element
+    const SkipEntry start = seekBlock(maxLiteralLengthDivision<word_t>(e));
+    int32_t i = start.wordIndex;
+    uint32_t blockIndex = maxLiteralLengthDivision<word_t>(e) - start.block;
+    const uint32_t bitPosition = maxLiteralLengthModulus<word_t>(e);
+    while (blockIndex >= getBlockCount(words[i])) {
+      blockIndex -= getBlockCount(words[i]);
+      i++;
+    }
+    const word_t w = words[i];
+    // the literal of the block holding the element; within a sequence, only
+    // the first block may have a flipped bit
+    const word_t literal =
+        isLiteral(w) || blockIndex == 0
+            ? getLiteral(w)
+            : (isOneSequence(w) ? word_traits::ALL_ONES_LITERAL
+                                : word_traits::ALL_ZEROS_LITERAL);
+    // bit already set
+    if ((literal & ((word_t)1 << bitPosition)) != 0)
+      return;
+    if (isLiteral(w)) {
+      // By adding the bit we potentially create a sequence:
+      // -- If the literal is made up of all zeros, it definitely
+      //    cannot be part of a sequence (otherwise it would not have
+      //    been created). Thus, we can create a 1-bit literal word
+      // -- If there are MAX_LITERAL_LENGTH - 2 set bits, by adding
+      //    the new one we potentially allow for a 1's sequence
+      //    together with the successive word
+      // -- If there are MAX_LITERAL_LENGTH - 1 set bits, by adding
+      //    the new one we potentially allow for a 1's sequence
+      //    together with the successive and/or the preceding words
+      const bool mayMerge =
+          wah_mode ? containsOnlyOneBit(~w)
+                   : (uint32_t)getLiteralBitCount(w) >=
+                         word_traits::MAX_LITERAL_LENGTH - 2;
+      if (!mayMerge) {
+        // set the bit
+        words[i] |= (word_t)1 << bitPosition;
+        if (cardinality >= 0)
+          cardinality++;
+        // the following entries of the skip index count one more element
+        for (SkipEntry &entry : skipIndex)
+          if (entry.wordIndex > i)
+            entry.rank++;
+        return;
+      }
+    }
+    // the bit is in the middle of a sequence or it may cause a literal to
+    // become a sequence, thus we re-encode the neighbourhood of the word
+    replaceBlock(i, blockIndex, literal | ((word_t)1 << bitPosition));
+    if (cardinality >= 0)
+      cardinality++;
+  }
+
+  /**
+   * Removes e from the set, if present. A bit cleared in a literal that
+   * keeps enough bits not to merge with its neighbours is cleared in place;
+   * otherwise, as when e is the flipped bit of a Concise sequence or lies
+   * inside a fill of ones, the word and its neighbours are encoded again by
+   * replaceBlock(). last is only recomputed when e was the greatest value.
+   */
+  void remove(uint32_t e) {
+    if ((int32_t)e > last || e > word_traits::MAX_ALLOWED_INTEGER)
+      return;
+    // find the word holding the element
+    const SkipEntry start = seekBlock(maxLiteralLengthDivision<word_t>(e));
+    int32_t i = start.wordIndex;
+    uint32_t blockIndex = maxLiteralLengthDivision<word_t>(e) - start.block;
+    const uint32_t bitPosition = maxLiteralLengthModulus<word_t>(e);
+    while (blockIndex >= getBlockCount(words[i])) {
+      blockIndex -= getBlockCount(words[i]);
+      i++;
+    }
+    const word_t w = words[i];
+    const word_t literal =
+        isLiteral(w) || blockIndex == 0
+            ? getLiteral(w)
+            : (isOneSequence(w) ? word_traits::ALL_ONES_LITERAL
+                                : word_traits::ALL_ZEROS_LITERAL);
+    // bit not set
+    if ((literal & ((word_t)1 << bitPosition)) == 0)
+      return;
+    const word_t cleared = literal & ~((word_t)1 << bitPosition);
+    // a literal left with no bit (or, with Concise, a single bit) may merge
+    // with a neighbouring fill
+    const bool mayMerge = wah_mode ? isLiteralZero(cleared)
+                                   : getLiteralBitCount(cleared) <= 1;
+    if (isLiteral(w) && !mayMerge) {
+      words[i] = cleared;
+      // the following entries of the skip index count one less element
+      for (SkipEntry &entry : skipIndex)
+        if (entry.wordIndex > i)
+          entry.rank--;
+    } else {
+      replaceBlock(i, blockIndex, cleared);
+    }
+    if (cardinality >= 0)
+      cardinality--;
+    if ((int32_t)e == last) {
+      trimZeros();
+      if (!isEmpty())
+        updateLast();
+    }
+  }
+
+  /**
+   * Adds the values in [begin, end), in any order. The values greater than
+   * last are appended directly and the other ones are merged through a single
+   * logicalor, so that a batch of out-of-order insertions costs one pass over
+   * the set instead of one per value.
+   */
+  void addUnsorted(const uint32_t *begin, const uint32_t *end) {
+    std::vector<uint32_t> sorted(begin, end);
+    std::sort(sorted.begin(), sorted.end());
+    const uint32_t *lower = sorted.data();
+    const uint32_t *upper = sorted.data() + sorted.size();
+    const uint32_t *middle =
+        isEmpty() ? lower : std::upper_bound(lower, upper, (uint32_t)last);
+    addMany(lower, middle);
+    addMany(middle, upper);
+  }
+
+  /**
+   * Replaces the blockIndex-th block of words[i] by the given literal. The
+   * words from i - 1 to i + 1 are encoded again in place through
+   * appendLiteral() and appendFill(), so that the result is as compact as if
+   * the set had been built by appending, and the following words are
+   * shifted at most once. Nothing is allocated unless words must grow.
+   * The cardinality is left for the caller to update.
+   */
+  void replaceBlock(int32_t i, uint32_t blockIndex, word_t literal) {
+    const int32_t lo = std::max(i - 1, 0);
+    const int32_t hi = std::min(i + 1, lastWordIndex);
+    const int32_t following = lastWordIndex - hi;
+    // a split sequence gives at most four words, and each neighbour two:
+    // the new words may run over the first seven following words, which
+    // are kept aside until the following words are moved
+    word_t old[3];
+    word_t next[7];
+    const int32_t kept = std::min(following, (int32_t)7);
+    std::copy(words.begin() + lo, words.begin() + hi + 1, old);
+    std::copy(words.begin() + hi + 1, words.begin() + hi + 1 + kept, next);
+    ensureCapacity(lastWordIndex + 8);
+    const int64_t previousCardinality = cardinality;
+    // the first new word may be merged into words[lo - 1]
+    invalidateSkipIndexAfter(lo - 1);
+    lastWordIndex = lo - 1;
+    for (int32_t j = lo; j <= hi; j++) {
+      const word_t w = old[j - lo];
+      if (j != i) {
+        appendWord(w);
+      } else if (isLiteral(w)) {
+        appendLiteral(literal);
+      } else {
+        const uint32_t blocks = (uint32_t)getSequenceCount<wah_mode>(w) + 1;
+        if (blockIndex > 0) {
+          // the first block keeps its flipped bit, if any
+          appendLiteral(getLiteral(w));
+          if (blockIndex > 1)
+            appendFill(blockIndex - 1, w);
+        }
+        appendLiteral(literal);
+        if (blocks > blockIndex + 1)
+          appendFill(blocks - blockIndex - 1, w);
+      }
+    }
+    cardinality = previousCardinality;
+    const int32_t shift = lastWordIndex - hi;
+    if (shift != 0 && following > 0) {
+      memmove(words.data() + hi + 1 + shift, words.data() + hi + 1,
+              following * sizeof(word_t));
+      if (shift > 0)
+        std::copy(next, next + std::min(shift, kept),
+                  words.begin() + hi + 1 + shift);
+    }
+    lastWordIndex += following;
+    updateSkipIndex();
+  }
+
+  void dump_buffer_content() const {
+    printf("{buffer content  \n");
+    for (int i = 0; i <= lastWordIndex; i++) {
+            const word_t w = words[i];
+            std::cout << w << std::endl;
+    }
+    printf("}\n");
+  }
+
+  void describe() const {
+    printf("{cardinality = %d, \n", size());
+    for (int i = 0; i <= lastWordIndex; i++) {
+
+      const word_t w = words[i];
+
+      const word_t t = w & word_traits::TYPE_MASK; // the first two bits...
+      switch (t) {
+      case word_traits::ALL_ZEROS_LITERAL: // LITERAL
+      case word_traits::TYPE_MASK:         // LITERAL
+        // check if the current literal word is the "right" one
+        printf("{literal word %llu}\n",
+               (unsigned long long)getLiteralBits(w));
 
         break;
-      case UINT32_C(0x00000000): // ZERO SEQUENCE
+      case 0: // ZERO SEQUENCE
         printf("{zero sequence:");
         if (!wah_mode) {
           printf("concise word with single 1-bit at %d (none if -1), \n",
-                 ((w >> 25) - 1));
+                 getFlippedBit(w));
         }
-        printf(" length= %u 31-bit words} \n", getSequenceCount<wah_mode>(w) + 1);
+        printf(" length= %llu %u-bit words} \n",
+               (unsigned long long)getSequenceCount<wah_mode>(w) + 1,
+               word_traits::MAX_LITERAL_LENGTH);
         break;
-      case UINT32_C(0x40000000): // ONE SEQUENCE
+      case word_traits::SEQUENCE_BIT: // ONE SEQUENCE
         printf("{one sequence:");
         if (!wah_mode) {
           printf("concise word with single 0-bit at %d (none if -1), \n",
-                 ((UINT32_C(0x0000001F) & (w >> 25)) - 1));
+                 getFlippedBit(w));
         }
-        printf(" length= %u 31-bit words }\n", getSequenceCount<wah_mode>(w) + 1);
+        printf(" length= %llu %u-bit words }\n",
+               (unsigned long long)getSequenceCount<wah_mode>(w) + 1,
+               word_traits::MAX_LITERAL_LENGTH);
         break;
       default:
         assert(false);
@@ -682,371 +725,2447 @@ public:
 
     printf("}\n");
   }
-  typedef ConciseSetBitForwardIterator<wah_mode> const_iterator;
+  typedef ConciseSetBitForwardIterator<wah_mode, word_t> const_iterator;
 
   const_iterator begin() const;
 
   const_iterator & end() const;
 
-  bool contains(uint32_t o) const {
-    if (isEmpty() || ((int32_t)o > last) || (o > MAX_ALLOWED_INTEGER)) {
-      return false;
-    }
+  typedef ConciseSetBitReverseIterator<wah_mode, word_t>
+      const_reverse_iterator;
 
-    // check if the element is within a literal word
-    int32_t block = (int32_t)maxLiteralLengthDivision(o);
-    uint32_t bit = maxLiteralLengthModulus(o);
-    assert(block * 31 + bit == o);
+  /**
+   * Visits the values from the largest down
+   */
+  const_reverse_iterator rbegin() const;
 
-    for (int i = 0; i <= lastWordIndex; i++) {
+  const_reverse_iterator rend() const;
 
-      const uint32_t w = words[i];
-      const uint32_t t = w & UINT32_C(0xC0000000); // the first two bits...
-      switch (t) {
-      case UINT32_C(0x80000000): // LITERAL
-      case UINT32_C(0xC0000000): // LITERAL
-        // check if the current literal word is the "right" one
-        if (block == 0)
-          return (w & (UINT32_C(1) << bit)) != 0;
-        block--;
-        break;
-      case UINT32_C(0x00000000): // ZERO SEQUENCE
-        if (!wah_mode)
-          if ((block == 0) && ((w >> 25) - 1) == bit)
-            return true;
-        block -= getSequenceCount<wah_mode>(w) + 1;
-        if (block < 0)
-          return false;
-        break;
-      case UINT32_C(0x40000000): // ONE SEQUENCE
-        if (!wah_mode)
-          if ((block == 0) && (((UINT32_C(0x0000001F) & (w >> 25)) - 1)) == bit)
-            return false;
-        block -= getSequenceCount<wah_mode>(w) + 1;
-        if (block < 0)
-          return true;
-        break;
-      }
+  bool contains(uint32_t o) const {
+    if (isEmpty() || ((int32_t)o > last) ||
+        (o > word_traits::MAX_ALLOWED_INTEGER)) {
+      return false;
     }
-    // no more words
-    return false;
+    const SkipEntry start = seekBlock(maxLiteralLengthDivision<word_t>(o));
+    return containsFromWord(o, start.wordIndex, start.block);
+  }
+
+  /**
+   * Checks whether o belongs to the set by scanning words from position
+   * wordIndex, which must be preceded by exactly firstBlock blocks.
+   * containsFromWord(o, 0, 0) is a plain linear scan.
+   */
+  bool containsFromWord(uint32_t o, int32_t wordIndex,
+                        uint32_t firstBlock) const {
+    return ConciseView<wah_mode, word_t>(*this).containsFromWord(o, wordIndex,
+                                                         firstBlock);
   }
 
+  /**
+   * Returns the cardinality, which is maintained as words are appended.
+   * It is only recomputed when unknown, e.g. after words were written
+   * directly.
+   */
   uint32_t size() const {
-    uint32_t cardsize = 0;
-    for (int i = 0; i <= lastWordIndex; i++) {
-      uint32_t w = words[i];
-      if (isLiteral(w)) {
-        cardsize += getLiteralBitCount(w);
-      } else {
-        if (isZeroSequence(w)) {
-          if (!isSequenceWithNoBits(w))
-            cardsize++;
-        } else {
-          cardsize += maxLiteralLengthMultiplication(getSequenceCount<wah_mode>(w) + 1);
-          if (!isSequenceWithNoBits(w))
-            cardsize--;
-        }
-      }
+    if (cardinality < 0) {
+      uint32_t cardsize = 0;
+      for (int i = 0; i <= lastWordIndex; i++)
+        cardsize += getWordCardinality(words[i]);
+      cardinality = cardsize;
     }
-    return cardsize;
+    return (uint32_t)cardinality;
   }
 
-  static ConciseSet<wah_mode>
-  fast_logicalor(size_t n, const ConciseSet<wah_mode> **inputs) {
-    class ConcisePtr {
+  /**
+   * Number of set bits represented by the given word
+   */
+  static uint32_t getWordCardinality(word_t w) {
+    if (isLiteral(w))
+      return getLiteralBitCount(w);
+    const bool noBits = wah_mode || isSequenceWithNoBits(w);
+    if (isZeroSequence(w))
+      return noBits ? 0 : 1;
+    uint32_t cardsize = maxLiteralLengthMultiplication<word_t>(
+        (uint32_t)getSequenceCount<wah_mode>(w) + 1);
+    return noBits ? cardsize : cardsize - 1;
+  }
 
-    public:
-      ConcisePtr(const ConciseSet<wah_mode> *p, bool o) : ptr(p), own(o) {}
-      const ConciseSet<wah_mode> *ptr;
-      bool own; // whether to clean
+  /**
+   * Number of set bits of the given word that precede the given bit of its
+   * block-th block
+   */
+  static uint32_t getWordRank(word_t w, uint32_t block, uint32_t bit) {
+    if (isLiteral(w))
+      return getLiteralBitCount(w & (((word_t)1 << bit) - 1));
+    const uint32_t position =
+        maxLiteralLengthMultiplication<word_t>(block) + bit;
+    // in Concise mode, the flipped bit (if any) belongs to the first block
+    const bool flippedBefore = !wah_mode && !isSequenceWithNoBits(w) &&
+                               (uint32_t)getFlippedBit(w) < position;
+    if (isZeroSequence(w))
+      return flippedBefore ? 1 : 0;
+    return flippedBefore ? position - 1 : position;
+  }
 
-      bool operator<(const ConcisePtr &o) const {
-        return o.ptr->sizeInBytes() < ptr->sizeInBytes(); // backward on purpose
-      }
-    };
+  /**
+   * Position, counted from the first bit of the word, of the k-th set bit
+   * (k = 0 gives the first one) of the given word
+   */
+  static uint32_t getWordSelect(word_t w, uint32_t k) {
+    if (isLiteral(w)) {
+      word_t bits = getLiteralBits(w);
+      for (; k > 0; k--)
+        bits &= bits - 1;
+      return word_traits::ctz(bits);
+    }
+    if (isZeroSequence(w))
+      return getFlippedBit(w);
+    if (wah_mode || isSequenceWithNoBits(w))
+      return k;
+    return k < (uint32_t)getFlippedBit(w) ? k : k + 1;
+  }
 
-    if (n == 0) {
-      return ConciseSet<wah_mode>();
+  /**
+   * Number of set bits of the given word, made of the given number of blocks
+   * from firstBlock on, that are smaller than x
+   */
+  static uint32_t getWordRankBelow(word_t w, uint32_t firstBlock,
+                                   uint32_t blocks, uint32_t x) {
+    const uint32_t block = maxLiteralLengthDivision<word_t>(x);
+    if (block < firstBlock)
+      return 0;
+    if (block >= firstBlock + blocks)
+      return getWordCardinality(w);
+    return getWordRank(w, block - firstBlock,
+                       maxLiteralLengthModulus<word_t>(x));
+  }
+
+  /**
+   * Returns the number of elements smaller than x
+   */
+  uint32_t rank(uint32_t x) const {
+    if (isEmpty() || x == 0)
+      return 0;
+    if (x > (uint32_t)last)
+      return size();
+    const uint32_t block = maxLiteralLengthDivision<word_t>(x);
+    const uint32_t bit = maxLiteralLengthModulus<word_t>(x);
+    const SkipEntry start = seekBlock(block);
+    uint32_t answer = start.rank;
+    uint32_t firstBlock = start.block;
+    for (int32_t i = start.wordIndex; i <= lastWordIndex; i++) {
+      const word_t w = words[i];
+      const uint32_t blocks = getBlockCount(w);
+      if (block < firstBlock + blocks)
+        return answer + getWordRank(w, block - firstBlock, bit);
+      answer += getWordCardinality(w);
+      firstBlock += blocks;
     }
-    if (n == 1) {
-      return ConciseSet<wah_mode>(*inputs[0]);
+    return answer;
+  }
+
+  /**
+   * Returns the k-th smallest element (k = 0 gives the smallest one)
+   */
+  uint32_t select(uint32_t k) const {
+    if (k >= size()) {
+      throw std::runtime_error("not enough elements");
     }
-    std::priority_queue<ConcisePtr> pq;
-    for (size_t i = 0; i < n; i++) {
-      // could use emplace
-      pq.push(ConcisePtr(inputs[i], false));
+    const SkipEntry start = seekRank(k);
+    uint32_t rank = start.rank;
+    uint32_t firstBlock = start.block;
+    for (int32_t i = start.wordIndex; i <= lastWordIndex; i++) {
+      const word_t w = words[i];
+      const uint32_t card = getWordCardinality(w);
+      if (k < rank + card)
+        return maxLiteralLengthMultiplication<word_t>(firstBlock) +
+               getWordSelect(w, k - rank);
+      rank += card;
+      firstBlock += getBlockCount(w);
     }
-    while (pq.size() > 2) {
+    throw std::runtime_error("not enough elements");
+  }
 
-      ConcisePtr x1 = pq.top();
-      pq.pop();
+  /**
+   * Returns the number of elements in [lo, hi). The words before lo are
+   * skipped through the skip index and the scan stops at hi.
+   */
+  uint32_t countInRange(uint32_t lo, uint32_t hi) const {
+    hi = std::min<uint32_t>(hi, (uint32_t)last + 1);
+    if (isEmpty() || lo >= hi)
+      return 0;
+    const SkipEntry start = seekBlock(maxLiteralLengthDivision<word_t>(lo));
+    uint32_t answer = 0;
+    uint32_t firstBlock = start.block;
+    for (int32_t i = start.wordIndex; i <= lastWordIndex; i++) {
+      const word_t w = words[i];
+      const uint32_t blocks = getBlockCount(w);
+      const uint32_t first = maxLiteralLengthMultiplication<word_t>(firstBlock);
+      if (first >= hi)
+        break;
+      answer += getWordRankBelow(w, firstBlock, blocks, hi) -
+                getWordRankBelow(w, firstBlock, blocks, lo);
+      firstBlock += blocks;
+    }
+    return answer;
+  }
 
-      ConcisePtr x2 = pq.top();
-      pq.pop();
-      ConciseSet<wah_mode> *buffer = new ConciseSet<wah_mode>();
-      x1.ptr->logicalorToContainer(*(const ConciseSet<wah_mode> *)x2.ptr,
-                                   *buffer);
-      if (x1.own) {
-        delete x1.ptr;
+  /**
+   * Returns the set of the elements in [lo, hi), at their positions. Only
+   * the words overlapping the window are read: the words before lo are
+   * skipped through the skip index.
+   */
+  ConciseSet<wah_mode, word_t> slice(uint32_t lo, uint32_t hi) const {
+    ConciseSet<wah_mode, word_t> answer;
+    hi = std::min<uint32_t>(hi, (uint32_t)last + 1);
+    if (isEmpty() || lo >= hi)
+      return answer;
+    const uint32_t loBlock = maxLiteralLengthDivision<word_t>(lo);
+    const uint32_t hiBlock = maxLiteralLengthDivision<word_t>(hi - 1);
+    // bits of the first and of the last block of the window
+    const word_t loMask = word_traits::ALL_ONES_LITERAL
+                          << maxLiteralLengthModulus<word_t>(lo);
+    const word_t hiMask =
+        word_traits::ALL_ZEROS_LITERAL |
+        (word_traits::ALL_ONES_WITHOUT_MSB >>
+         (word_traits::MAX_LITERAL_LENGTH - 1 -
+          maxLiteralLengthModulus<word_t>(hi - 1)));
+    auto masked = [&](word_t literal, uint32_t block) {
+      if (block == loBlock)
+        literal &= loMask;
+      if (block == hiBlock)
+        literal &= hiMask;
+      return literal;
+    };
+    answer.words.resize(2);
+    if (loBlock > 0)
+      answer.appendFill(loBlock, 0);
+    const SkipEntry start = seekBlock(loBlock);
+    uint32_t firstBlock = start.block;
+    for (int32_t i = start.wordIndex;
+         i <= lastWordIndex && firstBlock <= hiBlock; i++) {
+      const word_t w = words[i];
+      const uint32_t wordBlock = firstBlock;
+      firstBlock += getBlockCount(w);
+      // blocks [block, end) of the word lie in the window
+      uint32_t block = std::max(wordBlock, loBlock);
+      const uint32_t end = std::min(firstBlock, hiBlock + 1);
+      if (block >= end)
+        continue;
+      answer.ensureCapacity(answer.lastWordIndex + 4);
+      if (isLiteral(w) || block == wordBlock) {
+        // a literal, or the first block of a sequence with its flipped bit
+        answer.appendLiteral(masked(getLiteral(w), block));
+        block++;
       }
-      if (x2.own) {
-        delete x2.ptr;
+      if (block == end)
+        continue;
+      const word_t fill = isOneSequence(w) ? word_traits::ALL_ONES_LITERAL
+                                           : word_traits::ALL_ZEROS_LITERAL;
+      if (block == loBlock) {
+        answer.appendLiteral(masked(fill, block));
+        block++;
       }
-      pq.push(ConcisePtr(buffer, true));
-    }
-    ConcisePtr x1 = pq.top();
-    pq.pop();
-
-    ConcisePtr x2 = pq.top();
-    pq.pop();
-
-    ConciseSet<wah_mode> container = x1.ptr->logicalor(*x2.ptr);
-
-    if (x1.own) {
-      delete x1.ptr;
-    }
-    if (x2.own) {
-      delete x2.ptr;
+      const uint32_t fillEnd = end == hiBlock + 1 ? hiBlock : end;
+      if (fillEnd > block) {
+        answer.appendFill(fillEnd - block, w);
+        block = fillEnd;
+      }
+      if (block < end)
+        answer.appendLiteral(masked(fill, block));
     }
-    return container;
+    if (!answer.isEmpty())
+      answer.trimZeros();
+    if (!answer.isEmpty())
+      answer.updateLast();
+    return answer;
   }
 
-  std::vector<uint32_t> words;
-
   /**
-   * Most significant set bit within the uncompressed bit string.
+   * Cardinalities of this & other, this - other and other - this restricted
+   * to the elements in [lo, hi), see ConciseView::similarity(). Both sets
+   * are walked together from lo, through their skip indexes, and the scan
+   * stops at hi; nothing is allocated. Fills lying on both sides of a block
+   * boundary inside the window are counted in one step.
    */
-  int32_t last;
+  ConciseSimilarity similarity(const ConciseSet<wah_mode, word_t> &other,
+                               uint32_t lo, uint32_t hi) const {
+    return similarityInRange(other, &other, lo, hi);
+  }
 
   /**
-   * Index of the last word in words
+   * Same as above for a view, which has no skip index: reaching lo in other
+   * costs a pass over its words before lo.
    */
-  int32_t lastWordIndex;
+  ConciseSimilarity similarity(const ConciseView<wah_mode, word_t> &other,
+                               uint32_t lo, uint32_t hi) const {
+    return similarityInRange(other, NULL, lo, hi);
+  }
 
   /**
-   * Resets to an empty set
+   * Counts of the binary operations restricted to the elements in [lo, hi),
+   * computed by a single bounded scan (see similarity())
    */
-  void reset() {
-    words.clear();
-    words.shrink_to_fit();
-    last = -1;
-    lastWordIndex = -1;
+  size_t logicalandCount(const ConciseSet<wah_mode, word_t> &other,
+                         uint32_t lo, uint32_t hi) const {
+    return similarity(other, lo, hi).intersection;
   }
 
-  uint32_t getLiteral(uint32_t word) {
-    if (isLiteral(word))
-      return word;
+  size_t logicalorCount(const ConciseSet<wah_mode, word_t> &other,
+                        uint32_t lo, uint32_t hi) const {
+    return similarity(other, lo, hi).unionCount();
+  }
 
-    if (wah_mode)
-      return isZeroSequence(word) ? ALL_ZEROS_LITERAL : ALL_ONES_LITERAL;
+  size_t logicalxorCount(const ConciseSet<wah_mode, word_t> &other,
+                         uint32_t lo, uint32_t hi) const {
+    return similarity(other, lo, hi).xorCount();
+  }
 
-    // get bits from 30 to 26 and use them to set the corresponding bit
-    // NOTE: "1 << (word >> 25)" and "1 << ((word >> 25) & 0x0000001F)" are
-    // equivalent
-    // NOTE: ">> 1" is required since 00000 represents no bits and 00001 the LSB
-    // bit set
-    uint32_t literal = (UINT32_C(1) << (word >> 25)) >> 1;
-    return isZeroSequence(word) ? (ALL_ZEROS_LITERAL | literal)
-                                : (ALL_ONES_LITERAL & ~literal);
+  size_t logicalandnotCount(const ConciseSet<wah_mode, word_t> &other,
+                            uint32_t lo, uint32_t hi) const {
+    return similarity(other, lo, hi).leftOnly;
   }
 
-  void clearBitsAfterInLastWord(int lastSetBit) {
-    words[lastWordIndex] &=
-        ALL_ZEROS_LITERAL | (UINT32_C(0xFFFFFFFF) >> (31 - lastSetBit));
+  size_t logicalandCount(const ConciseView<wah_mode, word_t> &other,
+                         uint32_t lo, uint32_t hi) const {
+    return similarity(other, lo, hi).intersection;
   }
 
-  void ensureCapacity(size_t index) {
-    if (words.size() > index)
-      return;
-    words.resize(index + 1);
+  size_t logicalorCount(const ConciseView<wah_mode, word_t> &other,
+                        uint32_t lo, uint32_t hi) const {
+    return similarity(other, lo, hi).unionCount();
   }
 
-  void shrink_to_fit() { words.shrink_to_fit(); }
+  size_t logicalxorCount(const ConciseView<wah_mode, word_t> &other,
+                         uint32_t lo, uint32_t hi) const {
+    return similarity(other, lo, hi).xorCount();
+  }
 
-  void trimZeros() {
-    // loop over ALL_ZEROS_LITERAL words
-    uint32_t w;
-    do {
-      w = words[lastWordIndex];
-      if (w == ALL_ZEROS_LITERAL) {
-        lastWordIndex--;
-      } else if (isZeroSequence(w)) {
-        if (wah_mode || isSequenceWithNoBits(w)) {
-          lastWordIndex--;
-        } else {
-          // convert the sequence in a 1-bit literal word
-          words[lastWordIndex] = getLiteral(w);
-          return;
-        }
+  size_t logicalandnotCount(const ConciseView<wah_mode, word_t> &other,
+                            uint32_t lo, uint32_t hi) const {
+    return similarity(other, lo, hi).leftOnly;
+  }
+
+  /**
+   * Walk behind similarity(other, lo, hi): otherSet, when not NULL, is the
+   * set viewed by other and lets it jump to lo through its skip index
+   */
+  ConciseSimilarity
+  similarityInRange(const ConciseView<wah_mode, word_t> &other,
+                    const ConciseSet<wah_mode, word_t> *otherSet, uint32_t lo,
+                    uint32_t hi) const {
+    ConciseSimilarity answer;
+    hi = std::min<uint32_t>(hi, (uint32_t)std::max(last, other.last) + 1);
+    if (lo >= hi)
+      return answer;
+    const uint32_t loBlock = maxLiteralLengthDivision<word_t>(lo);
+    const uint32_t hiBlock = maxLiteralLengthDivision<word_t>(hi - 1);
+    // bits of the first and of the last block of the window
+    const word_t loMask = word_traits::ALL_ONES_LITERAL
+                          << maxLiteralLengthModulus<word_t>(lo);
+    const word_t hiMask =
+        word_traits::ALL_ZEROS_LITERAL |
+        (word_traits::ALL_ONES_WITHOUT_MSB >>
+         (word_traits::MAX_LITERAL_LENGTH - 1 -
+          maxLiteralLengthModulus<word_t>(hi - 1)));
+    WordIterator<wah_mode, word_t> thisItr(*this);
+    WordIterator<wah_mode, word_t> otherItr(other);
+    uint32_t thisPosition = 0, otherPosition = 0;
+    advanceTo(thisItr, thisPosition, loBlock, this);
+    advanceTo(otherItr, otherPosition, loBlock, otherSet);
+    uint32_t block = loBlock;
+    while (block <= hiBlock) {
+      const bool thisDone = thisItr.exhausted();
+      const bool otherDone = otherItr.exhausted();
+      if (thisDone && otherDone)
+        break;
+      if (block != loBlock && block != hiBlock &&
+          (thisDone || !thisItr.IsLiteral) &&
+          (otherDone || !otherItr.IsLiteral)) {
+        // fills (or the end of a set) on both sides, short of the last block
+        uint32_t end = hiBlock;
+        if (!thisDone)
+          end = std::min(end, thisPosition + thisItr.count);
+        if (!otherDone)
+          end = std::min(end, otherPosition + otherItr.count);
+        const size_t values =
+            maxLiteralLengthMultiplication<word_t>(end - block);
+        const bool thisOnes =
+            !thisDone && (thisItr.word & word_traits::SEQUENCE_BIT);
+        const bool otherOnes =
+            !otherDone && (otherItr.word & word_traits::SEQUENCE_BIT);
+        if (thisOnes && otherOnes)
+          answer.intersection += values;
+        else if (thisOnes)
+          answer.leftOnly += values;
+        else if (otherOnes)
+          answer.rightOnly += values;
+        block = end;
       } else {
-        // one sequence or literal
-        return;
+        word_t mask = word_traits::ALL_ONES_LITERAL;
+        if (block == loBlock)
+          mask &= loMask;
+        if (block == hiBlock)
+          mask &= hiMask;
+        const word_t thisLiteral =
+            thisDone ? word_traits::ALL_ZEROS_LITERAL
+                     : (thisItr.IsLiteral ? thisItr.word : thisItr.toLiteral());
+        const word_t otherLiteral =
+            otherDone
+                ? word_traits::ALL_ZEROS_LITERAL
+                : (otherItr.IsLiteral ? otherItr.word : otherItr.toLiteral());
+        ConciseView<wah_mode, word_t>::addLiteralSimilarity(
+            thisLiteral & mask, otherLiteral & mask, answer);
+        block++;
       }
-      if (lastWordIndex < 0) {
-        reset();
+      advanceTo(thisItr, thisPosition, block, NULL);
+      advanceTo(otherItr, otherPosition, block, NULL);
+    }
+    return answer;
+  }
+
+  /**
+   * Union of n sets. Many inputs go through multiway_logicalor(), which
+   * reads every word once; few inputs, or inputs dominated by a single large
+   * set, go through pairwise_logicalor().
+   */
+  static ConciseSet<wah_mode, word_t>
+  fast_logicalor(size_t n, const ConciseSet<wah_mode, word_t> **inputs) {
+    ConciseSet<wah_mode, word_t> answer;
+    fast_logicalorToContainer(n, inputs, answer);
+    return answer;
+  }
+
+  static void fast_logicalorToContainer(
+      size_t n, const ConciseSet<wah_mode, word_t> **inputs,
+      ConciseSet<wah_mode, word_t> &res) {
+    size_t total = 0, largest = 0;
+    for (size_t i = 0; i < n; i++) {
+      const size_t w = inputs[i]->lastWordIndex + 1;
+      total += w;
+      largest = std::max(largest, w);
+    }
+    // merging the small sets first and the large one last touches the large
+    // set once, which is what the multiway merge does as well
+    if (n <= MULTIWAY_THRESHOLD || 2 * largest > total)
+      pairwise_logicalorToContainer(n, inputs, res);
+    else
+      multiway_logicalorToContainer(n, inputs, res);
+  }
+
+  /**
+   * Union of n sets in one pass over all of them, see multiway()
+   */
+  static ConciseSet<wah_mode, word_t>
+  multiway_logicalor(size_t n, const ConciseSet<wah_mode, word_t> **inputs) {
+    ConciseSet<wah_mode, word_t> answer;
+    multiway_logicalorToContainer(n, inputs, answer);
+    return answer;
+  }
+
+  static void multiway_logicalorToContainer(
+      size_t n, const ConciseSet<wah_mode, word_t> **inputs,
+      ConciseSet<wah_mode, word_t> &res) {
+    int32_t maxlast = -1;
+    for (size_t i = 0; i < n; i++)
+      maxlast = std::max(maxlast, inputs[i]->last);
+    const std::vector<MultiwayOp> ops(n, MULTIWAY_OR);
+    multiwayToContainer(n, inputs, ops.data(), getBlocksUpTo(maxlast), res);
+  }
+
+  /**
+   * Number of elements in the union of n sets, computed without
+   * materializing it
+   */
+  static size_t fast_logicalorCount(
+      size_t n, const ConciseSet<wah_mode, word_t> **inputs) {
+    if (n == 0)
+      return 0;
+    if (n == 1)
+      return inputs[0]->size();
+    if (n == 2)
+      return inputs[0]->logicalorCount(*inputs[1]);
+    int32_t maxlast = -1;
+    for (size_t i = 0; i < n; i++)
+      maxlast = std::max(maxlast, inputs[i]->last);
+    const std::vector<MultiwayOp> ops(n, MULTIWAY_OR);
+    return multiwayCount(n, inputs, ops.data(), getBlocksUpTo(maxlast));
+  }
+
+  /**
+   * Intersection of n sets. The inputs are taken smallest first: the two
+   * smallest are intersected on their own, which ends the computation when
+   * they are disjoint, and the rest is a multiway AND in which the blocks
+   * cleared by a zero fill of any input are skipped in all of them.
+   */
+  static ConciseSet<wah_mode, word_t>
+  fast_logicaland(size_t n, const ConciseSet<wah_mode, word_t> **inputs) {
+    ConciseSet<wah_mode, word_t> answer;
+    fast_logicalandToContainer(n, inputs, answer);
+    return answer;
+  }
+
+  static void fast_logicalandToContainer(
+      size_t n, const ConciseSet<wah_mode, word_t> **inputs,
+      ConciseSet<wah_mode, word_t> &res) {
+    if (n == 0) {
+      res.clear();
+      return;
+    }
+    if (n == 1) {
+      if (inputs[0] != &res)
+        res = *inputs[0];
+      return;
+    }
+    if (n == 2 && inputs[0] != &res && inputs[1] != &res) {
+      inputs[0]->logicalandToContainer(*inputs[1], res);
+      return;
+    }
+    std::vector<const ConciseSet<wah_mode, word_t> *> sorted(inputs,
+                                                             inputs + n);
+    sortBySize(sorted);
+    // the two smallest sets often leave little or nothing to intersect
+    ConciseSet<wah_mode, word_t> smallest;
+    sorted[0]->logicalandToContainer(*sorted[1], smallest);
+    if (smallest.isEmpty()) {
+      res.clear();
+      return;
+    }
+    sorted[1] = &smallest;
+    const std::vector<MultiwayOp> ops(n - 1, MULTIWAY_AND);
+    multiwayToContainer(n - 1, sorted.data() + 1, ops.data(),
+                        getBlocksUpTo(smallest.last), res);
+  }
+
+  /**
+   * Number of elements in the intersection of n sets, computed as in
+   * fast_logicaland() but without materializing the result: only the
+   * intersection of the two smallest sets is built
+   */
+  static size_t fast_logicalandCount(
+      size_t n, const ConciseSet<wah_mode, word_t> **inputs) {
+    if (n == 0)
+      return 0;
+    if (n == 1)
+      return inputs[0]->size();
+    if (n == 2)
+      return inputs[0]->logicalandCount(*inputs[1]);
+    std::vector<const ConciseSet<wah_mode, word_t> *> sorted(inputs,
+                                                             inputs + n);
+    sortBySize(sorted);
+    ConciseSet<wah_mode, word_t> smallest;
+    sorted[0]->logicalandToContainer(*sorted[1], smallest);
+    if (smallest.isEmpty())
+      return 0;
+    if (n == 3)
+      return smallest.logicalandCount(*sorted[2]);
+    sorted[1] = &smallest;
+    const std::vector<MultiwayOp> ops(n - 1, MULTIWAY_AND);
+    return multiwayCount(n - 1, sorted.data() + 1, ops.data(),
+                         getBlocksUpTo(smallest.last));
+  }
+
+  /**
+   * Symmetric difference of n sets: the elements that belong to an odd
+   * number of them
+   */
+  static ConciseSet<wah_mode, word_t>
+  fast_logicalxor(size_t n, const ConciseSet<wah_mode, word_t> **inputs) {
+    ConciseSet<wah_mode, word_t> answer;
+    fast_logicalxorToContainer(n, inputs, answer);
+    return answer;
+  }
+
+  static void fast_logicalxorToContainer(
+      size_t n, const ConciseSet<wah_mode, word_t> **inputs,
+      ConciseSet<wah_mode, word_t> &res) {
+    if (n == 1) {
+      if (inputs[0] != &res)
+        res = *inputs[0];
+      return;
+    }
+    if (n == 2 && inputs[0] != &res && inputs[1] != &res) {
+      inputs[0]->logicalxorToContainer(*inputs[1], res);
+      return;
+    }
+    int32_t maxlast = -1;
+    for (size_t i = 0; i < n; i++)
+      maxlast = std::max(maxlast, inputs[i]->last);
+    const std::vector<MultiwayOp> ops(n, MULTIWAY_XOR);
+    multiwayToContainer(n, inputs, ops.data(), getBlocksUpTo(maxlast), res);
+  }
+
+  static size_t fast_logicalxorCount(
+      size_t n, const ConciseSet<wah_mode, word_t> **inputs) {
+    if (n == 0)
+      return 0;
+    if (n == 1)
+      return inputs[0]->size();
+    if (n == 2)
+      return inputs[0]->logicalxorCount(*inputs[1]);
+    int32_t maxlast = -1;
+    for (size_t i = 0; i < n; i++)
+      maxlast = std::max(maxlast, inputs[i]->last);
+    const std::vector<MultiwayOp> ops(n, MULTIWAY_XOR);
+    return multiwayCount(n, inputs, ops.data(), getBlocksUpTo(maxlast));
+  }
+
+  /**
+   * Elements of inputs[0] that belong to none of inputs[1..n-1]. One fills
+   * of the subtracted sets are skipped in all inputs.
+   */
+  static ConciseSet<wah_mode, word_t>
+  fast_logicalandnot(size_t n, const ConciseSet<wah_mode, word_t> **inputs) {
+    ConciseSet<wah_mode, word_t> answer;
+    fast_logicalandnotToContainer(n, inputs, answer);
+    return answer;
+  }
+
+  static void fast_logicalandnotToContainer(
+      size_t n, const ConciseSet<wah_mode, word_t> **inputs,
+      ConciseSet<wah_mode, word_t> &res) {
+    if (n == 0) {
+      res.clear();
+      return;
+    }
+    if (n == 1) {
+      if (inputs[0] != &res)
+        res = *inputs[0];
+      return;
+    }
+    if (n == 2 && inputs[0] != &res && inputs[1] != &res) {
+      inputs[0]->logicalandnotToContainer(*inputs[1], res);
+      return;
+    }
+    const std::vector<MultiwayOp> ops(n, MULTIWAY_ANDNOT);
+    multiwayToContainer(n, inputs, ops.data(), getBlocksUpTo(inputs[0]->last),
+                        res);
+  }
+
+  static size_t fast_logicalandnotCount(
+      size_t n, const ConciseSet<wah_mode, word_t> **inputs) {
+    if (n == 0)
+      return 0;
+    if (n == 1)
+      return inputs[0]->size();
+    if (n == 2)
+      return inputs[0]->logicalandnotCount(*inputs[1]);
+    const std::vector<MultiwayOp> ops(n, MULTIWAY_ANDNOT);
+    return multiwayCount(n, inputs, ops.data(),
+                         getBlocksUpTo(inputs[0]->last));
+  }
+
+  /**
+   * Union of n sets computed by merging the two smallest sets until one is
+   * left. The buffers of consumed intermediate results are recycled as the
+   * output of later merges.
+   */
+  static ConciseSet<wah_mode, word_t>
+  pairwise_logicalor(size_t n, const ConciseSet<wah_mode, word_t> **inputs) {
+    ConciseSet<wah_mode, word_t> answer;
+    pairwise_logicalorToContainer(n, inputs, answer);
+    return answer;
+  }
+
+  static void pairwise_logicalorToContainer(
+      size_t n, const ConciseSet<wah_mode, word_t> **inputs,
+      ConciseSet<wah_mode, word_t> &res) {
+    class ConcisePtr {
+
+    public:
+      ConcisePtr(const ConciseSet<wah_mode, word_t> *p,
+                 ConciseSet<wah_mode, word_t> *o)
+          : ptr(p), own(o) {}
+      const ConciseSet<wah_mode, word_t> *ptr;
+      ConciseSet<wah_mode, word_t> *own; // intermediate result, NULL for inputs
+
+      bool operator<(const ConcisePtr &o) const {
+        return o.ptr->sizeInBytes() < ptr->sizeInBytes(); // backward on purpose
+      }
+    };
+
+    if (n == 0) {
+      res.clear();
+      return;
+    }
+    if (n == 1) {
+      if (inputs[0] != &res)
+        res = *inputs[0];
+      return;
+    }
+    for (size_t i = 0; i < n; i++) {
+      if (inputs[i] == &res) {
+        ConciseSet<wah_mode, word_t> tmp;
+        pairwise_logicalorToContainer(n, inputs, tmp);
+        res.swap(tmp);
         return;
       }
-    } while (true);
+    }
+    std::priority_queue<ConcisePtr> pq;
+    for (size_t i = 0; i < n; i++) {
+      pq.push(ConcisePtr(inputs[i], NULL));
+    }
+    // reserved up front so that pointers to intermediate results stay valid
+    std::vector<ConciseSet<wah_mode, word_t>> intermediates;
+    intermediates.reserve(n - 2);
+    std::vector<std::vector<word_t>> spare;
+    while (pq.size() > 2) {
+      ConcisePtr x1 = pq.top();
+      pq.pop();
+      ConcisePtr x2 = pq.top();
+      pq.pop();
+      intermediates.emplace_back();
+      ConciseSet<wah_mode, word_t> &buffer = intermediates.back();
+      if (!spare.empty()) {
+        buffer.words.swap(spare.back());
+        spare.pop_back();
+      }
+      x1.ptr->logicalorToContainer(*x2.ptr, buffer);
+      if (x1.own) {
+        spare.emplace_back();
+        spare.back().swap(x1.own->words);
+      }
+      if (x2.own) {
+        spare.emplace_back();
+        spare.back().swap(x2.own->words);
+      }
+      pq.push(ConcisePtr(&buffer, &buffer));
+    }
+    ConcisePtr x1 = pq.top();
+    pq.pop();
+    ConcisePtr x2 = pq.top();
+    pq.pop();
+    x1.ptr->logicalorToContainer(*x2.ptr, res);
   }
 
-  void append(uint32_t i) {
-    // special case of empty set
-    if (isEmpty()) {
-      uint32_t zeroBlocks = maxLiteralLengthDivision(i);
-      if (zeroBlocks == 0) {
-        words.resize(1);
-        lastWordIndex = 0;
-      } else if (zeroBlocks == 1) {
-        words.resize(2);
-        lastWordIndex = 1;
-        words[0] = ALL_ZEROS_LITERAL;
-      } else {
-        words.resize(2);
-        lastWordIndex = 1;
-        words[0] = zeroBlocks - 1;
+  /**
+   * Number of blocks needed to hold the values up to last
+   */
+  static uint32_t getBlocksUpTo(int32_t last) {
+    return last < 0 ? 0 : maxLiteralLengthDivision<word_t>(last) + 1;
+  }
+
+  static void sortBySize(
+      std::vector<const ConciseSet<wah_mode, word_t> *> &sets) {
+    std::sort(sets.begin(), sets.end(),
+              [](const ConciseSet<wah_mode, word_t> *x,
+                 const ConciseSet<wah_mode, word_t> *y) {
+                return x->lastWordIndex < y->lastWordIndex;
+              });
+  }
+
+  /**
+   * Writes the result of multiway() over the first blocks of the inputs
+   * into res, which may be one of the inputs
+   */
+  static void multiwayToContainer(size_t n,
+                                  const ConciseSet<wah_mode, word_t> **inputs,
+                                  const MultiwayOp *ops, uint32_t blocks,
+                                  ConciseSet<wah_mode, word_t> &res) {
+    for (size_t i = 0; i < n; i++) {
+      if (inputs[i] == &res) {
+        ConciseSet<wah_mode, word_t> tmp;
+        multiwayToContainer(n, inputs, ops, blocks, tmp);
+        res.swap(tmp);
+        return;
       }
-      last = i;
-      words[lastWordIndex] =
-          ALL_ZEROS_LITERAL | (UINT32_C(1) << maxLiteralLengthModulus(i));
+    }
+    std::vector<WordIterator<wah_mode, word_t>> its;
+    its.reserve(n);
+    size_t total = 0;
+    for (size_t i = 0; i < n; i++) {
+      its.emplace_back(*inputs[i]);
+      total += inputs[i]->lastWordIndex + 1;
+    }
+    // every output word covers at least one block and ends where the piece
+    // of some input ends (a Concise word makes up to two pieces)
+    res.prepareOutput(std::min(2 * total, (size_t)blocks) + 1);
+    ConciseSetSink<wah_mode, word_t> sink(res);
+    multiway(its, ops, blocks, sink, inputs);
+    if (!res.isEmpty())
+      res.trimZeros();
+    if (res.isEmpty()) {
+      res.reset();
       return;
     }
+    res.last = sink.getLast();
+  }
 
-    // position of the next bit to set within the current literal
-    uint32_t bit = maxLiteralLengthModulus(last) + i - last;
+  /**
+   * Number of elements in the result of multiway() over the first blocks of
+   * the inputs
+   */
+  static size_t multiwayCount(size_t n,
+                              const ConciseSet<wah_mode, word_t> **inputs,
+                              const MultiwayOp *ops, uint32_t blocks) {
+    std::vector<WordIterator<wah_mode, word_t>> its;
+    its.reserve(n);
+    for (size_t i = 0; i < n; i++)
+      its.emplace_back(*inputs[i]);
+    CardinalitySink sink;
+    multiway(its, ops, blocks, sink, inputs);
+    return sink.getCardinality();
+  }
 
-    // if we are outside the current literal, add zeros in
-    // between the current word and the new 1-bit literal word
-    if (bit >= MAX_LITERAL_LENGTH) {
-      int zeroBlocks = maxLiteralLengthDivision(bit) - 1;
-      bit = maxLiteralLengthModulus(bit);
-      if (zeroBlocks == 0) {
-        ensureCapacity(lastWordIndex + 1);
-      } else {
-        ensureCapacity(lastWordIndex + 2);
-        appendFill(zeroBlocks, 0);
+  /**
+   * Combines n sets one window of MULTIWAY_WINDOW blocks at a time: the
+   * window is decoded into an uncompressed buffer, input after input, and
+   * the buffer is handed to the sink. Every word of every input is read once
+   * and the buffer stays in cache, whatever the number of inputs. The first
+   * input is loaded into the buffer and input i > 0 is combined with ops[i].
+   * Blocks known to be zero in the output are skipped at once: those over
+   * which all inputs stand on zero fills, and those cleared by an input that
+   * is only followed by AND and ANDNOT operations (a zero fill for a loaded
+   * or ANDed input, a one fill for an ANDNOTed input). Trailing zeros are
+   * not handed to the sink. When the sets behind the iterators are given,
+   * inputs that fall far behind catch up through their skip index.
+   */
+  template <class Sink>
+  static void multiway(std::vector<WordIterator<wah_mode, word_t>> &its,
+                       const MultiwayOp *ops, uint32_t blocks, Sink &sink,
+                       const ConciseSet<wah_mode, word_t> *const *sets = NULL) {
+    const size_t n = its.size();
+    // inputs from conjunctive onwards can clear the output on their own
+    size_t conjunctive = n;
+    while (conjunctive > 1 && (ops[conjunctive - 1] == MULTIWAY_AND ||
+                               ops[conjunctive - 1] == MULTIWAY_ANDNOT))
+      conjunctive--;
+    if (conjunctive > 0)
+      conjunctive--;
+    // first block of the current piece of each iterator
+    std::vector<uint32_t> positions(n, 0);
+    std::vector<word_t> buffer(MULTIWAY_WINDOW);
+    uint32_t start = 0;
+    while (start < blocks) {
+      uint32_t common = blocks;
+      uint32_t cleared = start;
+      for (size_t i = 0; i < n; i++) {
+        WordIterator<wah_mode, word_t> &it = its[i];
+        uint32_t &position = positions[i];
+        advanceTo(it, position, start, sets == NULL ? NULL : sets[i]);
+        // zeros in a loaded or ANDed input clear the output
+        const bool load = i == 0 || ops[i] == MULTIWAY_AND;
+        if (it.exhausted()) {
+          if (i >= conjunctive && load)
+            cleared = blocks;
+          continue;
+        }
+        const bool fill = !it.IsLiteral;
+        const bool ones = it.word & word_traits::SEQUENCE_BIT;
+        common = std::min(common, fill && !ones ? position + it.count : start);
+        if (fill && i >= conjunctive &&
+            (ones ? ops[i] == MULTIWAY_ANDNOT && i > 0 : load))
+          cleared = std::max(cleared, position + it.count);
       }
-      appendLiteral(ALL_ZEROS_LITERAL | UINT32_C(1) << bit);
-    } else {
-      words[lastWordIndex] |= UINT32_C(1) << bit;
-      if (words[lastWordIndex] == ALL_ONES_LITERAL) {
-        lastWordIndex--;
-        appendLiteral(ALL_ONES_LITERAL);
+      const uint32_t zeros = std::min(blocks, std::max(common, cleared));
+      if (zeros >= blocks)
+        return;
+      // short runs of zeros are cheaper to decode than to skip
+      if (zeros - start >= MULTIWAY_MIN_SKIP) {
+        if (!sink.appendZeros(zeros - start))
+          return;
+        start = zeros;
+        continue;
+      }
+      const uint32_t length = std::min(MULTIWAY_WINDOW, blocks - start);
+      std::fill(buffer.begin(), buffer.begin() + length, 0);
+      for (size_t i = 0; i < n; i++) {
+        decodeWindow(its[i], positions[i], start, length,
+                     i == 0 ? MULTIWAY_OR : ops[i], buffer.data());
+        // the remaining inputs cannot bring back what this one cleared,
+        // they catch up with the next window
+        if (i >= conjunctive && i + 1 < n &&
+            isZeroWindow(buffer.data(), length))
+          break;
       }
+      if (!sink.append(buffer.data(), length))
+        return;
+      start += length;
     }
+  }
 
-    // update other info
-    last = i;
+  /**
+   * Moves the iterator, whose current piece begins at block position, to
+   * the piece holding block start. An iterator left far behind by skipped
+   * blocks jumps through the skip index of set, when given.
+   */
+  static void advanceTo(WordIterator<wah_mode, word_t> &it,
+                        uint32_t &position, uint32_t start,
+                        const ConciseSet<wah_mode, word_t> *set) {
+    if (set != NULL && start - position > MULTIWAY_WINDOW / 2 &&
+        !it.exhausted() && position + it.blocks() <= start) {
+      const SkipEntry entry = set->seekBlock(start);
+      if (entry.block > position) {
+        it.seekWord(entry.wordIndex);
+        position = entry.block;
+      }
+    }
+    while (!it.exhausted() && position + it.blocks() <= start) {
+      position += it.blocks();
+      it.nextPiece();
+    }
   }
 
-  void appendLiteral(uint32_t word) {
-    // when we have a zero sequence of the maximum length (that is,
-    // 00.00000.1111111111111111111111111 = 0x01FFFFFF), it could happen
-    // that we try to append a zero literal because the result of the given
-    // operation must be an
-    // empty set. Whitout the following test, we would have increased the
-    // counter of the zero sequence, thus obtaining 0x02000000 that
-    // represents a sequence with the first bit set!
-    if (lastWordIndex == 0 && word == ALL_ZEROS_LITERAL &&
-        words[0] == UINT32_C(0x01FFFFFF))
-      return;
+  static bool isZeroWindow(const word_t *buffer, uint32_t length) {
+    word_t bits = 0;
+    for (uint32_t k = 0; k < length; k++)
+      bits |= buffer[k];
+    return bits == 0;
+  }
 
-    // first addition
-    if (lastWordIndex < 0) {
-      words[lastWordIndex = 0] = word;
-      return;
+  /**
+   * Combines the blocks [start, start + length) of the iterator, whose
+   * current piece begins at block position, into the literal bits stored in
+   * buffer
+   */
+  static void decodeWindow(WordIterator<wah_mode, word_t> &it,
+                           uint32_t &position, uint32_t start, uint32_t length,
+                           MultiwayOp op, word_t *buffer) {
+    const uint32_t end = start + length;
+    while (!it.exhausted() && position < end) {
+      const uint32_t pieceEnd = position + it.blocks();
+      if (it.IsLiteral) {
+        // a literal is one block, so it cannot begin before the window
+        word_t &b = buffer[position - start];
+        const word_t bits = getLiteralBits(it.word);
+        switch (op) {
+        case MULTIWAY_OR:
+          b |= bits;
+          break;
+        case MULTIWAY_AND:
+          b &= bits;
+          break;
+        case MULTIWAY_XOR:
+          b ^= bits;
+          break;
+        case MULTIWAY_ANDNOT:
+          b &= ~bits;
+          break;
+        }
+      } else {
+        word_t *from = buffer + (std::max(position, start) - start);
+        word_t *to = buffer + (std::min(pieceEnd, end) - start);
+        if (it.word & word_traits::SEQUENCE_BIT) {
+          if (op == MULTIWAY_OR)
+            std::fill(from, to, word_traits::ALL_ONES_WITHOUT_MSB);
+          else if (op == MULTIWAY_ANDNOT)
+            std::fill(from, to, 0);
+          else if (op == MULTIWAY_XOR)
+            for (; from != to; ++from)
+              *from ^= word_traits::ALL_ONES_WITHOUT_MSB;
+        } else if (op == MULTIWAY_AND) {
+          std::fill(from, to, 0);
+        }
+      }
+      if (pieceEnd > end)
+        return;
+      position = pieceEnd;
+      it.nextPiece();
+    }
+    // past its end, an input is made of zeros
+    if (op == MULTIWAY_AND && position < end)
+      std::fill(buffer + (std::max(position, start) - start), buffer + length,
+                0);
+  }
+
+  std::vector<word_t> words;
+
+  /**
+   * Most significant set bit within the uncompressed bit string.
+   */
+  int32_t last;
+
+  /**
+   * Index of the last word in words
+   */
+  int32_t lastWordIndex;
+
+  /**
+   * Number of set bits, or -1 when unknown. It becomes known as soon as the
+   * first word is appended and is then kept up to date by appendLiteral()
+   * and appendFill(), so that size() is constant time. Code that edits
+   * words directly must set it to -1.
+   */
+  mutable int64_t cardinality;
+
+  /**
+   * Entry of the skip index: the position of a word within words, together
+   * with the number of blocks and of set bits that precede it.
+   */
+  struct SkipEntry {
+    int32_t wordIndex;
+    uint32_t block;
+    uint32_t rank;
+  };
+
+  /**
+   * Skip index over words, with one entry every SKIP_INDEX_INTERVAL words.
+   * It doubles as the rank directory used by rank() and select().
+   * It is kept up to date by the operations that write words
+   * (appendLiteral(), appendFill(), replaceBlock()...), so that const
+   * methods such as contains() or rank() only ever read it and may run
+   * concurrently. Appending only ever rewrites words[lastWordIndex] in place
+   * or adds words after it, so the entries up to lastWordIndex stay valid;
+   * entries past lastWordIndex are dropped whenever lastWordIndex goes
+   * backward. Code that edits words directly must call clearSkipIndex() and
+   * then updateSkipIndex().
+   */
+  std::vector<SkipEntry> skipIndex;
+
+  /**
+   * Spare words used by the in-place operations (logicalorInPlace, |=...)
+   */
+  std::vector<word_t> scratch;
+
+  /**
+   * Resets to an empty set
+   */
+  void reset() {
+    words.clear();
+    words.shrink_to_fit();
+    last = -1;
+    lastWordIndex = -1;
+    cardinality = -1;
+    clearSkipIndex();
+  }
+
+  /**
+   * Empties the set while keeping room for the given number of words, so that
+   * the result of an operation can be written through appendLiteral() and
+   * appendFill()
+   */
+  void prepareOutput(size_t capacity) {
+    words.resize(capacity);
+    last = -1;
+    lastWordIndex = -1;
+    cardinality = -1;
+    clearSkipIndex();
+  }
+
+  void clearSkipIndex() { skipIndex.clear(); }
+
+  /**
+   * Drops the entries of the skip index that are past lastWordIndex
+   */
+  void truncateSkipIndex() { invalidateSkipIndexAfter(lastWordIndex); }
+
+  /**
+   * Drops the entries of the skip index that are past the given word
+   */
+  void invalidateSkipIndexAfter(int32_t wordIndex) {
+    while (!skipIndex.empty() && skipIndex.back().wordIndex > wordIndex)
+      skipIndex.pop_back();
+  }
+
+  /**
+   * Number of blocks represented by the given word
+   */
+  static uint32_t getBlockCount(word_t word) {
+    return isLiteral(word) ? 1 : (uint32_t)getSequenceCount<wah_mode>(word) + 1;
+  }
+
+  /**
+   * Extends the skip index so that it covers words[0..lastWordIndex]. It
+   * returns at once unless SKIP_INDEX_INTERVAL words were added since the
+   * last entry, so that appending a word costs O(1) amortized.
+   */
+  void updateSkipIndex() {
+    const int32_t indexed = skipIndex.empty() ? 0 : skipIndex.back().wordIndex;
+    if (lastWordIndex < indexed + (int32_t)SKIP_INDEX_INTERVAL)
+      return;
+    if (skipIndex.empty())
+      skipIndex.push_back(SkipEntry{0, 0, 0});
+    int32_t i = skipIndex.back().wordIndex;
+    uint32_t block = skipIndex.back().block;
+    uint32_t rank = skipIndex.back().rank;
+    while (i + (int32_t)SKIP_INDEX_INTERVAL <= lastWordIndex) {
+      const int32_t next = i + SKIP_INDEX_INTERVAL;
+      for (; i < next; i++) {
+        block += getBlockCount(words[i]);
+        rank += getWordCardinality(words[i]);
+      }
+      skipIndex.push_back(SkipEntry{i, block, rank});
+    }
+  }
+
+  /**
+   * Returns the skip index entry of a word at or before the one holding the
+   * given block. The caller is expected to scan forward from there.
+   */
+  SkipEntry seekBlock(uint32_t block) const {
+    assert(skipIndex.empty() || skipIndex.back().wordIndex <= lastWordIndex);
+    if (skipIndex.empty())
+      return SkipEntry{0, 0, 0};
+    // the first entry has block 0, so the search never returns begin()
+    auto it = std::upper_bound(
+        skipIndex.begin(), skipIndex.end(), block,
+        [](uint32_t b, const SkipEntry &e) { return b < e.block; });
+    return *(--it);
+  }
+
+  /**
+   * Returns the skip index entry of a word at or before the one holding the
+   * k-th set bit. The caller is expected to scan forward from there.
+   */
+  SkipEntry seekRank(uint32_t k) const {
+    assert(skipIndex.empty() || skipIndex.back().wordIndex <= lastWordIndex);
+    if (skipIndex.empty())
+      return SkipEntry{0, 0, 0};
+    // the first entry has rank 0, so the search never returns begin()
+    auto it = std::upper_bound(
+        skipIndex.begin(), skipIndex.end(), k,
+        [](uint32_t r, const SkipEntry &e) { return r < e.rank; });
+    return *(--it);
+  }
+
+  static word_t getLiteral(word_t word) {
+    if (isLiteral(word))
+      return word;
+
+    if (wah_mode)
+      return isZeroSequence(word) ? word_traits::ALL_ZEROS_LITERAL
+                                  : word_traits::ALL_ONES_LITERAL;
+
+    // get bits from 30 to 26 and use them to set the corresponding bit
+    // NOTE: "1 << (word >> 25)" and "1 << ((word >> 25) & 0x0000001F)" are
+    // equivalent on x86, but only the latter is defined for 1's sequences
+    // NOTE: ">> 1" is required since 00000 represents no bits and 00001 the LSB
+    // bit set
+    word_t literal = ((word_t)1 << ((word >> word_traits::FLIPPED_BIT_SHIFT) &
+                                    word_traits::FLIPPED_BIT_MASK)) >>
+                     1;
+    return isZeroSequence(word) ? (word_traits::ALL_ZEROS_LITERAL | literal)
+                                : (word_traits::ALL_ONES_LITERAL & ~literal);
+  }
+
+  void clearBitsAfterInLastWord(int lastSetBit) {
+    words[lastWordIndex] &=
+        word_traits::ALL_ZEROS_LITERAL |
+        (word_traits::ALL_ONES_LITERAL >>
+         (word_traits::MAX_LITERAL_LENGTH - lastSetBit));
+  }
+
+  void ensureCapacity(size_t index) {
+    if (words.size() > index)
+      return;
+    words.resize(index + 1);
+  }
+
+  void shrink_to_fit() { words.shrink_to_fit(); }
+
+  void trimZeros() {
+    // loop over ALL_ZEROS_LITERAL words
+    word_t w;
+    do {
+      w = words[lastWordIndex];
+      if (w == word_traits::ALL_ZEROS_LITERAL) {
+        lastWordIndex--;
+      } else if (isZeroSequence(w)) {
+        if (wah_mode || isSequenceWithNoBits(w)) {
+          lastWordIndex--;
+        } else {
+          // convert the sequence in a 1-bit literal word
+          words[lastWordIndex] = getLiteral(w);
+          return;
+        }
+      } else {
+        // one sequence or literal
+        return;
+      }
+      if (lastWordIndex < 0) {
+        reset();
+        return;
+      }
+      truncateSkipIndex();
+    } while (true);
+  }
+
+  void append(uint32_t i) {
+    // special case of empty set
+    if (isEmpty()) {
+      uint32_t zeroBlocks = maxLiteralLengthDivision<word_t>(i);
+      if (zeroBlocks == 0) {
+        words.resize(1);
+        lastWordIndex = 0;
+      } else if (zeroBlocks == 1) {
+        words.resize(2);
+        lastWordIndex = 1;
+        words[0] = word_traits::ALL_ZEROS_LITERAL;
+      } else {
+        words.resize(2);
+        lastWordIndex = 1;
+        words[0] = zeroBlocks - 1;
+      }
+      last = i;
+      words[lastWordIndex] =
+          word_traits::ALL_ZEROS_LITERAL |
+          ((word_t)1 << maxLiteralLengthModulus<word_t>(i));
+      cardinality = 1;
+      return;
+    }
+
+    // position of the next bit to set within the current literal
+    uint32_t bit = maxLiteralLengthModulus<word_t>(last) + i - last;
+
+    // if we are outside the current literal, add zeros in
+    // between the current word and the new 1-bit literal word
+    if (bit >= word_traits::MAX_LITERAL_LENGTH) {
+      int zeroBlocks = maxLiteralLengthDivision<word_t>(bit) - 1;
+      bit = maxLiteralLengthModulus<word_t>(bit);
+      if (zeroBlocks == 0) {
+        ensureCapacity(lastWordIndex + 1);
+      } else {
+        ensureCapacity(lastWordIndex + 2);
+        appendFill(zeroBlocks, 0);
+      }
+      appendLiteral(word_traits::ALL_ZEROS_LITERAL | (word_t)1 << bit);
+    } else {
+      words[lastWordIndex] |= (word_t)1 << bit;
+      if (cardinality >= 0)
+        cardinality++;
+      if (words[lastWordIndex] == word_traits::ALL_ONES_LITERAL) {
+        // the full literal is appended again, possibly merged into a fill
+        if (cardinality >= 0)
+          cardinality -= word_traits::MAX_LITERAL_LENGTH;
+        lastWordIndex--;
+        // the literal may be merged into the previous word
+        truncateSkipIndex();
+        appendLiteral(word_traits::ALL_ONES_LITERAL);
+      }
+    }
+
+    // update other info
+    last = i;
+  }
+
+  /**
+   * Builds a set from the sorted values in [begin, end); duplicates are
+   * allowed. Throws std::runtime_error on unsorted or out of bound values.
+   */
+  static ConciseSet<wah_mode, word_t> fromSorted(const uint32_t *begin,
+                                                 const uint32_t *end) {
+    ConciseSet<wah_mode, word_t> answer;
+    answer.addMany(begin, end);
+    return answer;
+  }
+
+  /**
+   * Adds the sorted values in [begin, end); duplicates are allowed. When all
+   * values are greater than last, the words are emitted directly in one pass
+   * after sizing words once; otherwise the batch is merged with logicalor.
+   * Throws std::runtime_error on unsorted or out of bound values.
+   */
+  void addMany(const uint32_t *begin, const uint32_t *end) {
+    if (begin == end)
+      return;
+    // validate the input and bound the number of words: every new block
+    // takes at most one literal, and every gap between blocks one fill
+    size_t maxWords = lastWordIndex + 3;
+    uint32_t previous = *begin;
+    uint32_t previousBlock = maxLiteralLengthDivision<word_t>(previous);
+    for (const uint32_t *p = begin; p != end; p++) {
+      if (*p > word_traits::MAX_ALLOWED_INTEGER) {
+        std::cerr << "max integer allowed is "
+                  << word_traits::MAX_ALLOWED_INTEGER << std::endl;
+        throw std::runtime_error("out of bound value");
+      }
+      if (*p < previous)
+        throw std::runtime_error("values must be sorted");
+      const uint32_t block = maxLiteralLengthDivision<word_t>(*p);
+      if (block != previousBlock)
+        maxWords += (block == previousBlock + 1) ? 1 : 2;
+      previous = *p;
+      previousBlock = block;
+    }
+    if ((int32_t)*begin <= last) {
+      ConciseSet<wah_mode, word_t> batch = fromSorted(begin, end);
+      ConciseSet<wah_mode, word_t> newbitmap = this->logicalor(batch);
+      this->swap(newbitmap);
+      return;
+    }
+    ensureCapacity(maxWords);
+
+    // the literal under construction, kept in a register until its block ends
+    uint32_t block = maxLiteralLengthDivision<word_t>(*begin);
+    word_t literal = word_traits::ALL_ZEROS_LITERAL;
+    if (isEmpty()) {
+      if (block > 0)
+        appendFill(block, 0);
+    } else {
+      const uint32_t lastBlock = maxLiteralLengthDivision<word_t>(last);
+      const word_t lastWord = words[lastWordIndex];
+      if (lastBlock == block && isLiteral(lastWord)) {
+        // resume the last literal, it is appended again below
+        literal = lastWord;
+        if (cardinality >= 0)
+          cardinality -= getLiteralBitCount(lastWord);
+        lastWordIndex--;
+        // the literal may be merged into the previous word
+        truncateSkipIndex();
+      } else if (block > lastBlock + 1) {
+        appendFill(block - lastBlock - 1, 0);
+      }
+    }
+    for (const uint32_t *p = begin; p != end; p++) {
+      const uint32_t b = maxLiteralLengthDivision<word_t>(*p);
+      if (b != block) {
+        appendLiteral(literal);
+        if (b > block + 1)
+          appendFill(b - block - 1, 0);
+        block = b;
+        literal = word_traits::ALL_ZEROS_LITERAL;
+      }
+      literal |= (word_t)1 << maxLiteralLengthModulus<word_t>(*p);
+    }
+    appendLiteral(literal);
+    last = *(end - 1);
+  }
+
+  /**
+   * Builds the set of the values in [lo, hi): a fill of zeros, then at most
+   * two literals around a fill of ones. Throws std::runtime_error if hi - 1
+   * is out of bound.
+   */
+  static ConciseSet<wah_mode, word_t> fromRange(uint32_t lo, uint32_t hi) {
+    ConciseSet<wah_mode, word_t> answer;
+    if (lo >= hi)
+      return answer;
+    if (hi - 1 > word_traits::MAX_ALLOWED_INTEGER) {
+      std::cerr << "max integer allowed is "
+                << word_traits::MAX_ALLOWED_INTEGER << std::endl;
+      throw std::runtime_error("out of bound value");
+    }
+    const uint32_t firstBlock = maxLiteralLengthDivision<word_t>(lo);
+    const uint32_t lastBlock = maxLiteralLengthDivision<word_t>(hi - 1);
+    // bits from the first value of the range up, and up to its last value
+    const word_t head = word_traits::ALL_ONES_LITERAL
+                        << maxLiteralLengthModulus<word_t>(lo);
+    const word_t tail =
+        word_traits::ALL_ZEROS_LITERAL |
+        (word_traits::ALL_ONES_WITHOUT_MSB >>
+         (word_traits::MAX_LITERAL_LENGTH - 1 -
+          maxLiteralLengthModulus<word_t>(hi - 1)));
+    answer.words.resize(4);
+    if (firstBlock > 0)
+      answer.appendFill(firstBlock, 0);
+    if (firstBlock == lastBlock) {
+      answer.appendLiteral(head & tail);
+    } else {
+      answer.appendLiteral(word_traits::ALL_ZEROS_LITERAL | head);
+      if (lastBlock > firstBlock + 1)
+        answer.appendFill(lastBlock - firstBlock - 1,
+                          word_traits::SEQUENCE_BIT);
+      answer.appendLiteral(tail);
+    }
+    answer.last = (int32_t)(hi - 1);
+    return answer;
+  }
+
+  /**
+   * Adds, removes or flips the values in [lo, hi). The range is built with
+   * fromRange() and merged with the set in one pass by the in-place
+   * operations. Throws std::runtime_error if hi - 1 is out of bound.
+   */
+  void addRange(uint32_t lo, uint32_t hi) {
+    if (lo < hi)
+      logicalorInPlace(fromRange(lo, hi));
+  }
+
+  void removeRange(uint32_t lo, uint32_t hi) {
+    if (lo >= hi || isEmpty())
+      return;
+    hi = std::min<uint32_t>(hi, (uint32_t)last + 1);
+    if (lo < hi)
+      logicalandnotInPlace(fromRange(lo, hi));
+  }
+
+  void flipRange(uint32_t lo, uint32_t hi) {
+    if (lo < hi)
+      logicalxorInPlace(fromRange(lo, hi));
+  }
+
+  void appendLiteral(word_t word) {
+    // when we have a zero sequence of the maximum length (that is,
+    // 00.00000.1111111111111111111111111 = 0x01FFFFFF), it could happen
+    // that we try to append a zero literal because the result of the given
+    // operation must be an
+    // empty set. Whitout the following test, we would have increased the
+    // counter of the zero sequence, thus obtaining 0x02000000 that
+    // represents a sequence with the first bit set!
+    if (lastWordIndex == 0 && word == word_traits::ALL_ZEROS_LITERAL &&
+        words[0] == word_traits::CONCISE_COUNT_MASK)
+      return;
+
+    // first addition
+    if (lastWordIndex < 0) {
+      words[lastWordIndex = 0] = word;
+      cardinality = getLiteralBitCount(word);
+      return;
+    }
+    if (cardinality >= 0)
+      cardinality += getLiteralBitCount(word);
+
+    const word_t lastWord = words[lastWordIndex];
+    if (word == word_traits::ALL_ZEROS_LITERAL) {
+      if (lastWord == word_traits::ALL_ZEROS_LITERAL)
+        words[lastWordIndex] = 1;
+      else if (isZeroSequence(lastWord) && !isFullSequence(lastWord))
+        words[lastWordIndex]++;
+      else if (!wah_mode && containsOnlyOneBit(getLiteralBits(lastWord)))
+        words[lastWordIndex] = 1 | flippedBitField(lastWord);
+      else
+        words[++lastWordIndex] = word;
+    } else if (word == word_traits::ALL_ONES_LITERAL) {
+      if (lastWord == word_traits::ALL_ONES_LITERAL)
+        words[lastWordIndex] = word_traits::SEQUENCE_BIT | 1;
+      else if (isOneSequence(lastWord) && !isFullSequence(lastWord))
+        words[lastWordIndex]++;
+      else if (!wah_mode && containsOnlyOneBit(~lastWord))
+        words[lastWordIndex] =
+            word_traits::SEQUENCE_BIT | 1 | flippedBitField(~lastWord);
+      else
+        words[++lastWordIndex] = word;
+    } else {
+      words[++lastWordIndex] = word;
+    }
+    updateSkipIndex();
+  }
+
+  void appendFill(uint32_t length, word_t fillType) {
+
+    fillType &= word_traits::SEQUENCE_BIT;
+
+    // it is actually a literal...
+    if (length == 1) {
+      appendLiteral(fillType == 0 ? word_traits::ALL_ZEROS_LITERAL
+                                  : word_traits::ALL_ONES_LITERAL);
+      return;
+    }
+    // empty set
+    if (lastWordIndex < 0) {
+      words[lastWordIndex = 0] = fillType | (length - 1);
+      cardinality =
+          fillType == 0 ? 0 : maxLiteralLengthMultiplication<word_t>(length);
+      return;
+    }
+    if (cardinality >= 0 && fillType != 0)
+      cardinality += maxLiteralLengthMultiplication<word_t>(length);
+    word_t lastWord = words[lastWordIndex];
+    if (isLiteral(lastWord)) {
+      if (fillType == 0 && lastWord == word_traits::ALL_ZEROS_LITERAL) {
+        words[lastWordIndex] = length;
+      } else if (fillType == word_traits::SEQUENCE_BIT &&
+                 lastWord == word_traits::ALL_ONES_LITERAL) {
+        words[lastWordIndex] = word_traits::SEQUENCE_BIT | length;
+      } else if (!wah_mode) {
+        if (fillType == 0 && containsOnlyOneBit(getLiteralBits(lastWord))) {
+          words[lastWordIndex] = length | flippedBitField(lastWord);
+        } else if (fillType == word_traits::SEQUENCE_BIT &&
+                   containsOnlyOneBit(~lastWord)) {
+          words[lastWordIndex] =
+              word_traits::SEQUENCE_BIT | length | flippedBitField(~lastWord);
+        } else {
+          words[++lastWordIndex] = fillType | (length - 1);
+        }
+      } else {
+        words[++lastWordIndex] = fillType | (length - 1);
+      }
+    } else {
+      if ((lastWord & word_traits::TYPE_MASK) == fillType &&
+          getSequenceCount<wah_mode>(lastWord) + length <=
+              maxSequenceCount()) {
+        words[lastWordIndex] += length;
+      } else {
+        words[++lastWordIndex] = fillType | (length - 1);
+      }
+    }
+    updateSkipIndex();
+  }
+
+  /**
+   * Largest count field of a sequence: with 32-bit Concise words, a
+   * sequence spans at most 2^25 blocks, one less than the whole range of
+   * values
+   */
+  static constexpr word_t maxSequenceCount() {
+    return wah_mode ? word_traits::WAH_COUNT_MASK
+                    : word_traits::CONCISE_COUNT_MASK;
+  }
+
+  static bool isFullSequence(word_t word) {
+    return getSequenceCount<wah_mode>(word) == maxSequenceCount();
+  }
+
+  /**
+   * Sequence bits recording the lowest set bit of a literal as the flipped
+   * bit
+   */
+  static word_t flippedBitField(word_t literal) {
+    return (word_t)(1 + word_traits::ctz(literal))
+           << word_traits::FLIPPED_BIT_SHIFT;
+  }
+
+  /**
+   * Appends a word of another set through appendLiteral() and appendFill(),
+   * so that it gets merged with the current last word when possible
+   */
+  void appendWord(word_t word) {
+    if (isLiteral(word)) {
+      appendLiteral(word);
+      return;
+    }
+    const uint32_t blocks = (uint32_t)getSequenceCount<wah_mode>(word) + 1;
+    if (!wah_mode && !isSequenceWithNoBits(word)) {
+      appendLiteral(getLiteral(word));
+      if (blocks > 1)
+        appendFill(blocks - 1, word);
+    } else {
+      appendFill(blocks, word);
+    }
+  }
+
+  void updateLast() {
+    // unsigned, as the bits of the last block may go past INT32_MAX
+    uint32_t bits = 0;
+    for (int32_t i = 0; i <= lastWordIndex; i++) {
+      word_t w = words[i];
+      if (isLiteral(w))
+        bits += word_traits::MAX_LITERAL_LENGTH;
+      else
+        bits += maxLiteralLengthMultiplication<word_t>(
+            (uint32_t)getSequenceCount<wah_mode>(w) + 1);
+    }
+
+    word_t w = words[lastWordIndex];
+    if (isLiteral(w))
+      last = (int32_t)(bits - word_traits::clz(getLiteralBits(w)));
+    else
+      last = (int32_t)(bits - 1);
+  }
+};
+
+/**
+ * Read-only view over the words of a set that lives elsewhere: a ConciseSet,
+ * or a buffer written by ConciseSet::serialize(), such as a memory-mapped
+ * file. The view never copies nor owns the words, so the buffer must outlive
+ * it. All the read-only operations of ConciseSet are available, and they
+ * accept either views or sets as arguments.
+ */
+template <bool wah_mode = false, class word_t = uint32_t> class ConciseView {
+
+public:
+  typedef ConciseWord<word_t> word_traits;
+
+  ConciseView() : words(nullptr), last(-1), lastWordIndex(-1), cardinality(0) {}
+
+  ConciseView(const ConciseSet<wah_mode, word_t> &cs)
+      : words(cs.words.data()), last(cs.last), lastWordIndex(cs.lastWordIndex),
+        cardinality(cs.cardinality) {}
+
+  /**
+   * Views numberOfWords words whose greatest element is last
+   */
+  ConciseView(const word_t *w, size_t numberOfWords, int32_t l)
+      : words(w), last(l), lastWordIndex((int32_t)numberOfWords - 1),
+        cardinality(-1) {}
+
+  /**
+   * Views a set written by ConciseSet::serialize() into buffer, of size
+   * maxbytes, without copying it. Throws std::runtime_error if the buffer
+   * does not hold a valid set of the same mode and word size, if the host is
+   * not little-endian, or if the words are not aligned (64-bit words need a
+   * buffer aligned on 8 bytes).
+   */
+  static ConciseView<wah_mode, word_t> fromBuffer(const uint32_t *buffer,
+                                          size_t maxbytes) {
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    (void)buffer;
+    (void)maxbytes;
+    throw std::runtime_error("views require a little-endian host");
+#else
+    ConciseView<wah_mode, word_t> answer;
+    uint32_t cardinality;
+    const uint32_t numberOfWords =
+        readHeader((const char *)buffer, maxbytes, answer.last, cardinality);
+    const uint32_t *first = buffer + CONCISE_SERIAL_HEADER_WORDS;
+    if ((uintptr_t)first % alignof(word_t) != 0)
+      throw std::runtime_error("misaligned buffer");
+    answer.words = reinterpret_cast<const word_t *>(first);
+    answer.lastWordIndex = (int32_t)numberOfWords - 1;
+    answer.cardinality = cardinality;
+    return answer;
+#endif
+  }
+
+  /**
+   * Checks the header written by ConciseSet::serialize() and returns the
+   * number of words that follow it.
+   */
+  static uint32_t readHeader(const char *buffer, size_t maxbytes,
+                             int32_t &last, uint32_t &cardinality) {
+    const size_t headerbytes = CONCISE_SERIAL_HEADER_WORDS * sizeof(uint32_t);
+    if (maxbytes < headerbytes)
+      throw std::runtime_error("truncated buffer");
+    if (readLittleEndian32(buffer) != CONCISE_SERIAL_COOKIE)
+      throw std::runtime_error("not a serialized ConciseSet");
+    if (readLittleEndian32(buffer + 4) != CONCISE_SERIAL_VERSION)
+      throw std::runtime_error("unsupported serialization version");
+    const uint32_t flags = readLittleEndian32(buffer + 8);
+    if (((flags & CONCISE_SERIAL_WAH_FLAG) != 0) != wah_mode)
+      throw std::runtime_error("WAH/Concise mode mismatch");
+    if (((flags & CONCISE_SERIAL_WIDE_FLAG) != 0) != (sizeof(word_t) == 8))
+      throw std::runtime_error("word size mismatch");
+    const uint32_t numberOfWords = readLittleEndian32(buffer + 12);
+    if (numberOfWords > (maxbytes - headerbytes) / sizeof(word_t))
+      throw std::runtime_error("truncated buffer");
+    last = (int32_t)readLittleEndian32(buffer + 16);
+    cardinality = readLittleEndian32(buffer + 20);
+    return numberOfWords;
+  }
+
+  bool isEmpty() const { return lastWordIndex == -1; }
+
+  uint32_t size() const {
+    if (cardinality < 0) {
+      uint32_t cardsize = 0;
+      for (int i = 0; i <= lastWordIndex; i++)
+        cardsize += ConciseSet<wah_mode, word_t>::getWordCardinality(words[i]);
+      cardinality = cardsize;
+    }
+    return (uint32_t)cardinality;
+  }
+
+  typedef ConciseSetBitForwardIterator<wah_mode, word_t> const_iterator;
+
+  const_iterator begin() const;
+
+  const_iterator & end() const;
+
+  typedef ConciseSetBitReverseIterator<wah_mode, word_t>
+      const_reverse_iterator;
+
+  /**
+   * Visits the values from the largest down
+   */
+  const_reverse_iterator rbegin() const;
+
+  const_reverse_iterator rend() const;
+
+  bool contains(uint32_t o) const { return containsFromWord(o, 0, 0); }
+
+  /**
+   * Writes the values of the set in increasing order to out, which must have
+   * room for size() values, and returns their number. Literals are decoded
+   * and fills are expanded with AVX2 when the processor supports it, and
+   * with plain scalar code otherwise.
+   */
+  size_t toArray(uint32_t *out) const {
+#ifdef CONCISE_X86_DECODE
+    if (useAVX2Decoder())
+      return decodeAVX2(out);
+#endif
+    return decode<ScalarDecoder>(out);
+  }
+
+  std::vector<uint32_t> toVector() const {
+    std::vector<uint32_t> answer(size());
+    toArray(answer.data());
+    return answer;
+  }
+
+  /**
+   * toArray() with the given kernels (see ScalarDecoder)
+   */
+  template <class Decoder> size_t decode(uint32_t *out) const {
+    const uint32_t *end = out + size();
+    uint32_t *p = out;
+    uint32_t base = 0; // first value of the current block
+    for (int32_t i = 0; i <= lastWordIndex; i++) {
+      const word_t w = words[i];
+      if (isLiteral(w)) {
+        p = Decoder::bits(getLiteralBits(w), base, p, end);
+        base += word_traits::MAX_LITERAL_LENGTH;
+        continue;
+      }
+      const uint32_t blocks = (uint32_t)getSequenceCount<wah_mode>(w) + 1;
+      const int flipped = wah_mode ? -1 : getFlippedBit(w);
+      if (isZeroSequence(w)) {
+        if (flipped >= 0)
+          *p++ = base + (uint32_t)flipped;
+      } else if (flipped >= 0) {
+        // the first block misses a bit, the others are full
+        p = Decoder::bits(getLiteralBits(word_traits::ALL_ONES_LITERAL &
+                                         ~((word_t)1 << flipped)),
+                          base, p, end);
+        p = Decoder::run(base + word_traits::MAX_LITERAL_LENGTH,
+                         maxLiteralLengthMultiplication<word_t>(blocks - 1),
+                         p);
+      } else {
+        p = Decoder::run(base, maxLiteralLengthMultiplication<word_t>(blocks),
+                         p);
+      }
+      base += maxLiteralLengthMultiplication<word_t>(blocks);
+    }
+    return (size_t)(p - out);
+  }
+
+#ifdef CONCISE_X86_DECODE
+  __attribute__((target("avx2"), flatten)) size_t
+  decodeAVX2(uint32_t *out) const {
+    return decode<AVX2Decoder>(out);
+  }
+#endif
+
+  ConciseSet<wah_mode, word_t> logicaland(
+      const ConciseView<wah_mode, word_t> &other) const {
+    ConciseSet<wah_mode, word_t> res;
+    logicalandToContainer(other, res);
+    return res;
+  }
+
+  ConciseSet<wah_mode, word_t> operator&(
+      const ConciseView<wah_mode, word_t> &o) const {
+    return logicaland(o);
+  }
+
+  ConciseSet<wah_mode, word_t> logicalandnot(
+      const ConciseView<wah_mode, word_t> &other) const {
+    ConciseSet<wah_mode, word_t> res;
+    logicalandnotToContainer(other, res);
+    return res;
+  }
+
+  ConciseSet<wah_mode, word_t> operator-(
+      const ConciseView<wah_mode, word_t> &o) const {
+    return logicalandnot(o);
+  }
+
+  ConciseSet<wah_mode, word_t> logicalor(
+      const ConciseView<wah_mode, word_t> &other) const {
+    ConciseSet<wah_mode, word_t> res;
+    logicalorToContainer(other, res);
+    return res;
+  }
+
+  ConciseSet<wah_mode, word_t> operator|(
+      const ConciseView<wah_mode, word_t> &o) const {
+    return logicalor(o);
+  }
+
+  ConciseSet<wah_mode, word_t> logicalxor(
+      const ConciseView<wah_mode, word_t> &other) const {
+    ConciseSet<wah_mode, word_t> res;
+    logicalxorToContainer(other, res);
+    return res;
+  }
+
+  ConciseSet<wah_mode, word_t> operator^(
+      const ConciseView<wah_mode, word_t> &o) const {
+    return logicalxor(o);
+  }
+
+  bool equals(const ConciseView<wah_mode, word_t> &other) const {
+    return logicalxorEmpty(other);
+  }
+
+  void logicalandToContainer(const ConciseView<wah_mode, word_t> &other,
+                             ConciseSet<wah_mode, word_t> &res) const {
+    if (isEmpty() || other.isEmpty()) {
+      res.clear();
+      return;
+    }
+    res.prepareOutput(3 + this->lastWordIndex + other.lastWordIndex);
+
+    // scan "this" and "other"
+    WordIterator<wah_mode, word_t> thisItr(*this);
+    WordIterator<wah_mode, word_t> otherItr(other);
+    while (true) {
+      if (!thisItr.IsLiteral) {
+        if (!otherItr.IsLiteral) {
+          int minCount = std::min(thisItr.count, otherItr.count);
+          res.appendFill(minCount, thisItr.word & otherItr.word);
+          if (!thisItr.prepareNext(minCount) |
+              !otherItr.prepareNext(minCount)) // NOT ||
+            break;
+        } else {
+          res.appendLiteral(thisItr.toLiteral() & otherItr.word);
+          thisItr.word--;
+          if (!thisItr.prepareNext(1) |
+              !otherItr.prepareNext()) // do NOT use "||"
+            break;
+        }
+      } else if (!otherItr.IsLiteral) {
+        res.appendLiteral(thisItr.word & otherItr.toLiteral());
+        otherItr.word--;
+        if (!thisItr.prepareNext() |
+            !otherItr.prepareNext(1)) // do NOT use  "||"
+          break;
+      } else {
+        // Java code simply does thisItr.word & otherItr.word below
+        res.appendLiteral(concise_and(thisItr.word , otherItr.word));
+        if (!thisItr.prepareNext() | !otherItr.prepareNext()) // do NOT use "||"
+          break;
+      }
+    }
+    bool invalidLast = true;
+    // remove trailing zeros
+    res.trimZeros();
+    if (res.isEmpty())
+      return;
+
+    // compute the greatest element
+    if (invalidLast)
+      res.updateLast();
+
+    return;
+  }
+
+  bool intersects(const ConciseView<wah_mode, word_t> &other) const {
+    if (isEmpty() || other.isEmpty()) {
+      return 0;
+    }
+    // scan "this" and "other"
+    WordIterator<wah_mode, word_t> thisItr(*this);
+    WordIterator<wah_mode, word_t> otherItr(other);
+    while (true) {
+      if (!thisItr.IsLiteral) {
+        if (!otherItr.IsLiteral) {
+          int minCount = std::min(thisItr.count, otherItr.count);
+          if(concise_and(thisItr.word, otherItr.word) &
+             word_traits::SEQUENCE_BIT)
+                if(minCount > 0 ) return true;
+          if (!thisItr.prepareNext(minCount) |
+              !otherItr.prepareNext(minCount)) // NOT ||
+            break;
+        } else {
+          if( !isLiteralZero(thisItr.toLiteral() & otherItr.word)  ) return true;
+          thisItr.word--;
+          if (!thisItr.prepareNext(1) |
+              !otherItr.prepareNext()) // do NOT use "||"
+            break;
+        }
+      } else if (!otherItr.IsLiteral) {
+        if( !isLiteralZero(thisItr.word & otherItr.toLiteral())  ) return true;
+        otherItr.word--;
+        if (!thisItr.prepareNext() |
+            !otherItr.prepareNext(1)) // do NOT use  "||"
+          break;
+      } else {
+        // Java code simply does thisItr.word & otherItr.word below
+        if ( !isLiteralZero(concise_and(thisItr.word , otherItr.word))  ) return true;
+        if (!thisItr.prepareNext() | !otherItr.prepareNext()) // do NOT use "||"
+          break;
+      }
+    }
+    return false;
+  }
+
+  size_t logicalandCount(const ConciseView<wah_mode, word_t> &other) const {
+    if (isEmpty() || other.isEmpty()) {
+      return 0;
+    }
+    size_t answer = 0;
+    // scan "this" and "other"
+    WordIterator<wah_mode, word_t> thisItr(*this);
+    WordIterator<wah_mode, word_t> otherItr(other);
+    while (true) {
+      if (!thisItr.IsLiteral) {
+        if (!otherItr.IsLiteral) {
+          int minCount = std::min(thisItr.count, otherItr.count);
+          if(concise_and(thisItr.word, otherItr.word) &
+             word_traits::SEQUENCE_BIT)
+                answer += word_traits::MAX_LITERAL_LENGTH * minCount;
+          if (!thisItr.prepareNext(minCount) |
+              !otherItr.prepareNext(minCount)) // NOT ||
+            break;
+        } else {
+          answer += getLiteralBitCount(thisItr.toLiteral() & otherItr.word);
+          thisItr.word--;
+          if (!thisItr.prepareNext(1) |
+              !otherItr.prepareNext()) // do NOT use "||"
+            break;
+        }
+      } else if (!otherItr.IsLiteral) {
+        answer += getLiteralBitCount(thisItr.word & otherItr.toLiteral());
+        otherItr.word--;
+        if (!thisItr.prepareNext() |
+            !otherItr.prepareNext(1)) // do NOT use  "||"
+          break;
+      } else {
+        // Java code simply does thisItr.word & otherItr.word below
+        answer += getLiteralBitCount(concise_and(thisItr.word , otherItr.word));
+        if (!thisItr.prepareNext() | !otherItr.prepareNext()) // do NOT use "||"
+          break;
+      }
+    }
+    return answer;
+  }
+
+  void logicalandnotToContainer(const ConciseView<wah_mode, word_t> &other,
+                                ConciseSet<wah_mode, word_t> &res) const {
+    if (isEmpty()) {
+      res.clear();
+      return;
+    }
+    if (other.isEmpty()) {
+      res.assign(*this);
+      return;
+    }
+    res.prepareOutput(3 + this->lastWordIndex + other.lastWordIndex);
+
+    // scan "this" and "other"
+    WordIterator<wah_mode, word_t> thisItr(*this);
+    WordIterator<wah_mode, word_t> otherItr(other);
+    while (true) {
+      if (!thisItr.IsLiteral) {
+        if (!otherItr.IsLiteral) {
+          int minCount = std::min(thisItr.count, otherItr.count);
+          res.appendFill(minCount, concise_andnot(thisItr.word, otherItr.word));
+          if (!thisItr.prepareNext(minCount) |
+              !otherItr.prepareNext(minCount)) // NOT ||
+            break;
+        } else {
+          res.appendLiteral(concise_andnot(thisItr.toLiteral(), otherItr.word));
+          thisItr.word--;
+          if (!thisItr.prepareNext(1) |
+              !otherItr.prepareNext()) // do NOT use "||"
+            break;
+        }
+      } else if (!otherItr.IsLiteral) {
+        res.appendLiteral(concise_andnot(thisItr.word, otherItr.toLiteral()));
+        otherItr.word--;
+        if (!thisItr.prepareNext() |
+            !otherItr.prepareNext(1)) // do NOT use  "||"
+          break;
+      } else {
+        res.appendLiteral(concise_andnot(thisItr.word, otherItr.word));
+        if (!thisItr.prepareNext() | !otherItr.prepareNext()) // do NOT use "||"
+          break;
+      }
+    }
+    bool invalidLast = true;
+    invalidLast |= thisItr.flush(res);
+    // remove trailing zeros
+    res.trimZeros();
+    if (res.isEmpty())
+      return;
+
+    // compute the greatest element
+    if (invalidLast)
+      res.updateLast();
+    return;
+  }
+
+  void logicalorToContainer(const ConciseView<wah_mode, word_t> &other,
+                            ConciseSet<wah_mode, word_t> &res) const {
+    if (this->isEmpty()) {
+      res.assign(other);
+      return;
+    }
+    if (other.isEmpty()) {
+      res.assign(*this);
+      return;
+    }
+    res.prepareOutput(3 + this->lastWordIndex + other.lastWordIndex);
+    // scan "this" and "other"
+    WordIterator<wah_mode, word_t> thisItr(*this);
+    WordIterator<wah_mode, word_t> otherItr(other);
+    while (true) {
+      if (!thisItr.IsLiteral) {
+        if (!otherItr.IsLiteral) {
+          int minCount = std::min(thisItr.count, otherItr.count);
+          res.appendFill(minCount, thisItr.word | otherItr.word);
+          if (!thisItr.prepareNext(minCount) |
+              !otherItr.prepareNext(minCount)) // NOT ||
+            break;
+        } else {
+          res.appendLiteral(thisItr.toLiteral() | otherItr.word);
+          thisItr.word--;
+          if (!thisItr.prepareNext(1) |
+              !otherItr.prepareNext()) // do NOT use "||"
+            break;
+        }
+      } else if (!otherItr.IsLiteral) {
+        res.appendLiteral(thisItr.word | otherItr.toLiteral());
+        otherItr.word--;
+        if (!thisItr.prepareNext() |
+            !otherItr.prepareNext(1)) // do NOT use  "||"
+          break;
+      } else {
+        res.appendLiteral(thisItr.word | otherItr.word);
+        if (!thisItr.prepareNext() | !otherItr.prepareNext()) // do NOT use "||"
+          break;
+      }
+    }
+    bool invalidLast = true;
+    res.last = std::max(this->last, other.last);
+    invalidLast = false;
+    invalidLast |= thisItr.flush(res);
+    invalidLast |= otherItr.flush(res);
+    // remove trailing zeros
+    res.trimZeros();
+    if (res.isEmpty())
+      return;
+    // compute the greatest element
+    if (invalidLast)
+      res.updateLast();
+    return;
+  }
+
+  void logicalxorToContainer(const ConciseView<wah_mode, word_t> &other,
+                             ConciseSet<wah_mode, word_t> &res) const {
+    if (this->isEmpty()) {
+      res.assign(other);
+      return;
+    }
+    if (other.isEmpty()) {
+      res.assign(*this);
+      return;
+    }
+    res.prepareOutput(3 + this->lastWordIndex + other.lastWordIndex);
+    // scan "this" and "other"
+    WordIterator<wah_mode, word_t> thisItr(*this);
+    WordIterator<wah_mode, word_t> otherItr(other);
+    while (true) {
+      if (!thisItr.IsLiteral) {
+        if (!otherItr.IsLiteral) {
+          int minCount = std::min(thisItr.count, otherItr.count);
+          res.appendFill(minCount, concise_xor(thisItr.word, otherItr.word));
+          if (!thisItr.prepareNext(minCount) |
+              !otherItr.prepareNext(minCount)) // NOT ||
+            break;
+        } else {
+          res.appendLiteral(concise_xor(thisItr.toLiteral(), otherItr.word));
+          thisItr.word--;
+          if (!thisItr.prepareNext(1) |
+              !otherItr.prepareNext()) // do NOT use "||"
+            break;
+        }
+      } else if (!otherItr.IsLiteral) {
+        res.appendLiteral(concise_xor(thisItr.word, otherItr.toLiteral()));
+        otherItr.word--;
+        if (!thisItr.prepareNext() |
+            !otherItr.prepareNext(1)) // do NOT use  "||"
+          break;
+      } else {
+        res.appendLiteral(concise_xor(thisItr.word, otherItr.word));
+        if (!thisItr.prepareNext() | !otherItr.prepareNext()) // do NOT use "||"
+          break;
+      }
+    }
+    bool invalidLast = true;
+    res.last = std::max(this->last, other.last);
+    invalidLast = false;
+    invalidLast |= thisItr.flush(res);
+    invalidLast |= otherItr.flush(res);
+    // remove trailing zeros
+    res.trimZeros();
+    if (res.isEmpty())
+      return;
+    // compute the greatest element
+    if (invalidLast)
+      res.updateLast();
+    return;
+  }
+
+  bool logicalxorEmpty(const ConciseView<wah_mode, word_t> &other) const {
+    if (this->isEmpty()) {
+      return other.isEmpty();
+    }
+    if (other.isEmpty()) {
+      return this->isEmpty();
+    }
+    // scan "this" and "other"
+    WordIterator<wah_mode, word_t> thisItr(*this);
+    WordIterator<wah_mode, word_t> otherItr(other);
+    while (true) {
+      if (!thisItr.IsLiteral) {
+        if (!otherItr.IsLiteral) {
+          int minCount = std::min(thisItr.count, otherItr.count);
+          if(concise_xor(thisItr.word, otherItr.word) &
+             word_traits::SEQUENCE_BIT)
+             return false;
+          if (!thisItr.prepareNext(minCount) |
+              !otherItr.prepareNext(minCount)) // NOT ||
+            break;
+        } else {
+          if(!isLiteralZero(concise_xor(thisItr.toLiteral(), otherItr.word))) return false;
+          thisItr.word--;
+          if (!thisItr.prepareNext(1) |
+              !otherItr.prepareNext()) // do NOT use "||"
+            break;
+        }
+      } else if (!otherItr.IsLiteral) {
+        if(!isLiteralZero(concise_xor(thisItr.word, otherItr.toLiteral()))) return false;
+        otherItr.word--;
+        if (!thisItr.prepareNext() |
+            !otherItr.prepareNext(1)) // do NOT use  "||"
+          break;
+      } else {
+        if(!isLiteralZero(concise_xor(thisItr.word, otherItr.word))) return false;
+        if (!thisItr.prepareNext() | !otherItr.prepareNext()) // do NOT use "||"
+          break;
+      }
+    }
+    if(thisItr.flushEmpty() && otherItr.flushEmpty()) return true;
+    return false;
+  }
+
+  /**
+   * Returns true if every element of this set belongs to other. The scan
+   * stops at the first word holding an element missing from other, and
+   * aligned fills are skipped in one step.
+   */
+  bool isSubsetOf(const ConciseView<wah_mode, word_t> &other) const {
+    if (isEmpty())
+      return true;
+    if (other.isEmpty() || last > other.last)
+      return false;
+    WordIterator<wah_mode, word_t> thisItr(*this);
+    WordIterator<wah_mode, word_t> otherItr(other);
+    while (true) {
+      if (!thisItr.IsLiteral) {
+        if (!otherItr.IsLiteral) {
+          const int minCount = std::min(thisItr.count, otherItr.count);
+          if (concise_andnot(thisItr.word, otherItr.word) &
+              word_traits::SEQUENCE_BIT)
+            return false;
+          if (!thisItr.prepareNext(minCount) |
+              !otherItr.prepareNext(minCount)) // do NOT use "||"
+            break;
+        } else {
+          if (!isLiteralZero(
+                  concise_andnot(thisItr.toLiteral(), otherItr.word)))
+            return false;
+          thisItr.word--;
+          if (!thisItr.prepareNext(1) |
+              !otherItr.prepareNext()) // do NOT use "||"
+            break;
+        }
+      } else if (!otherItr.IsLiteral) {
+        if (!isLiteralZero(concise_andnot(thisItr.word, otherItr.toLiteral())))
+          return false;
+        otherItr.word--;
+        if (!thisItr.prepareNext() |
+            !otherItr.prepareNext(1)) // do NOT use "||"
+          break;
+      } else {
+        if (!isLiteralZero(concise_andnot(thisItr.word, otherItr.word)))
+          return false;
+        if (!thisItr.prepareNext() |
+            !otherItr.prepareNext()) // do NOT use "||"
+          break;
+      }
+    }
+    // whatever is left of this set must be empty
+    return thisItr.flushEmpty();
+  }
+
+  bool isSupersetOf(const ConciseView<wah_mode, word_t> &other) const {
+    return other.isSubsetOf(*this);
+  }
+
+  /**
+   * Returns true if no element belongs to both sets, stopping at the first
+   * common element (see intersects())
+   */
+  bool isDisjoint(const ConciseView<wah_mode, word_t> &other) const {
+    return !intersects(other);
+  }
+
+  size_t logicalandnotCount(const ConciseView<wah_mode, word_t> &other) const {
+      if (isEmpty()) {
+        return 0;
+      }
+      if (other.isEmpty()) {
+        return this->size();
+      }
+      size_t answer = 0;
+      // scan "this" and "other"
+      WordIterator<wah_mode, word_t> thisItr(*this);
+      WordIterator<wah_mode, word_t> otherItr(other);
+      while (true) {
+        if (!thisItr.IsLiteral) {
+          if (!otherItr.IsLiteral) {
+            int minCount = std::min(thisItr.count, otherItr.count);
+            if(concise_andnot(thisItr.word, otherItr.word) &
+               word_traits::SEQUENCE_BIT)
+               answer += word_traits::MAX_LITERAL_LENGTH * minCount;
+            if (!thisItr.prepareNext(minCount) |
+                !otherItr.prepareNext(minCount)) // NOT ||
+              break;
+          } else {
+            answer += getLiteralBitCount(concise_andnot(thisItr.toLiteral(), otherItr.word));
+            thisItr.word--;
+            if (!thisItr.prepareNext(1) |
+                !otherItr.prepareNext()) // do NOT use "||"
+              break;
+          }
+        } else if (!otherItr.IsLiteral) {
+          answer += getLiteralBitCount(concise_andnot(thisItr.word, otherItr.toLiteral()));
+          otherItr.word--;
+          if (!thisItr.prepareNext() |
+              !otherItr.prepareNext(1)) // do NOT use  "||"
+            break;
+        } else {
+          answer += getLiteralBitCount(concise_andnot(thisItr.word, otherItr.word));
+          if (!thisItr.prepareNext() | !otherItr.prepareNext()) // do NOT use "||"
+            break;
+        }
+      }
+      answer += thisItr.flushCount();
+      return answer;
+  }
+
+  size_t logicalxorCount(const ConciseView<wah_mode, word_t> &other) const {
+    if (this->isEmpty()) {
+      return other.size();
+    }
+    if (other.isEmpty()) {
+      return this->size();
+    }
+    size_t answer = 0;
+    // scan "this" and "other"
+    WordIterator<wah_mode, word_t> thisItr(*this);
+    WordIterator<wah_mode, word_t> otherItr(other);
+    while (true) {
+      if (!thisItr.IsLiteral) {
+        if (!otherItr.IsLiteral) {
+          int minCount = std::min(thisItr.count, otherItr.count);
+          if(concise_xor(thisItr.word, otherItr.word) &
+             word_traits::SEQUENCE_BIT)
+             answer += word_traits::MAX_LITERAL_LENGTH * minCount;
+          if (!thisItr.prepareNext(minCount) |
+              !otherItr.prepareNext(minCount)) // NOT ||
+            break;
+        } else {
+          answer += getLiteralBitCount(concise_xor(thisItr.toLiteral(), otherItr.word));
+          thisItr.word--;
+          if (!thisItr.prepareNext(1) |
+              !otherItr.prepareNext()) // do NOT use "||"
+            break;
+        }
+      } else if (!otherItr.IsLiteral) {
+        answer += getLiteralBitCount(concise_xor(thisItr.word, otherItr.toLiteral()));
+        otherItr.word--;
+        if (!thisItr.prepareNext() |
+            !otherItr.prepareNext(1)) // do NOT use  "||"
+          break;
+      } else {
+        answer += getLiteralBitCount(concise_xor(thisItr.word, otherItr.word));
+        if (!thisItr.prepareNext() | !otherItr.prepareNext()) // do NOT use "||"
+          break;
+      }
+    }
+    answer += thisItr.flushCount();
+    answer += otherItr.flushCount();
+    return answer;
+  }
+
+  size_t logicalorCount(const ConciseView<wah_mode, word_t> &other) const {
+    if (this->isEmpty()) {
+      return other.size();
+    }
+    if (other.isEmpty()) {
+      return this->size();
+    }
+    size_t answer = 0;
+    // scan "this" and "other"
+    WordIterator<wah_mode, word_t> thisItr(*this);
+    WordIterator<wah_mode, word_t> otherItr(other);
+    while (true) {
+      if (!thisItr.IsLiteral) {
+        if (!otherItr.IsLiteral) {
+          int minCount = std::min(thisItr.count, otherItr.count);
+          if((thisItr.word | otherItr.word) & word_traits::SEQUENCE_BIT)
+             answer += word_traits::MAX_LITERAL_LENGTH * minCount;
+          if (!thisItr.prepareNext(minCount) |
+              !otherItr.prepareNext(minCount)) // NOT ||
+            break;
+        } else {
+          answer += getLiteralBitCount(thisItr.toLiteral() | otherItr.word);
+          thisItr.word--;
+          if (!thisItr.prepareNext(1) |
+              !otherItr.prepareNext()) // do NOT use "||"
+            break;
+        }
+      } else if (!otherItr.IsLiteral) {
+        answer += getLiteralBitCount(thisItr.word | otherItr.toLiteral());
+        otherItr.word--;
+        if (!thisItr.prepareNext() |
+            !otherItr.prepareNext(1)) // do NOT use  "||"
+          break;
+      } else {
+        answer += getLiteralBitCount(thisItr.word | otherItr.word);
+        if (!thisItr.prepareNext() | !otherItr.prepareNext()) // do NOT use "||"
+          break;
+      }
+    }
+    answer += thisItr.flushCount();
+    answer += otherItr.flushCount();
+    return answer;
+  }
+
+  /**
+   * Cardinalities of this & other, this - other and other - this, computed
+   * in a single scan of both sets (rather than one scan per count)
+   */
+  ConciseSimilarity
+  similarity(const ConciseView<wah_mode, word_t> &other) const {
+    ConciseSimilarity answer;
+    if (isEmpty() || other.isEmpty()) {
+      answer.leftOnly = size();
+      answer.rightOnly = other.size();
+      return answer;
+    }
+    WordIterator<wah_mode, word_t> thisItr(*this);
+    WordIterator<wah_mode, word_t> otherItr(other);
+    while (true) {
+      if (!thisItr.IsLiteral) {
+        if (!otherItr.IsLiteral) {
+          const int minCount = std::min(thisItr.count, otherItr.count);
+          const size_t blocks = word_traits::MAX_LITERAL_LENGTH * minCount;
+          const bool thisOnes = thisItr.word & word_traits::SEQUENCE_BIT;
+          const bool otherOnes = otherItr.word & word_traits::SEQUENCE_BIT;
+          if (thisOnes && otherOnes)
+            answer.intersection += blocks;
+          else if (thisOnes)
+            answer.leftOnly += blocks;
+          else if (otherOnes)
+            answer.rightOnly += blocks;
+          if (!thisItr.prepareNext(minCount) |
+              !otherItr.prepareNext(minCount)) // do NOT use "||"
+            break;
+        } else {
+          addLiteralSimilarity(thisItr.toLiteral(), otherItr.word, answer);
+          thisItr.word--;
+          if (!thisItr.prepareNext(1) |
+              !otherItr.prepareNext()) // do NOT use "||"
+            break;
+        }
+      } else if (!otherItr.IsLiteral) {
+        addLiteralSimilarity(thisItr.word, otherItr.toLiteral(), answer);
+        otherItr.word--;
+        if (!thisItr.prepareNext() |
+            !otherItr.prepareNext(1)) // do NOT use "||"
+          break;
+      } else {
+        addLiteralSimilarity(thisItr.word, otherItr.word, answer);
+        if (!thisItr.prepareNext() |
+            !otherItr.prepareNext()) // do NOT use "||"
+          break;
+      }
     }
+    answer.leftOnly += thisItr.flushCount();
+    answer.rightOnly += otherItr.flushCount();
+    return answer;
+  }
 
-    const uint32_t lastWord = words[lastWordIndex];
-    if (word == ALL_ZEROS_LITERAL) {
-      if (lastWord == ALL_ZEROS_LITERAL)
-        words[lastWordIndex] = 1;
-      else if (isZeroSequence(lastWord))
-        words[lastWordIndex]++;
-      else if (!wah_mode && containsOnlyOneBit(getLiteralBits(lastWord)))
-        words[lastWordIndex] = 1 | ((1 + __builtin_ctz(lastWord)) << 25);
-      else
-        words[++lastWordIndex] = word;
-    } else if (word == ALL_ONES_LITERAL) {
-      if (lastWord == ALL_ONES_LITERAL)
-        words[lastWordIndex] = SEQUENCE_BIT | 1;
-      else if (isOneSequence(lastWord))
-        words[lastWordIndex]++;
-      else if (!wah_mode && containsOnlyOneBit(~lastWord))
-        words[lastWordIndex] =
-            SEQUENCE_BIT | 1 | ((1 + __builtin_ctz(~lastWord)) << 25);
-      else
-        words[++lastWordIndex] = word;
-    } else {
-      words[++lastWordIndex] = word;
-    }
+  double jaccard(const ConciseView<wah_mode, word_t> &other) const {
+    return similarity(other).jaccard();
   }
 
-  void appendFill(uint32_t length, uint32_t fillType) {
+  double dice(const ConciseView<wah_mode, word_t> &other) const {
+    return similarity(other).dice();
+  }
 
-    fillType &= SEQUENCE_BIT;
+  double overlap(const ConciseView<wah_mode, word_t> &other) const {
+    return similarity(other).overlap();
+  }
 
-    // it is actually a literal...
-    if (length == 1) {
-      appendLiteral(fillType == 0 ? ALL_ZEROS_LITERAL : ALL_ONES_LITERAL);
-      return;
-    }
-    // empty set
-    if (lastWordIndex < 0) {
-      words[lastWordIndex = 0] = fillType | (length - 1);
-      return;
+  double cosine(const ConciseView<wah_mode, word_t> &other) const {
+    return similarity(other).cosine();
+  }
+
+  static void addLiteralSimilarity(word_t thisLiteral, word_t otherLiteral,
+                                   ConciseSimilarity &answer) {
+    const size_t common =
+        getLiteralBitCount(concise_and(thisLiteral, otherLiteral));
+    answer.intersection += common;
+    answer.leftOnly += getLiteralBitCount(thisLiteral) - common;
+    answer.rightOnly += getLiteralBitCount(otherLiteral) - common;
+  }
+
+  /**
+   * Checks whether o belongs to the set by scanning words from position
+   * wordIndex, which must be preceded by exactly firstBlock blocks.
+   * containsFromWord(o, 0, 0) is a plain linear scan.
+   */
+  bool containsFromWord(uint32_t o, int32_t wordIndex,
+                        uint32_t firstBlock) const {
+    if (isEmpty() || ((int32_t)o > last) ||
+        (o > word_traits::MAX_ALLOWED_INTEGER)) {
+      return false;
     }
-    uint32_t lastWord = words[lastWordIndex];
-    if (isLiteral(lastWord)) {
-      if (fillType == 0 && lastWord == ALL_ZEROS_LITERAL) {
-        words[lastWordIndex] = length;
-      } else if (fillType == SEQUENCE_BIT && lastWord == ALL_ONES_LITERAL) {
-        words[lastWordIndex] = SEQUENCE_BIT | length;
-      } else if (!wah_mode) {
-        if (fillType == 0 && containsOnlyOneBit(getLiteralBits(lastWord))) {
-          words[lastWordIndex] = length | ((1 + __builtin_ctz(lastWord)) << 25);
-        } else if (fillType == SEQUENCE_BIT && containsOnlyOneBit(~lastWord)) {
-          words[lastWordIndex] =
-              SEQUENCE_BIT | length | ((1 + __builtin_ctz(~lastWord)) << 25);
-        } else {
-          words[++lastWordIndex] = fillType | (length - 1);
-        }
-      } else {
-        words[++lastWordIndex] = fillType | (length - 1);
-      }
-    } else {
-      if ((lastWord & UINT32_C(0xC0000000)) == fillType) {
-        words[lastWordIndex] += length;
-      } else {
-        words[++lastWordIndex] = fillType | (length - 1);
+
+    // check if the element is within a literal word
+    uint32_t bit = maxLiteralLengthModulus<word_t>(o);
+    assert(maxLiteralLengthMultiplication<word_t>(
+               maxLiteralLengthDivision<word_t>(o)) +
+               bit ==
+           o);
+    int32_t block = (int32_t)(maxLiteralLengthDivision<word_t>(o) - firstBlock);
+
+    for (int i = wordIndex; i <= lastWordIndex; i++) {
+
+      const word_t w = words[i];
+      const word_t t = w & word_traits::TYPE_MASK; // the first two bits...
+      switch (t) {
+      case word_traits::ALL_ZEROS_LITERAL: // LITERAL
+      case word_traits::TYPE_MASK:         // LITERAL
+        // check if the current literal word is the "right" one
+        if (block == 0)
+          return (w & ((word_t)1 << bit)) != 0;
+        block--;
+        break;
+      case 0: // ZERO SEQUENCE
+        if (!wah_mode)
+          if ((block == 0) && getFlippedBit(w) == (int)bit)
+            return true;
+        block -= (int32_t)getSequenceCount<wah_mode>(w) + 1;
+        if (block < 0)
+          return false;
+        break;
+      case word_traits::SEQUENCE_BIT: // ONE SEQUENCE
+        if (!wah_mode)
+          if ((block == 0) && getFlippedBit(w) == (int)bit)
+            return false;
+        block -= (int32_t)getSequenceCount<wah_mode>(w) + 1;
+        if (block < 0)
+          return true;
+        break;
       }
     }
+    // no more words
+    return false;
   }
 
-  void updateLast() {
-    last = 0;
-    for (int32_t i = 0; i <= lastWordIndex; i++) {
-      uint32_t w = words[i];
-      if (isLiteral(w))
-        last += MAX_LITERAL_LENGTH;
-      else
-        last += maxLiteralLengthMultiplication(getSequenceCount<wah_mode>(w) + 1);
-    }
+  const word_t *words;
 
-    uint32_t w = words[lastWordIndex];
-    if (isLiteral(w))
-      last -= __builtin_clz(getLiteralBits(w));
-    else
-      last--;
-  }
+  /**
+   * Most significant set bit within the uncompressed bit string.
+   */
+  int32_t last;
+
+  /**
+   * Index of the last word in words
+   */
+  int32_t lastWordIndex;
+
+  /**
+   * Number of set bits, or -1 when not computed yet
+   */
+  mutable int64_t cardinality;
 };
 
-template <bool wah_mode = false> class WordIterator {
+template <bool wah_mode = false, class word_t = uint32_t> class WordIterator {
 public:
+  typedef ConciseWord<word_t> word_traits;
+
   /**
    * Initialize data
    */
-  WordIterator(const ConciseSet<wah_mode> &p)
+  WordIterator(const ConciseView<wah_mode, word_t> &p)
       : IsLiteral(false), parent(p), index(-1), word(0), count(0) {
     prepareNext();
   }
@@ -1078,12 +3197,14 @@ public:
     word = parent.words[index];
     IsLiteral = isLiteral(word);
     if (!IsLiteral) {
-      count = getSequenceCount<wah_mode>(word) + 1 ;
+      count = (uint32_t)getSequenceCount<wah_mode>(word) + 1 ;
       if (!wah_mode && !isSequenceWithNoBits(word)) {
         IsLiteral = true;
-        int bit = (UINT32_C(1) << ((word >> 25) % 32)) >> 1;
-        word = isZeroSequence(word) ? (ALL_ZEROS_LITERAL | bit)
-                                    : (ALL_ONES_LITERAL & ~bit);
+        const word_t flipped = (word >> word_traits::FLIPPED_BIT_SHIFT) &
+                               word_traits::FLIPPED_BIT_MASK;
+        const word_t bit = ((word_t)1 << flipped) >> 1;
+        word = isZeroSequence(word) ? (word_traits::ALL_ZEROS_LITERAL | bit)
+                                    : (word_traits::ALL_ONES_LITERAL & ~bit);
       }
     } else {
       count = 1;
@@ -1091,19 +3212,42 @@ public:
     return true;
   }
 
-  uint32_t toLiteral() {
-    return ALL_ZEROS_LITERAL |
-           (uint32_t)(((int32_t)word << 1) >> MAX_LITERAL_LENGTH);
+  /**
+   * Moves to the given word, which must begin a new piece
+   */
+  void seekWord(int32_t wordIndex) {
+    index = wordIndex - 1;
+    IsLiteral = false;
+    prepareNext();
+  }
+
+  /**
+   * Number of blocks in the current piece: 1 for a literal, including the
+   * first block of a Concise sequence with a flipped bit
+   */
+  uint32_t blocks() const { return IsLiteral ? 1 : count; }
+
+  /**
+   * Moves past the current piece
+   */
+  bool nextPiece() { return IsLiteral ? prepareNext() : prepareNext(count); }
+
+  word_t toLiteral() {
+    // the sequence bit, moved to the sign bit, is spread over all bits
+    typedef typename std::make_signed<word_t>::type signed_word_t;
+    return word_traits::ALL_ZEROS_LITERAL |
+           (word_t)((signed_word_t)(word << 1) >>
+                    word_traits::MAX_LITERAL_LENGTH);
   }
 
   /** true if {@link #word} is a literal */
   bool IsLiteral;
-  const ConciseSet<wah_mode> &parent;
+  ConciseView<wah_mode, word_t> parent;
 
   /** current word index */
   int32_t index;
   /** copy of the current word */
-  uint32_t word;
+  word_t word;
 
   /** number of blocks in the current word (1 for literals, > 1 for sequences)
    */
@@ -1118,8 +3262,8 @@ public:
       if (IsLiteral) {
         cardsize += getLiteralBitCount(word);
       } else {
-        if(word & SEQUENCE_BIT) {
-           cardsize += 31 * count;
+        if(word & word_traits::SEQUENCE_BIT) {
+           cardsize += word_traits::MAX_LITERAL_LENGTH * count;
         }
       }
     } while (prepareNext());
@@ -1132,14 +3276,14 @@ public:
       if (IsLiteral) {
         if(!isLiteralZero(word)) return false;
       } else {
-        if(word & SEQUENCE_BIT)
+        if(word & word_traits::SEQUENCE_BIT)
            return false;
       }
     } while (prepareNext());
     return true;
   }
 
-  bool flush(ConciseSet<wah_mode> &s) {
+  bool flush(ConciseSet<wah_mode, word_t> &s) {
     // nothing to flush
     if (exhausted())
       return false;
@@ -1157,18 +3301,77 @@ public:
     int32_t delta = parent.lastWordIndex - index + 1;
     for (int i = 0; i < delta; ++i) {
       s.words[s.lastWordIndex + 1 + i] = parent.words[index + i];
+      if (s.cardinality >= 0)
+        s.cardinality += ConciseSet<wah_mode, word_t>::getWordCardinality(
+            parent.words[index + i]);
     }
     s.lastWordIndex += delta;
+    s.updateSkipIndex();
     s.last = parent.last;
     return true;
   }
 };
 
-template <bool wah_mode> class ConciseSetBitForwardIterator {
+/**
+ * Sink for ConciseSet::multiway() compressing its output into a set prepared
+ * with prepareOutput()
+ */
+template <bool wah_mode = false, class word_t = uint32_t> class ConciseSetSink {
+public:
+  typedef ConciseWord<word_t> word_traits;
+
+  explicit ConciseSetSink(ConciseSet<wah_mode, word_t> &s)
+      : set(s), position(0), last(-1) {}
+
+  bool appendZeros(uint32_t blocks) {
+    set.appendFill(blocks, 0);
+    position += blocks;
+    return true;
+  }
+
+  bool append(const word_t *buffer, uint32_t length) {
+    uint32_t k = 0;
+    while (k < length) {
+      const word_t bits = buffer[k];
+      if (bits == 0 || bits == word_traits::ALL_ONES_WITHOUT_MSB) {
+        uint32_t run = 1;
+        while (k + run < length && buffer[k + run] == bits)
+          run++;
+        set.appendFill(run, bits == 0 ? 0 : word_traits::SEQUENCE_BIT);
+        k += run;
+        if (bits != 0)
+          last = maxLiteralLengthMultiplication<word_t>(position + k) - 1;
+      } else {
+        set.appendLiteral(word_traits::ALL_ZEROS_LITERAL | bits);
+        last = maxLiteralLengthMultiplication<word_t>(position + k) +
+               word_traits::WORD_BITS - 1 - word_traits::clz(bits);
+        k++;
+      }
+    }
+    position += length;
+    return true;
+  }
+
+  /**
+   * Greatest element appended so far, -1 if none
+   */
+  int32_t getLast() const { return last; }
+
+private:
+  ConciseSet<wah_mode, word_t> &set;
+  /** number of blocks appended so far */
+  uint32_t position;
+  int32_t last;
+};
+
+template <bool wah_mode = false, class word_t = uint32_t>
+class ConciseSetBitForwardIterator {
 public:
+  typedef ConciseWord<word_t> word_traits;
   typedef std::forward_iterator_tag iterator_category;
   typedef uint32_t *pointer;
   typedef uint32_t &reference_type;
+  typedef uint32_t reference; // values are computed, not stored
   typedef uint32_t value_type;
   typedef int32_t difference_type;
   typedef ConciseSetBitForwardIterator type_of_iterator;
@@ -1216,7 +3419,7 @@ public:
   }
 
   type_of_iterator operator++(int) { // i++, must return orig. value
-    ConciseSetBitForwardIterator<wah_mode> orig(*this);
+    ConciseSetBitForwardIterator<wah_mode, word_t> orig(*this);
     advanceToNextBit();
     return orig;
   }
@@ -1230,7 +3433,7 @@ public:
   bool operator!=(const ConciseSetBitForwardIterator &o) {
     return !(*this == o);
   }
-  ConciseSetBitForwardIterator(const ConciseSet<wah_mode> &parent,
+  ConciseSetBitForwardIterator(const ConciseView<wah_mode, word_t> &parent,
                                bool exhausted = false)
       : word_location(0), current_value(0), has_value(true), word_value(0),
         i(parent) {
@@ -1271,15 +3474,63 @@ public:
       }
     }
     if (word_value != 0) {
-      uint32_t t = word_value & (-word_value);
+      word_t t = word_value & (-word_value);
       has_value = true;
-      current_value = word_location * 31 + __builtin_popcount(t - 1);
+      current_value = word_location * word_traits::MAX_LITERAL_LENGTH +
+                      word_traits::ctz(t);
       word_value ^= t;
     } else {
       has_value = false;
     }
   }
 
+  /**
+   * Moves to the first value at or after x; the iterator never moves
+   * backward. Pieces of words ending before x are skipped by their block
+   * counts, without being decoded. Exhausts the iterator if there is no
+   * such value.
+   */
+  void skipTo(uint32_t x) {
+    if (!has_value || current_value >= x)
+      return;
+    uint32_t block = x / word_traits::MAX_LITERAL_LENGTH;
+    uint32_t bit = x % word_traits::MAX_LITERAL_LENGTH;
+    if (block > word_location) {
+      // i holds the block after word_location
+      uint32_t pieceBlock = word_location + 1;
+      while (!i.exhausted()) {
+        const uint32_t blocks = i.blocks();
+        if (pieceBlock + blocks > block) {
+          if (i.IsLiteral || (i.word & word_traits::SEQUENCE_BIT) != 0)
+            break;
+          // a fill of zeros holds nothing, go to the piece after it
+          block = pieceBlock + blocks;
+          bit = 0;
+        }
+        pieceBlock += blocks;
+        i.nextPiece();
+      }
+      if (i.exhausted()) {
+        word_value = 0;
+        has_value = false;
+        return;
+      }
+      word_location = block;
+      if (i.IsLiteral) {
+        word_value = getLiteralBits(i.word);
+        i.prepareNext();
+      } else {
+        // blocks of the fill of ones before the target, then the target
+        const uint32_t skipped = block - pieceBlock;
+        i.word -= skipped + 1;
+        i.prepareNext(skipped + 1);
+        word_value = word_traits::ALL_ONES_WITHOUT_MSB;
+      }
+    }
+    word_value &= ~(((word_t)1 << bit) - 1);
+    advanceToNextBit();
+  }
+
   ConciseSetBitForwardIterator &
   operator=(const ConciseSetBitForwardIterator &o) = default;
   ConciseSetBitForwardIterator &
@@ -1287,24 +3538,356 @@ public:
 
   ~ConciseSetBitForwardIterator() = default;
 
-  ConciseSetBitForwardIterator(const ConciseSetBitForwardIterator &o)
-      : i(o.i) {}
+  ConciseSetBitForwardIterator(const ConciseSetBitForwardIterator &o) =
+      default;
   uint32_t word_location;
   uint32_t current_value;
   bool has_value;
-  uint32_t word_value;
-  WordIterator<wah_mode> i;
+  word_t word_value;
+  WordIterator<wah_mode, word_t> i;
+};
+
+/**
+ * Hands out the values of a set in increasing order, up to cap values per
+ * call to nextBatch(). It only keeps a pointer to the words and the
+ * position reached: the rest of the current literal and the rest of the
+ * current fill of ones. The set must outlive the iterator and must not be
+ * modified while it is in use.
+ */
+template <bool wah_mode = false, class word_t = uint32_t>
+class ConciseSetBatchIterator {
+public:
+  typedef ConciseWord<word_t> word_traits;
+
+  ConciseSetBatchIterator(const ConciseView<wah_mode, word_t> &parent)
+      : words(parent.words), wordIndex(0),
+        lastWordIndex(parent.lastWordIndex), nextBlock(0), pending(0),
+        pendingBase(0), runStart(0), runLength(0) {}
+
+  /**
+   * Writes the next values, at most cap of them, to buf and returns their
+   * number: fewer than cap only once the set is exhausted, 0 afterwards.
+   */
+  size_t nextBatch(uint32_t *buf, size_t cap) {
+    uint32_t *out = buf;
+    uint32_t *const end = buf + cap;
+    while (out != end) {
+      if (pending != 0) {
+        if ((size_t)(end - out) >= (size_t)word_traits::popcount(pending)) {
+          out = ScalarDecoder::bits(pending, pendingBase, out, end);
+          pending = 0;
+        } else {
+          for (; out != end; out++) {
+            *out = pendingBase + word_traits::ctz(pending);
+            pending &= pending - 1;
+          }
+          break;
+        }
+      }
+      if (runLength != 0) {
+        const uint32_t length =
+            (uint32_t)std::min<size_t>(runLength, end - out);
+        out = ScalarDecoder::run(runStart, length, out);
+        runStart += length;
+        runLength -= length;
+      } else if (!nextWord()) {
+        break;
+      }
+    }
+    return (size_t)(out - buf);
+  }
+
+  bool exhausted() const {
+    return pending == 0 && runLength == 0 && wordIndex > lastWordIndex;
+  }
+
+  /**
+   * Loads the next word into pending and the run, false if there is none
+   */
+  bool nextWord() {
+    if (wordIndex > lastWordIndex)
+      return false;
+    const word_t w = words[wordIndex++];
+    pendingBase = nextBlock;
+    if (isLiteral(w)) {
+      pending = getLiteralBits(w);
+      nextBlock += word_traits::MAX_LITERAL_LENGTH;
+      return true;
+    }
+    const uint32_t length = maxLiteralLengthMultiplication<word_t>(
+        (uint32_t)getSequenceCount<wah_mode>(w) + 1);
+    const int flipped = wah_mode ? -1 : getFlippedBit(w);
+    if (isZeroSequence(w)) {
+      if (flipped >= 0)
+        pending = (word_t)1 << flipped;
+    } else if (flipped >= 0) {
+      // the first block misses a bit, the others are full
+      pending = getLiteralBits(word_traits::ALL_ONES_LITERAL &
+                               ~((word_t)1 << flipped));
+      runStart = nextBlock + word_traits::MAX_LITERAL_LENGTH;
+      runLength = length - word_traits::MAX_LITERAL_LENGTH;
+    } else {
+      runStart = nextBlock;
+      runLength = length;
+    }
+    nextBlock += length;
+    return true;
+  }
+
+  const word_t *words;
+  int32_t wordIndex;
+  int32_t lastWordIndex;
+  uint32_t nextBlock;   // first value of the block after the current word
+  word_t pending;       // bits of the current literal not handed out yet
+  uint32_t pendingBase; // value of the bit 0 of pending
+  uint32_t runStart;    // next value of the current fill of ones
+  uint32_t runLength;   // values of the current fill not handed out yet
+};
+
+/**
+ * Hands out the values of a set as runs of consecutive values [start, end),
+ * in increasing order. nextRun() returns maximal runs: fills of ones, full
+ * literals and the runs of bits inside literals are merged whenever they
+ * touch, even across words. nextRawRun() returns the runs as they come in
+ * the words, a fill of ones being one run and a literal giving one run per
+ * group of consecutive bits. The set must outlive the iterator and must not
+ * be modified while it is in use.
+ */
+template <bool wah_mode = false, class word_t = uint32_t>
+class ConciseSetRunIterator {
+public:
+  typedef ConciseWord<word_t> word_traits;
+
+  ConciseSetRunIterator(const ConciseView<wah_mode, word_t> &parent)
+      : pieces(parent), hasLookahead(false), lookaheadStart(0),
+        lookaheadEnd(0) {}
+
+  /**
+   * Moves to the next maximal run, false once the set is exhausted
+   */
+  bool nextRun(uint32_t &start, uint32_t &end) {
+    if (hasLookahead) {
+      start = lookaheadStart;
+      end = lookaheadEnd;
+      hasLookahead = false;
+    } else if (!nextRawRun(start, end)) {
+      return false;
+    }
+    uint32_t s, e;
+    while (nextRawRun(s, e)) {
+      if (s != end) {
+        hasLookahead = true;
+        lookaheadStart = s;
+        lookaheadEnd = e;
+        break;
+      }
+      end = e;
+    }
+    return true;
+  }
+
+  /**
+   * Moves to the next run held by a single piece of a word, false once the
+   * set is exhausted
+   */
+  bool nextRawRun(uint32_t &start, uint32_t &end) {
+    while (true) {
+      if (pieces.pending != 0) {
+        const uint32_t low = (uint32_t)word_traits::ctz(pieces.pending);
+        // pending has no MSB, so the run of ones ends below it
+        const uint32_t length =
+            (uint32_t)word_traits::ctz(~(pieces.pending >> low));
+        start = pieces.pendingBase + low;
+        end = start + length;
+        pieces.pending &= ~((((word_t)1 << length) - 1) << low);
+        return true;
+      }
+      if (pieces.runLength != 0) {
+        start = pieces.runStart;
+        end = start + pieces.runLength;
+        pieces.runLength = 0;
+        return true;
+      }
+      if (!pieces.nextWord())
+        return false;
+    }
+  }
+
+  ConciseSetBatchIterator<wah_mode, word_t> pieces;
+  bool hasLookahead;
+  uint32_t lookaheadStart;
+  uint32_t lookaheadEnd;
+};
+
+/**
+ * Visits the values of a set in decreasing order. The words are read
+ * backward from lastWordIndex: the last word ends with the block holding
+ * the greatest value, so the block of every word follows from the blocks of
+ * the words after it. Within a word, the fill of ones comes first, then the
+ * first block of a Concise fill (missing its flipped bit) or the literal,
+ * decoded from the high bit down.
+ */
+template <bool wah_mode = false, class word_t = uint32_t>
+class ConciseSetBitReverseIterator {
+public:
+  typedef ConciseWord<word_t> word_traits;
+  typedef std::forward_iterator_tag iterator_category;
+  typedef uint32_t *pointer;
+  typedef uint32_t &reference_type;
+  typedef uint32_t reference; // values are computed, not stored
+  typedef uint32_t value_type;
+  typedef int32_t difference_type;
+  typedef ConciseSetBitReverseIterator type_of_iterator;
+
+  ConciseSetBitReverseIterator(const ConciseView<wah_mode, word_t> &parent,
+                               bool exhausted = false)
+      : words(parent.words),
+        wordIndex(exhausted ? -1 : parent.lastWordIndex),
+        nextBlock(parent.last < 0
+                      ? 0
+                      : maxLiteralLengthMultiplication<word_t>(
+                            maxLiteralLengthDivision<word_t>(
+                                (uint32_t)parent.last) +
+                            1)),
+        pending(0), pendingBase(0), runStart(0), runLength(0),
+        current_value(0), has_value(true) {
+    advanceToPreviousBit();
+  }
+
+  value_type operator*() const { return current_value; }
+
+  type_of_iterator &operator++() {
+    advanceToPreviousBit();
+    return *this;
+  }
+
+  type_of_iterator operator++(int) {
+    ConciseSetBitReverseIterator<wah_mode, word_t> orig(*this);
+    advanceToPreviousBit();
+    return orig;
+  }
+
+  bool operator==(const ConciseSetBitReverseIterator &o) const {
+    if (!has_value || !o.has_value)
+      return has_value == o.has_value;
+    return current_value == o.current_value;
+  }
+
+  bool operator!=(const ConciseSetBitReverseIterator &o) const {
+    return !(*this == o);
+  }
+
+  void advanceToPreviousBit() {
+    while (true) {
+      if (runLength != 0) {
+        current_value = runStart + --runLength;
+        return;
+      }
+      if (pending != 0) {
+        const int top = word_traits::WORD_BITS - 1 - word_traits::clz(pending);
+        current_value = pendingBase + (uint32_t)top;
+        pending ^= (word_t)1 << top;
+        return;
+      }
+      if (!previousWord()) {
+        has_value = false;
+        return;
+      }
+    }
+  }
+
+  /**
+   * Loads the word before the current one, false if there is none
+   */
+  bool previousWord() {
+    if (wordIndex < 0)
+      return false;
+    const word_t w = words[wordIndex--];
+    if (isLiteral(w)) {
+      nextBlock -= word_traits::MAX_LITERAL_LENGTH;
+      pendingBase = nextBlock;
+      pending = getLiteralBits(w);
+      return true;
+    }
+    const uint32_t length = maxLiteralLengthMultiplication<word_t>(
+        (uint32_t)getSequenceCount<wah_mode>(w) + 1);
+    nextBlock -= length;
+    pendingBase = nextBlock;
+    const int flipped = wah_mode ? -1 : getFlippedBit(w);
+    if (isZeroSequence(w)) {
+      if (flipped >= 0)
+        pending = (word_t)1 << flipped;
+    } else if (flipped >= 0) {
+      pending = getLiteralBits(word_traits::ALL_ONES_LITERAL &
+                               ~((word_t)1 << flipped));
+      runStart = nextBlock + word_traits::MAX_LITERAL_LENGTH;
+      runLength = length - word_traits::MAX_LITERAL_LENGTH;
+    } else {
+      runStart = nextBlock;
+      runLength = length;
+    }
+    return true;
+  }
+
+  const word_t *words;
+  int32_t wordIndex;    // next word to load
+  uint32_t nextBlock;   // first value of the current word
+  word_t pending;       // bits of the current literal not visited yet
+  uint32_t pendingBase; // value of the bit 0 of pending
+  uint32_t runStart;    // first value of the current fill of ones
+  uint32_t runLength;   // values of the current fill not visited yet
+  uint32_t current_value;
+  bool has_value;
 };
 
-template <bool wah_mode>
-inline ConciseSetBitForwardIterator<wah_mode>
-ConciseSet<wah_mode>::begin() const {
-  return ConciseSetBitForwardIterator<wah_mode>(*this);
+template <bool wah_mode, class word_t>
+inline ConciseSetBitForwardIterator<wah_mode, word_t>
+ConciseSet<wah_mode, word_t>::begin() const {
+  return ConciseSetBitForwardIterator<wah_mode, word_t>(*this);
+}
+
+template <bool wah_mode, class word_t>
+inline ConciseSetBitForwardIterator<wah_mode, word_t>&
+ConciseSet<wah_mode, word_t>::end() const {
+  static ConciseSetBitForwardIterator<wah_mode, word_t> endp(*this, true);
+  return endp;
+}
+
+template <bool wah_mode, class word_t>
+inline ConciseSetBitForwardIterator<wah_mode, word_t>
+ConciseView<wah_mode, word_t>::begin() const {
+  return ConciseSetBitForwardIterator<wah_mode, word_t>(*this);
 }
 
-template <bool wah_mode>
-inline ConciseSetBitForwardIterator<wah_mode>&
-ConciseSet<wah_mode>::end() const {
-  static ConciseSetBitForwardIterator<wah_mode> endp(*this, true);
+template <bool wah_mode, class word_t>
+inline ConciseSetBitForwardIterator<wah_mode, word_t>&
+ConciseView<wah_mode, word_t>::end() const {
+  static ConciseSetBitForwardIterator<wah_mode, word_t> endp(*this, true);
   return endp;
 }
+
+template <bool wah_mode, class word_t>
+inline ConciseSetBitReverseIterator<wah_mode, word_t>
+ConciseSet<wah_mode, word_t>::rbegin() const {
+  return ConciseSetBitReverseIterator<wah_mode, word_t>(*this);
+}
+
+template <bool wah_mode, class word_t>
+inline ConciseSetBitReverseIterator<wah_mode, word_t>
+ConciseSet<wah_mode, word_t>::rend() const {
+  return ConciseSetBitReverseIterator<wah_mode, word_t>(*this, true);
+}
+
+template <bool wah_mode, class word_t>
+inline ConciseSetBitReverseIterator<wah_mode, word_t>
+ConciseView<wah_mode, word_t>::rbegin() const {
+  return ConciseSetBitReverseIterator<wah_mode, word_t>(*this);
+}
+
+template <bool wah_mode, class word_t>
+inline ConciseSetBitReverseIterator<wah_mode, word_t>
+ConciseView<wah_mode, word_t>::rend() const {
+  return ConciseSetBitReverseIterator<wah_mode, word_t>(*this, true);
+}
+
+#endif
@@ -0,0 +1,178 @@
+#ifndef CONCISEBATCH_H
+#define CONCISEBATCH_H
+#include <map>
+#include <tuple>
+#include <vector>
+
+#include "conciseexpr.h"
+#include "conciseparallel.h"
+
+/**
+ * Batch of queries (ConciseExpressions) over the same sets, evaluated
+ * together. The queries are merged into a single graph in which every
+ * distinct subexpression appears once, so that a term such as a & b shared
+ * by many queries (or written b & a by some of them) is computed once. Each
+ * node of the graph is computed by the binary logical*ToContainer() kernel
+ * of its operator. Nodes are grouped by level, a node being one level above
+ * its deepest operand and the sets at level 0: the nodes of a level only
+ * read lower levels and run in parallel through parallelFor(). Intermediate
+ * results are released as soon as the last level reading them is done.
+ * The batch holds pointers to the sets, which must outlive it.
+ */
+template <bool wah_mode = false, class word_t = uint32_t> class ConciseBatch {
+public:
+  typedef ConciseSet<wah_mode, word_t> set_t;
+  typedef ConciseExpression<wah_mode, word_t> expression_t;
+
+  /**
+   * Node of the graph: a set when set is not NULL, otherwise the operation
+   * op over the nodes left and right
+   */
+  struct Node {
+    const set_t *set;
+    int32_t left;
+    int32_t right;
+    MultiwayOp op;
+    uint32_t level;
+  };
+
+  ConciseBatch() : levels(0) {}
+
+  explicit ConciseBatch(const std::vector<expression_t> &queries)
+      : levels(0) {
+    for (const expression_t &query : queries)
+      add(query);
+  }
+
+  /**
+   * Adds a query to the batch and returns its index among the results of
+   * execute()
+   */
+  size_t add(const expression_t &query) {
+    std::vector<int32_t> stack;
+    for (const typename expression_t::Step &step : query.steps) {
+      int32_t operand;
+      if (step.leaf >= 0) {
+        operand = leaf(query.leaves[step.leaf]);
+      } else {
+        operand = stack.back();
+        stack.pop_back();
+      }
+      if (step.push)
+        stack.push_back(operand);
+      else
+        stack.back() = operation(step.op, stack.back(), operand);
+    }
+    roots.push_back(stack.back());
+    return roots.size() - 1;
+  }
+
+  /**
+   * Number of operations left to compute once shared subexpressions are
+   * merged
+   */
+  size_t operationCount() const { return operations.size(); }
+
+  /**
+   * Evaluates every query, on up to the given number of threads (0 means
+   * defaultThreadCount()), and returns their values in the order in which
+   * they were added
+   */
+  std::vector<set_t> execute(size_t threads = 0) const {
+    if (threads == 0)
+      threads = defaultThreadCount();
+    std::vector<std::vector<int32_t>> byLevel(levels + 1);
+    // level after which an intermediate result is no longer read
+    std::vector<uint32_t> lastUse(nodes.size(), 0);
+    std::vector<size_t> queries(nodes.size(), 0);
+    for (int32_t root : roots)
+      queries[root]++;
+    for (size_t id = 0; id < nodes.size(); id++) {
+      const Node &node = nodes[id];
+      if (node.set != NULL)
+        continue;
+      byLevel[node.level].push_back((int32_t)id);
+      lastUse[node.left] = std::max(lastUse[node.left], node.level);
+      lastUse[node.right] = std::max(lastUse[node.right], node.level);
+    }
+    std::vector<std::vector<int32_t>> releaseAfter(levels + 1);
+    for (size_t id = 0; id < nodes.size(); id++)
+      if (nodes[id].set == NULL && queries[id] == 0)
+        releaseAfter[lastUse[id]].push_back((int32_t)id);
+    std::vector<set_t> values(nodes.size());
+    auto operand = [&](int32_t id) -> const set_t & {
+      return nodes[id].set != NULL ? *nodes[id].set : values[id];
+    };
+    for (uint32_t level = 1; level <= levels; level++) {
+      const std::vector<int32_t> &ids = byLevel[level];
+      parallelFor(ids.size(), threads, [&](size_t k) {
+        const Node &node = nodes[ids[k]];
+        compute(node.op, operand(node.left), operand(node.right),
+                values[ids[k]]);
+      });
+      for (int32_t id : releaseAfter[level])
+        values[id].reset();
+    }
+    // the last query of a node takes its value, the others copy it
+    std::vector<set_t> results(roots.size());
+    for (size_t q = 0; q < roots.size(); q++) {
+      const int32_t root = roots[q];
+      if (--queries[root] == 0 && nodes[root].set == NULL)
+        results[q].swap(values[root]);
+      else
+        results[q] = operand(root);
+    }
+    return results;
+  }
+
+  static void compute(MultiwayOp op, const set_t &left, const set_t &right,
+                      set_t &res) {
+    switch (op) {
+    case MULTIWAY_OR:
+      left.logicalorToContainer(right, res);
+      break;
+    case MULTIWAY_AND:
+      left.logicalandToContainer(right, res);
+      break;
+    case MULTIWAY_XOR:
+      left.logicalxorToContainer(right, res);
+      break;
+    case MULTIWAY_ANDNOT:
+      left.logicalandnotToContainer(right, res);
+      break;
+    }
+  }
+
+  int32_t leaf(const set_t *set) {
+    auto it = sets.find(set);
+    if (it != sets.end())
+      return it->second;
+    nodes.push_back(Node{set, -1, -1, MULTIWAY_OR, 0});
+    return sets[set] = (int32_t)nodes.size() - 1;
+  }
+
+  int32_t operation(MultiwayOp op, int32_t left, int32_t right) {
+    // only ANDNOT depends on the order of its operands
+    if (op != MULTIWAY_ANDNOT && right < left)
+      std::swap(left, right);
+    const std::tuple<int, int32_t, int32_t> key(op, left, right);
+    auto it = operations.find(key);
+    if (it != operations.end())
+      return it->second;
+    const uint32_t level =
+        std::max(nodes[left].level, nodes[right].level) + 1;
+    levels = std::max(levels, level);
+    nodes.push_back(Node{NULL, left, right, op, level});
+    return operations[key] = (int32_t)nodes.size() - 1;
+  }
+
+  std::vector<Node> nodes;
+  /** node holding the value of each query */
+  std::vector<int32_t> roots;
+  std::map<const set_t *, int32_t> sets;
+  std::map<std::tuple<int, int32_t, int32_t>, int32_t> operations;
+  /** highest level of a node */
+  uint32_t levels;
+};
+
+#endif
@@ -0,0 +1,122 @@
+#ifndef CONCISEDECODE_H
+#define CONCISEDECODE_H
+#include <cstdint>
+#include <cstddef>
+
+#include "conciseutil.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CONCISE_X86_DECODE 1
+#include <immintrin.h>
+#endif
+
+/**
+ * Kernels used by ConciseView::toArray() to write out the values of a set:
+ * bits() writes base + i for every bit i set in bits, run() writes start,
+ * start + 1, ..., start + length - 1. Both return the new end of the output.
+ * The output never extends past end, the end of the array handed to
+ * toArray().
+ */
+struct ScalarDecoder {
+  static inline uint32_t *bits(uint64_t bits, uint32_t base, uint32_t *out,
+                               const uint32_t *) {
+    while (bits != 0) {
+      *out++ = base + (uint32_t)__builtin_ctzll(bits);
+      bits &= bits - 1;
+    }
+    return out;
+  }
+
+  static inline uint32_t *run(uint32_t start, uint32_t length, uint32_t *out) {
+    for (uint32_t k = 0; k < length; k++)
+      out[k] = start + k;
+    return out + length;
+  }
+};
+
+#ifdef CONCISE_X86_DECODE
+
+/**
+ * For each byte, the positions of its set bits, padded with zeros
+ */
+struct BitPositionTable {
+  BitPositionTable() {
+    for (int byte = 0; byte < 256; byte++) {
+      int count = 0;
+      for (int bit = 0; bit < 8; bit++)
+        positions[byte][bit] = 0;
+      for (int bit = 0; bit < 8; bit++)
+        if (byte & (1 << bit))
+          positions[byte][count++] = (uint8_t)bit;
+    }
+  }
+
+  static const BitPositionTable &get() {
+    static const BitPositionTable table;
+    return table;
+  }
+
+  uint8_t positions[256][8];
+};
+
+/**
+ * AVX2 kernels: a literal is decoded one byte at a time, by widening the
+ * positions of its set bits to eight 32-bit lanes, adding the base, and
+ * storing all eight lanes; the output then moves forward by the number of
+ * bits set in the byte. Stores may write up to 8 lanes past the last value
+ * of a literal, so literals too close to the end of the output, as well as
+ * literals with few bits set, go through ScalarDecoder.
+ */
+struct AVX2Decoder {
+  __attribute__((target("avx2"))) static inline uint32_t *
+  bits(uint64_t bits, uint32_t base, uint32_t *out, const uint32_t *end) {
+    // sparse literals are cheaper to decode one bit at a time
+    if (end - out < 64 || __builtin_popcountll(bits) < 8)
+      return ScalarDecoder::bits(bits, base, out, end);
+    const BitPositionTable &table = BitPositionTable::get();
+    __m256i offset = _mm256_set1_epi32((int)base);
+    const __m256i eight = _mm256_set1_epi32(8);
+    while (bits != 0) {
+      const uint32_t byte = (uint32_t)(bits & 0xFF);
+      const __m256i positions = _mm256_cvtepu8_epi32(
+          _mm_loadl_epi64((const __m128i *)table.positions[byte]));
+      _mm256_storeu_si256((__m256i *)out, _mm256_add_epi32(positions, offset));
+      out += __builtin_popcount(byte);
+      offset = _mm256_add_epi32(offset, eight);
+      bits >>= 8;
+    }
+    return out;
+  }
+
+  __attribute__((target("avx2"))) static inline uint32_t *
+  run(uint32_t start, uint32_t length, uint32_t *out) {
+    __m256i values = _mm256_add_epi32(_mm256_set1_epi32((int)start),
+                                      _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    const __m256i eight = _mm256_set1_epi32(8);
+    uint32_t k = 0;
+    for (; k + 8 <= length; k += 8) {
+      _mm256_storeu_si256((__m256i *)(out + k), values);
+      values = _mm256_add_epi32(values, eight);
+    }
+    for (; k < length; k++)
+      out[k] = start + k;
+    return out + length;
+  }
+};
+
+/**
+ * Whether toArray() may use AVX2Decoder: always when the code is compiled
+ * for AVX2, otherwise when the processor supports it (checked once)
+ */
+static inline bool useAVX2Decoder() {
+#ifdef __AVX2__
+  return true;
+#else
+  static const bool supported = __builtin_cpu_supports("avx2");
+  return supported;
+#endif
+}
+
+#endif // CONCISE_X86_DECODE
+
+#endif
@@ -0,0 +1,384 @@
+#ifndef CONCISEEXPR_H
+#define CONCISEEXPR_H
+#include <vector>
+#include <algorithm>
+
+#include "concise.h"
+
+/**
+ * Sink for ConciseExpression::run() that stops at the first element
+ */
+class NonEmptySink {
+public:
+  NonEmptySink() : found(false) {}
+
+  bool appendZeros(uint32_t) { return true; }
+
+  template <class word_t> bool append(const word_t *buffer, uint32_t length) {
+    for (uint32_t k = 0; k < length; k++) {
+      if (buffer[k] != 0) {
+        found = true;
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool isEmpty() const { return !found; }
+
+private:
+  bool found;
+};
+
+/**
+ * Boolean expression over ConciseSets, evaluated lazily: the operators &,
+ * |, ^ and - build a tree instead of computing intermediate sets, e.g.,
+ *
+ *   ConciseSet<> answer = ((lazy(a) & b) | (lazy(c) - d)).evaluate();
+ *
+ * Evaluation walks all the sets (the leaves) together, one window of
+ * MULTIWAY_WINDOW blocks at a time, as ConciseSet::multiway() does: each
+ * leaf is decoded into an uncompressed buffer, the buffers are combined
+ * following the tree, and the result is handed to a sink, which appends it
+ * to the answer (evaluate(), toContainer()), counts it (count()) or stops at
+ * the first element (isEmpty()). Windows that the fills of the leaves prove
+ * to be zero in the result are skipped without being decoded.
+ *
+ * The tree is stored as a postfix program over a stack of buffers. A leaf
+ * that is the right operand of an operator is decoded straight into the
+ * buffer of the left operand, so a chain such as a & b & c | d uses a single
+ * buffer. The expression holds pointers to its sets, which must outlive it.
+ * Evaluation only reads the sets, their skip index included (see
+ * ConciseSet::skipIndex), so that expressions sharing sets may be evaluated
+ * on several threads at once.
+ */
+template <bool wah_mode = false, class word_t = uint32_t>
+class ConciseExpression {
+public:
+  typedef ConciseSet<wah_mode, word_t> set_t;
+  typedef ConciseWord<word_t> word_traits;
+
+  /**
+   * Step of the program. With push set, leaf is decoded into a new buffer
+   * on top of the stack. Otherwise the top buffer is combined with op and
+   * either leaf or, when leaf is negative, the buffer above it (which is
+   * popped).
+   */
+  struct Step {
+    int32_t leaf;
+    bool push;
+    MultiwayOp op;
+  };
+
+  ConciseExpression(const set_t &s)
+      : leaves(1, &s), steps(1, Step{0, true, MULTIWAY_OR}), depth(1) {}
+
+  ConciseExpression operator&(const ConciseExpression &o) const {
+    return combine(*this, o, MULTIWAY_AND);
+  }
+
+  ConciseExpression operator|(const ConciseExpression &o) const {
+    return combine(*this, o, MULTIWAY_OR);
+  }
+
+  ConciseExpression operator^(const ConciseExpression &o) const {
+    return combine(*this, o, MULTIWAY_XOR);
+  }
+
+  ConciseExpression operator-(const ConciseExpression &o) const {
+    return combine(*this, o, MULTIWAY_ANDNOT);
+  }
+
+  set_t evaluate() const {
+    set_t answer;
+    toContainer(answer);
+    return answer;
+  }
+
+  /**
+   * Writes the value of the expression into res, which may be one of the
+   * leaves
+   */
+  void toContainer(set_t &res) const {
+    for (const set_t *leaf : leaves) {
+      if (leaf == &res) {
+        set_t tmp;
+        toContainer(tmp);
+        res.swap(tmp);
+        return;
+      }
+    }
+    size_t total = 0;
+    for (const set_t *leaf : leaves)
+      total += leaf->lastWordIndex + 1;
+    // every output word ends where the piece of some leaf ends
+    res.prepareOutput(
+        std::min(2 * total, (size_t)set_t::getBlocksUpTo(lastBound())) + 1);
+    ConciseSetSink<wah_mode, word_t> sink(res);
+    run(sink);
+    if (!res.isEmpty())
+      res.trimZeros();
+    if (res.isEmpty()) {
+      res.reset();
+      return;
+    }
+    res.last = sink.getLast();
+  }
+
+  /**
+   * Number of elements in the value of the expression
+   */
+  size_t count() const {
+    CardinalitySink sink;
+    run(sink);
+    return sink.getCardinality();
+  }
+
+  /**
+   * Whether the value of the expression is empty: the evaluation stops at
+   * the first window holding an element
+   */
+  bool isEmpty() const {
+    NonEmptySink sink;
+    run(sink);
+    return sink.isEmpty();
+  }
+
+  /**
+   * Hands the value of the expression to the sink, window by window (see
+   * ConciseSet::multiway() for the interface of a sink)
+   */
+  template <class Sink> void run(Sink &sink) const {
+    const size_t n = leaves.size();
+    std::vector<WordIterator<wah_mode, word_t>> its;
+    its.reserve(n);
+    for (size_t i = 0; i < n; i++)
+      its.emplace_back(*leaves[i]);
+    // first block of the current piece of each leaf
+    std::vector<uint32_t> positions(n, 0);
+    std::vector<word_t> buffers(depth * MULTIWAY_WINDOW);
+    std::vector<uint32_t> zeros(depth), ones(depth);
+    const uint32_t blocks = set_t::getBlocksUpTo(lastBound());
+    uint32_t start = 0;
+    while (start < blocks) {
+      for (size_t i = 0; i < n; i++)
+        set_t::advanceTo(its[i], positions[i], start, leaves[i]);
+      const uint32_t skip =
+          std::min(blocks, zerosUntil(its, positions, start, blocks,
+                                      zeros.data(), ones.data()));
+      if (skip >= blocks)
+        return;
+      // short runs of zeros are cheaper to decode than to skip
+      if (skip - start >= MULTIWAY_MIN_SKIP) {
+        if (!sink.appendZeros(skip - start))
+          return;
+        start = skip;
+        continue;
+      }
+      const uint32_t length = std::min(MULTIWAY_WINDOW, blocks - start);
+      decode(its, positions, start, length, buffers.data());
+      if (!sink.append(buffers.data(), length))
+        return;
+      start += length;
+    }
+  }
+
+  static ConciseExpression combine(const ConciseExpression &left,
+                                   const ConciseExpression &right,
+                                   MultiwayOp op) {
+    // a lone leaf is cheaper as a right operand, where it needs no buffer
+    if (op != MULTIWAY_ANDNOT && left.steps.size() == 1 &&
+        right.steps.size() > 1)
+      return combine(right, left, op);
+    ConciseExpression answer(left);
+    const int32_t offset = (int32_t)left.leaves.size();
+    answer.leaves.insert(answer.leaves.end(), right.leaves.begin(),
+                         right.leaves.end());
+    if (right.steps.size() == 1) {
+      answer.steps.push_back(Step{offset, false, op});
+      return answer;
+    }
+    for (Step step : right.steps) {
+      if (step.leaf >= 0)
+        step.leaf += offset;
+      answer.steps.push_back(step);
+    }
+    answer.steps.push_back(Step{-1, false, op});
+    answer.depth = std::max(left.depth, right.depth + 1);
+    return answer;
+  }
+
+  /**
+   * Upper bound on the greatest element of the value of the expression
+   */
+  int32_t lastBound() const {
+    std::vector<int32_t> stack;
+    stack.reserve(depth);
+    for (const Step &step : steps) {
+      int32_t last;
+      if (step.leaf >= 0) {
+        last = leaves[step.leaf]->last;
+      } else {
+        last = stack.back();
+        stack.pop_back();
+      }
+      if (step.push) {
+        stack.push_back(last);
+        continue;
+      }
+      int32_t &top = stack.back();
+      if (step.op == MULTIWAY_AND)
+        top = std::min(top, last);
+      else if (step.op != MULTIWAY_ANDNOT)
+        top = std::max(top, last);
+    }
+    return stack.back();
+  }
+
+  /**
+   * Block up to which the value of the expression is known to be zero from
+   * block start on, given the fills the leaves stand on: the blocks
+   * [start, zeros[k]) of stack entry k are known to be zero, and the blocks
+   * [start, ones[k]) to be one.
+   */
+  uint32_t zerosUntil(std::vector<WordIterator<wah_mode, word_t>> &its,
+                      const std::vector<uint32_t> &positions, uint32_t start,
+                      uint32_t blocks, uint32_t *zeros, uint32_t *ones) const {
+    size_t top = 0;
+    for (const Step &step : steps) {
+      uint32_t z, o;
+      if (step.leaf >= 0) {
+        WordIterator<wah_mode, word_t> &it = its[step.leaf];
+        const uint32_t end = positions[step.leaf] + it.blocks();
+        z = o = start;
+        if (it.exhausted())
+          z = blocks;
+        else if (!it.IsLiteral && (it.word & word_traits::SEQUENCE_BIT))
+          o = end;
+        else if (!it.IsLiteral)
+          z = end;
+      } else {
+        top--;
+        z = zeros[top];
+        o = ones[top];
+      }
+      if (step.push) {
+        zeros[top] = z;
+        ones[top] = o;
+        top++;
+        continue;
+      }
+      const uint32_t zl = zeros[top - 1];
+      const uint32_t ol = ones[top - 1];
+      switch (step.op) {
+      case MULTIWAY_OR:
+        zeros[top - 1] = std::min(zl, z);
+        ones[top - 1] = std::max(ol, o);
+        break;
+      case MULTIWAY_AND:
+        zeros[top - 1] = std::max(zl, z);
+        ones[top - 1] = std::min(ol, o);
+        break;
+      case MULTIWAY_XOR:
+        zeros[top - 1] = std::max(std::min(zl, z), std::min(ol, o));
+        ones[top - 1] = std::max(std::min(zl, o), std::min(ol, z));
+        break;
+      case MULTIWAY_ANDNOT:
+        zeros[top - 1] = std::max(zl, o);
+        ones[top - 1] = std::min(ol, z);
+        break;
+      }
+    }
+    return zeros[0];
+  }
+
+  /**
+   * Computes the value of the expression over the blocks [start, start +
+   * length) into the first buffer
+   */
+  void decode(std::vector<WordIterator<wah_mode, word_t>> &its,
+              std::vector<uint32_t> &positions, uint32_t start,
+              uint32_t length, word_t *buffers) const {
+    size_t top = 0;
+    for (const Step &step : steps) {
+      if (step.push) {
+        word_t *buffer = buffers + top * MULTIWAY_WINDOW;
+        top++;
+        std::fill(buffer, buffer + length, 0);
+        set_t::decodeWindow(its[step.leaf], positions[step.leaf], start,
+                            length, MULTIWAY_OR, buffer);
+      } else if (step.leaf >= 0) {
+        set_t::decodeWindow(its[step.leaf], positions[step.leaf], start,
+                            length, step.op,
+                            buffers + (top - 1) * MULTIWAY_WINDOW);
+      } else {
+        top--;
+        combineWindow(step.op, buffers + top * MULTIWAY_WINDOW,
+                      buffers + (top - 1) * MULTIWAY_WINDOW, length);
+      }
+    }
+  }
+
+  static void combineWindow(MultiwayOp op, const word_t *from, word_t *to,
+                            uint32_t length) {
+    switch (op) {
+    case MULTIWAY_OR:
+      for (uint32_t k = 0; k < length; k++)
+        to[k] |= from[k];
+      break;
+    case MULTIWAY_AND:
+      for (uint32_t k = 0; k < length; k++)
+        to[k] &= from[k];
+      break;
+    case MULTIWAY_XOR:
+      for (uint32_t k = 0; k < length; k++)
+        to[k] ^= from[k];
+      break;
+    case MULTIWAY_ANDNOT:
+      for (uint32_t k = 0; k < length; k++)
+        to[k] &= ~from[k];
+      break;
+    }
+  }
+
+  std::vector<const set_t *> leaves;
+  std::vector<Step> steps;
+  /** largest number of buffers on the stack */
+  size_t depth;
+};
+
+template <bool wah_mode, class word_t>
+ConciseExpression<wah_mode, word_t>
+lazy(const ConciseSet<wah_mode, word_t> &s) {
+  return ConciseExpression<wah_mode, word_t>(s);
+}
+
+template <bool wah_mode, class word_t>
+ConciseExpression<wah_mode, word_t>
+operator&(const ConciseSet<wah_mode, word_t> &s,
+          const ConciseExpression<wah_mode, word_t> &e) {
+  return lazy(s) & e;
+}
+
+template <bool wah_mode, class word_t>
+ConciseExpression<wah_mode, word_t>
+operator|(const ConciseSet<wah_mode, word_t> &s,
+          const ConciseExpression<wah_mode, word_t> &e) {
+  return lazy(s) | e;
+}
+
+template <bool wah_mode, class word_t>
+ConciseExpression<wah_mode, word_t>
+operator^(const ConciseSet<wah_mode, word_t> &s,
+          const ConciseExpression<wah_mode, word_t> &e) {
+  return lazy(s) ^ e;
+}
+
+template <bool wah_mode, class word_t>
+ConciseExpression<wah_mode, word_t>
+operator-(const ConciseSet<wah_mode, word_t> &s,
+          const ConciseExpression<wah_mode, word_t> &e) {
+  return lazy(s) - e;
+}
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef CONCISEPARALLEL_H
+#define CONCISEPARALLEL_H
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "concise.h"
+
+/**
+ * Unions of fewer sets are computed by a single thread
+ */
+constexpr static size_t PARALLEL_LOGICALOR_THRESHOLD = 64;
+
+/**
+ * Number of threads used when none is given: one per hardware thread
+ */
+static inline size_t defaultThreadCount() {
+  const size_t threads = std::thread::hardware_concurrency();
+  return threads == 0 ? 1 : threads;
+}
+
+/**
+ * Calls f(0), f(1), ..., f(tasks - 1) on up to the given number of threads
+ * (the calling thread included). Threads pick the next task from a shared
+ * counter as soon as they are done with the previous one, so that uneven
+ * tasks are balanced. Returns once every task is done.
+ */
+template <class F> void parallelFor(size_t tasks, size_t threads, F f) {
+  threads = std::min(threads, tasks);
+  if (threads <= 1) {
+    for (size_t t = 0; t < tasks; t++)
+      f(t);
+    return;
+  }
+  std::atomic<size_t> next(0);
+  auto worker = [&]() {
+    for (size_t t = next++; t < tasks; t = next++)
+      f(t);
+  };
+  std::vector<std::thread> pool;
+  pool.reserve(threads - 1);
+  for (size_t k = 1; k < threads; k++)
+    pool.emplace_back(worker);
+  worker();
+  for (std::thread &thread : pool)
+    thread.join();
+}
+
+/**
+ * Union of n sets on several threads: the inputs are cut into one run of
+ * consecutive inputs per thread, holding about as many words each, every
+ * run is merged with ConciseSet::fast_logicalor(), and the partial unions
+ * are merged pairwise with logicalorToContainer() along a balanced tree.
+ * The inputs are only read, their skip index included (see
+ * ConciseSet::skipIndex), so the same set may be given several times.
+ * Few inputs, or a single thread, fall back to ConciseSet::fast_logicalor().
+ * A thread count of 0 means defaultThreadCount().
+ */
+template <bool wah_mode, class word_t>
+void parallel_logicalorToContainer(size_t n,
+                                   const ConciseSet<wah_mode, word_t> **inputs,
+                                   ConciseSet<wah_mode, word_t> &res,
+                                   size_t threads = 0) {
+  if (threads == 0)
+    threads = defaultThreadCount();
+  threads = std::min(threads, n / MULTIWAY_THRESHOLD);
+  if (n < PARALLEL_LOGICALOR_THRESHOLD || threads <= 1) {
+    ConciseSet<wah_mode, word_t>::fast_logicalorToContainer(n, inputs, res);
+    return;
+  }
+  size_t total = 0;
+  for (size_t i = 0; i < n; i++)
+    total += inputs[i]->lastWordIndex + 1;
+  // runs [bounds[c], bounds[c + 1]) of about total / threads words
+  std::vector<size_t> bounds(1, 0);
+  size_t words = 0;
+  for (size_t i = 0; i < n && bounds.size() < threads; i++) {
+    words += inputs[i]->lastWordIndex + 1;
+    if (words * threads >= total * bounds.size())
+      bounds.push_back(i + 1);
+  }
+  if (bounds.back() != n)
+    bounds.push_back(n);
+  const size_t runs = bounds.size() - 1;
+  std::vector<ConciseSet<wah_mode, word_t>> partial(runs);
+  parallelFor(runs, threads, [&](size_t c) {
+    ConciseSet<wah_mode, word_t>::fast_logicalorToContainer(
+        bounds[c + 1] - bounds[c], inputs + bounds[c], partial[c]);
+  });
+  std::vector<ConciseSet<wah_mode, word_t>> merged(runs);
+  for (size_t step = 1; step < runs; step *= 2) {
+    const size_t pairs = (runs + 2 * step - 1) / (2 * step);
+    parallelFor(pairs, threads, [&](size_t p) {
+      const size_t c = 2 * step * p;
+      if (c + step >= runs)
+        return;
+      partial[c].logicalorToContainer(partial[c + step], merged[c]);
+      partial[c].swap(merged[c]);
+      partial[c + step].clear();
+    });
+  }
+  res.swap(partial[0]);
+}
+
+template <bool wah_mode, class word_t>
+ConciseSet<wah_mode, word_t>
+parallel_logicalor(size_t n, const ConciseSet<wah_mode, word_t> **inputs,
+                   size_t threads = 0) {
+  ConciseSet<wah_mode, word_t> answer;
+  parallel_logicalorToContainer(n, inputs, answer, threads);
+  return answer;
+}
+
+#endif
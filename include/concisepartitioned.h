@@ -0,0 +1,449 @@
+#ifndef CONCISEPARTITIONED_H
+#define CONCISEPARTITIONED_H
+#include <vector>
+#include <stdexcept>
+#include <algorithm>
+#include <iterator>
+#include <string>
+#include <type_traits>
+
+#include "concise.h"
+#include "conciseparallel.h"
+
+/**
+ * Default number of low bits of a value kept by its partition: 2^24 values,
+ * that is 541,201 blocks, per partition
+ */
+constexpr static uint32_t PARTITION_BITS = UINT32_C(24);
+
+/**
+ * Operations over fewer words in total are run by a single thread
+ */
+constexpr static size_t PARTITIONED_SERIAL_WORDS = 1 << 16;
+
+template <bool wah_mode, class word_t, class value_t>
+class PartitionedConciseSetIterator;
+
+/**
+ * Set of integers cut into ranges of 2^partitionBits values, each held by an
+ * independent ConciseSet over the low bits of its values. Only non-empty
+ * partitions are stored, sorted by key (the high bits of their values).
+ * Binary operations and counts run partition by partition on several
+ * threads and the resulting partitions are kept as they are, without being
+ * encoded again. Both operands of a binary operation must use the same
+ * number of partition bits.
+ *
+ * Values are of type value_t, uint32_t or uint64_t: unlike a ConciseSet,
+ * the set accepts every value of that type, so that identifiers need not be
+ * remapped below MAX_ALLOWED_INTEGER.
+ */
+template <bool wah_mode = false, class word_t = uint32_t,
+          class value_t = uint32_t>
+class PartitionedConciseSet {
+  static_assert(std::is_same<value_t, uint32_t>::value ||
+                    std::is_same<value_t, uint64_t>::value,
+                "values must be uint32_t or uint64_t");
+
+public:
+  struct Partition {
+    value_t key;
+    ConciseSet<wah_mode, word_t> set;
+  };
+
+  /**
+   * Largest number of partition bits: the low bits of a value must fit in
+   * [0, MAX_ALLOWED_INTEGER] (29 bits with 32-bit words, 31 with 64-bit
+   * words)
+   */
+  static constexpr uint32_t maxPartitionBits(
+      uint64_t limit = (uint64_t)ConciseWord<word_t>::MAX_ALLOWED_INTEGER + 1,
+      uint32_t bits = 0) {
+    return limit > 1 ? maxPartitionBits(limit >> 1, bits + 1) : bits;
+  }
+
+  explicit PartitionedConciseSet(uint32_t bits = PARTITION_BITS)
+      : partitionBits(bits), partitions() {
+    if (bits == 0 || bits > maxPartitionBits()) {
+      throw std::runtime_error("partition bits must be between 1 and " +
+                               std::to_string(maxPartitionBits()));
+    }
+  }
+
+  uint32_t getPartitionBits() const { return partitionBits; }
+
+  bool isEmpty() const { return partitions.empty(); }
+
+  void clear() { partitions.clear(); }
+
+  void add(value_t e) {
+    const value_t key = e >> partitionBits;
+    auto it = seek(key);
+    if (it == partitions.end() || it->key != key) {
+      it = partitions.insert(it, Partition());
+      it->key = key;
+    }
+    it->set.add((uint32_t)(e & lowMask()));
+  }
+
+  bool contains(value_t e) const {
+    const value_t key = e >> partitionBits;
+    auto it = seek(key);
+    return it != partitions.end() && it->key == key &&
+           it->set.contains((uint32_t)(e & lowMask()));
+  }
+
+  size_t size() const {
+    size_t answer = 0;
+    for (const Partition &p : partitions)
+      answer += p.set.size();
+    return answer;
+  }
+
+  size_t sizeInBytes() const {
+    size_t answer = 0;
+    for (const Partition &p : partitions)
+      answer += sizeof(value_t) + p.set.sizeInBytes();
+    return answer;
+  }
+
+  bool equals(
+      const PartitionedConciseSet<wah_mode, word_t, value_t> &other) const {
+    if (partitionBits != other.partitionBits ||
+        partitions.size() != other.partitions.size())
+      return false;
+    for (size_t i = 0; i < partitions.size(); i++) {
+      if (partitions[i].key != other.partitions[i].key ||
+          !partitions[i].set.equals(other.partitions[i].set))
+        return false;
+    }
+    return true;
+  }
+
+  /**
+   * Binary operations. The thread count is handed to parallelFor(), 0 meaning
+   * defaultThreadCount(); small operands are processed by a single thread.
+   */
+  void logicalandToContainer(
+      const PartitionedConciseSet<wah_mode, word_t, value_t> &other,
+      PartitionedConciseSet<wah_mode, word_t, value_t> &res,
+      size_t threads = 0) const {
+    combine(other, res, threads, false, false,
+            [](const ConciseSet<wah_mode, word_t> &a,
+               const ConciseSet<wah_mode, word_t> &b,
+               ConciseSet<wah_mode, word_t> &out) {
+              a.logicalandToContainer(b, out);
+            });
+  }
+
+  void logicalorToContainer(
+      const PartitionedConciseSet<wah_mode, word_t, value_t> &other,
+      PartitionedConciseSet<wah_mode, word_t, value_t> &res,
+      size_t threads = 0) const {
+    combine(other, res, threads, true, true,
+            [](const ConciseSet<wah_mode, word_t> &a,
+               const ConciseSet<wah_mode, word_t> &b,
+               ConciseSet<wah_mode, word_t> &out) {
+              a.logicalorToContainer(b, out);
+            });
+  }
+
+  void logicalxorToContainer(
+      const PartitionedConciseSet<wah_mode, word_t, value_t> &other,
+      PartitionedConciseSet<wah_mode, word_t, value_t> &res,
+      size_t threads = 0) const {
+    combine(other, res, threads, true, true,
+            [](const ConciseSet<wah_mode, word_t> &a,
+               const ConciseSet<wah_mode, word_t> &b,
+               ConciseSet<wah_mode, word_t> &out) {
+              a.logicalxorToContainer(b, out);
+            });
+  }
+
+  void logicalandnotToContainer(
+      const PartitionedConciseSet<wah_mode, word_t, value_t> &other,
+      PartitionedConciseSet<wah_mode, word_t, value_t> &res,
+      size_t threads = 0) const {
+    combine(other, res, threads, true, false,
+            [](const ConciseSet<wah_mode, word_t> &a,
+               const ConciseSet<wah_mode, word_t> &b,
+               ConciseSet<wah_mode, word_t> &out) {
+              a.logicalandnotToContainer(b, out);
+            });
+  }
+
+  PartitionedConciseSet<wah_mode, word_t, value_t>
+  logicaland(const PartitionedConciseSet<wah_mode, word_t, value_t> &other,
+             size_t threads = 0) const {
+    PartitionedConciseSet<wah_mode, word_t, value_t> res(partitionBits);
+    logicalandToContainer(other, res, threads);
+    return res;
+  }
+
+  PartitionedConciseSet<wah_mode, word_t, value_t>
+  logicalor(const PartitionedConciseSet<wah_mode, word_t, value_t> &other,
+            size_t threads = 0) const {
+    PartitionedConciseSet<wah_mode, word_t, value_t> res(partitionBits);
+    logicalorToContainer(other, res, threads);
+    return res;
+  }
+
+  PartitionedConciseSet<wah_mode, word_t, value_t>
+  logicalxor(const PartitionedConciseSet<wah_mode, word_t, value_t> &other,
+             size_t threads = 0) const {
+    PartitionedConciseSet<wah_mode, word_t, value_t> res(partitionBits);
+    logicalxorToContainer(other, res, threads);
+    return res;
+  }
+
+  PartitionedConciseSet<wah_mode, word_t, value_t>
+  logicalandnot(const PartitionedConciseSet<wah_mode, word_t, value_t> &other,
+                size_t threads = 0) const {
+    PartitionedConciseSet<wah_mode, word_t, value_t> res(partitionBits);
+    logicalandnotToContainer(other, res, threads);
+    return res;
+  }
+
+  PartitionedConciseSet<wah_mode, word_t, value_t>
+  operator&(const PartitionedConciseSet<wah_mode, word_t, value_t> &o) const {
+    return logicaland(o);
+  }
+
+  PartitionedConciseSet<wah_mode, word_t, value_t>
+  operator|(const PartitionedConciseSet<wah_mode, word_t, value_t> &o) const {
+    return logicalor(o);
+  }
+
+  PartitionedConciseSet<wah_mode, word_t, value_t>
+  operator^(const PartitionedConciseSet<wah_mode, word_t, value_t> &o) const {
+    return logicalxor(o);
+  }
+
+  PartitionedConciseSet<wah_mode, word_t, value_t>
+  operator-(const PartitionedConciseSet<wah_mode, word_t, value_t> &o) const {
+    return logicalandnot(o);
+  }
+
+  size_t logicalandCount(
+      const PartitionedConciseSet<wah_mode, word_t, value_t> &other,
+      size_t threads = 0) const {
+    return count(other, threads, false, false,
+                 [](const ConciseSet<wah_mode, word_t> &a,
+                    const ConciseSet<wah_mode, word_t> &b) {
+                   return a.logicalandCount(b);
+                 });
+  }
+
+  size_t logicalorCount(
+      const PartitionedConciseSet<wah_mode, word_t, value_t> &other,
+      size_t threads = 0) const {
+    return count(other, threads, true, true,
+                 [](const ConciseSet<wah_mode, word_t> &a,
+                    const ConciseSet<wah_mode, word_t> &b) {
+                   return a.logicalorCount(b);
+                 });
+  }
+
+  size_t logicalxorCount(
+      const PartitionedConciseSet<wah_mode, word_t, value_t> &other,
+      size_t threads = 0) const {
+    return count(other, threads, true, true,
+                 [](const ConciseSet<wah_mode, word_t> &a,
+                    const ConciseSet<wah_mode, word_t> &b) {
+                   return a.logicalxorCount(b);
+                 });
+  }
+
+  size_t logicalandnotCount(
+      const PartitionedConciseSet<wah_mode, word_t, value_t> &other,
+      size_t threads = 0) const {
+    return count(other, threads, true, false,
+                 [](const ConciseSet<wah_mode, word_t> &a,
+                    const ConciseSet<wah_mode, word_t> &b) {
+                   return a.logicalandnotCount(b);
+                 });
+  }
+
+  PartitionedConciseSetIterator<wah_mode, word_t, value_t> begin() const {
+    return PartitionedConciseSetIterator<wah_mode, word_t, value_t>(*this, 0);
+  }
+
+  PartitionedConciseSetIterator<wah_mode, word_t, value_t> end() const {
+    return PartitionedConciseSetIterator<wah_mode, word_t, value_t>(*this,
+                                                           partitions.size());
+  }
+
+  uint32_t partitionBits;
+  std::vector<Partition> partitions;
+
+  value_t lowMask() const { return ((value_t)1 << partitionBits) - 1; }
+
+  typename std::vector<Partition>::const_iterator seek(value_t key) const {
+    return std::lower_bound(
+        partitions.begin(), partitions.end(), key,
+        [](const Partition &p, value_t k) { return p.key < k; });
+  }
+
+  typename std::vector<Partition>::iterator seek(value_t key) {
+    return std::lower_bound(
+        partitions.begin(), partitions.end(), key,
+        [](const Partition &p, value_t k) { return p.key < k; });
+  }
+
+  /**
+   * Partitions of both sets sharing a key; a missing side is NULL
+   */
+  struct Match {
+    value_t key;
+    const ConciseSet<wah_mode, word_t> *left;
+    const ConciseSet<wah_mode, word_t> *right;
+  };
+
+  /**
+   * Pairs up the partitions of both sets by key, keeping the partitions
+   * found only in this set (respectively only in other) when asked to
+   */
+  std::vector<Match> match(
+      const PartitionedConciseSet<wah_mode, word_t, value_t> &other,
+      bool leftOnly, bool rightOnly, size_t &words) const {
+    if (partitionBits != other.partitionBits) {
+      throw std::runtime_error("partition bits differ");
+    }
+    std::vector<Match> answer;
+    words = 0;
+    size_t i = 0, j = 0;
+    while (i < partitions.size() || j < other.partitions.size()) {
+      const Partition *a = i < partitions.size() ? &partitions[i] : NULL;
+      const Partition *b =
+          j < other.partitions.size() ? &other.partitions[j] : NULL;
+      Match m;
+      if (b == NULL || (a != NULL && a->key < b->key)) {
+        m = Match{a->key, &a->set, NULL};
+        i++;
+      } else if (a == NULL || b->key < a->key) {
+        m = Match{b->key, NULL, &b->set};
+        j++;
+      } else {
+        m = Match{a->key, &a->set, &b->set};
+        i++;
+        j++;
+      }
+      if ((m.left == NULL && !rightOnly) || (m.right == NULL && !leftOnly))
+        continue;
+      words += (m.left ? m.left->lastWordIndex + 1 : 0) +
+               (m.right ? m.right->lastWordIndex + 1 : 0);
+      answer.push_back(m);
+    }
+    return answer;
+  }
+
+  static size_t threadsFor(size_t threads, size_t words) {
+    return words < PARTITIONED_SERIAL_WORDS ? 1 : threads == 0
+                                                  ? defaultThreadCount()
+                                                  : threads;
+  }
+
+  /**
+   * Computes op partition by partition. Partitions present in a single
+   * operand are copied when kept. res may be one of the operands.
+   */
+  template <class F>
+  void combine(const PartitionedConciseSet<wah_mode, word_t, value_t> &other,
+               PartitionedConciseSet<wah_mode, word_t, value_t> &res,
+               size_t threads, bool leftOnly, bool rightOnly, F op) const {
+    size_t words;
+    const std::vector<Match> matches = match(other, leftOnly, rightOnly, words);
+    std::vector<Partition> out(matches.size());
+    parallelFor(matches.size(), threadsFor(threads, words), [&](size_t k) {
+      const Match &m = matches[k];
+      out[k].key = m.key;
+      if (m.left == NULL)
+        out[k].set = *m.right;
+      else if (m.right == NULL)
+        out[k].set = *m.left;
+      else
+        op(*m.left, *m.right, out[k].set);
+    });
+    out.erase(std::remove_if(out.begin(), out.end(),
+                             [](const Partition &p) { return p.set.isEmpty(); }),
+              out.end());
+    res.partitionBits = partitionBits;
+    res.partitions.swap(out);
+  }
+
+  template <class F>
+  size_t count(const PartitionedConciseSet<wah_mode, word_t, value_t> &other,
+               size_t threads, bool leftOnly, bool rightOnly, F op) const {
+    size_t words;
+    const std::vector<Match> matches = match(other, leftOnly, rightOnly, words);
+    std::vector<size_t> counts(matches.size());
+    parallelFor(matches.size(), threadsFor(threads, words), [&](size_t k) {
+      const Match &m = matches[k];
+      counts[k] = m.left == NULL    ? m.right->size()
+                  : m.right == NULL ? m.left->size()
+                                    : op(*m.left, *m.right);
+    });
+    size_t answer = 0;
+    for (size_t c : counts)
+      answer += c;
+    return answer;
+  }
+};
+
+/**
+ * Visits the values of a PartitionedConciseSet in increasing order
+ */
+template <bool wah_mode = false, class word_t = uint32_t,
+          class value_t = uint32_t>
+class PartitionedConciseSetIterator {
+public:
+  typedef std::forward_iterator_tag iterator_category;
+  typedef value_t *pointer;
+  typedef value_t &reference_type;
+  typedef value_t reference; // values are computed, not stored
+  typedef value_t value_type;
+  typedef int32_t difference_type;
+  typedef PartitionedConciseSetIterator type_of_iterator;
+
+  PartitionedConciseSetIterator(
+      const PartitionedConciseSet<wah_mode, word_t, value_t> &p, size_t index)
+      : parent(&p), partition(index),
+        inner(ConciseView<wah_mode, word_t>(), true) {
+    if (partition < parent->partitions.size())
+      inner = ConciseSetBitForwardIterator<wah_mode, word_t>(
+          parent->partitions[partition].set);
+  }
+
+  value_type operator*() const {
+    return (parent->partitions[partition].key << parent->partitionBits) |
+           (value_t)*inner;
+  }
+
+  type_of_iterator &operator++() {
+    ++inner;
+    // stored partitions are never empty
+    if (!inner.has_value && ++partition < parent->partitions.size())
+      inner = ConciseSetBitForwardIterator<wah_mode, word_t>(
+          parent->partitions[partition].set);
+    return *this;
+  }
+
+  type_of_iterator operator++(int) {
+    PartitionedConciseSetIterator<wah_mode, word_t, value_t> orig(*this);
+    ++*this;
+    return orig;
+  }
+
+  bool operator==(const type_of_iterator &o) const {
+    if (partition != o.partition)
+      return false;
+    return partition >= parent->partitions.size() || *inner == *o.inner;
+  }
+
+  bool operator!=(const type_of_iterator &o) const { return !(*this == o); }
+
+  const PartitionedConciseSet<wah_mode, word_t, value_t> *parent;
+  size_t partition;
+  ConciseSetBitForwardIterator<wah_mode, word_t> inner;
+};
+
+#endif
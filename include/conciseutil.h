@@ -1,6 +1,8 @@
 #ifndef CONCISEUTIL_H
 #define CONCISEUTIL_H
 #include <cstdint>
+#include <cstring>
+#include <type_traits>
 
 /**
  * The highest representable integer.
@@ -34,102 +36,241 @@ constexpr static uint32_t ALL_ONES_WITHOUT_MSB = UINT32_C(0x7FFFFFFF);
 constexpr static uint32_t SEQUENCE_BIT = UINT32_C(0x40000000);
 
 /**
- * Calculates the modulus division by 31 in a faster way than using n % 31
+ * Number of words between two consecutive entries of the skip index
  */
-static inline uint32_t maxLiteralLengthModulus(uint32_t n) {
-  return n % 31;
-  // following code is a bad idea. Compilers can compiler n % 31 to something
-  // faster.
+constexpr static uint32_t SKIP_INDEX_INTERVAL = UINT32_C(64);
+
+/**
+ * Unions of at most this many sets are merged pairwise rather than in a
+ * single multiway pass
+ */
+constexpr static size_t MULTIWAY_THRESHOLD = 4;
+
+/**
+ * Number of blocks decoded at once by the multiway merge (8 kB of buffer with
+ * 32-bit words)
+ */
+constexpr static uint32_t MULTIWAY_WINDOW = UINT32_C(2048);
+
+/**
+ * Shortest run of zero blocks that the multiway merge skips rather than
+ * decodes
+ */
+constexpr static uint32_t MULTIWAY_MIN_SKIP = UINT32_C(64);
+
+/**
+ * How the multiway merge combines an input with the inputs before it
+ */
+enum MultiwayOp { MULTIWAY_OR, MULTIWAY_AND, MULTIWAY_XOR, MULTIWAY_ANDNOT };
+
+/**
+ * First word of a serialized set ("CNCS" in little-endian order)
+ */
+constexpr static uint32_t CONCISE_SERIAL_COOKIE = UINT32_C(0x53434E43);
+
+/**
+ * Version of the serialization format
+ */
+constexpr static uint32_t CONCISE_SERIAL_VERSION = UINT32_C(1);
+
+/**
+ * Flag set in a serialized set that uses WAH rather than Concise
+ */
+constexpr static uint32_t CONCISE_SERIAL_WAH_FLAG = UINT32_C(1);
+
+/**
+ * Flag set in a serialized set made of 64-bit words
+ */
+constexpr static uint32_t CONCISE_SERIAL_WIDE_FLAG = UINT32_C(2);
+
+/**
+ * Number of 32-bit words in the header of a serialized set
+ */
+constexpr static uint32_t CONCISE_SERIAL_HEADER_WORDS = UINT32_C(6);
+
+/**
+ * Layout of the words of a set made of 32-bit (uint32_t) or 64-bit
+ * (uint64_t) words. A literal has its most significant bit set and holds
+ * MAX_LITERAL_LENGTH bits (31 or 63). A sequence has its most significant
+ * bit cleared, the next bit giving the fill type; in Concise mode, the
+ * following FLIPPED_BIT_WIDTH bits give the position (plus one) of the
+ * flipped bit of the first block, and the remaining low bits the number of
+ * blocks minus one. The constants above describe 32-bit words.
+ */
+template <class word_t> struct ConciseWord {
+  static_assert(std::is_same<word_t, uint32_t>::value ||
+                    std::is_same<word_t, uint64_t>::value,
+                "words must be uint32_t or uint64_t");
+
+  static constexpr uint32_t WORD_BITS = 8 * sizeof(word_t);
+
+  static constexpr uint32_t MAX_LITERAL_LENGTH = WORD_BITS - 1;
+
+  static constexpr word_t ALL_ONES_LITERAL = ~(word_t)0;
+
+  static constexpr word_t ALL_ZEROS_LITERAL = (word_t)1 << (WORD_BITS - 1);
+
+  static constexpr word_t ALL_ONES_WITHOUT_MSB = ALL_ONES_LITERAL >> 1;
+
+  static constexpr word_t SEQUENCE_BIT = (word_t)1 << (WORD_BITS - 2);
+
+  /** the two bits telling literals, 0's and 1's sequences apart */
+  static constexpr word_t TYPE_MASK = ALL_ZEROS_LITERAL | SEQUENCE_BIT;
+
+  /** enough bits to store a position within a literal, plus one */
+  static constexpr uint32_t FLIPPED_BIT_WIDTH = WORD_BITS == 64 ? 6 : 5;
+
+  static constexpr uint32_t FLIPPED_BIT_SHIFT =
+      WORD_BITS - 2 - FLIPPED_BIT_WIDTH;
+
+  static constexpr word_t FLIPPED_BIT_MASK =
+      ((word_t)1 << FLIPPED_BIT_WIDTH) - 1;
+
+  static constexpr word_t CONCISE_COUNT_MASK =
+      ((word_t)1 << FLIPPED_BIT_SHIFT) - 1;
+
+  static constexpr word_t WAH_COUNT_MASK = SEQUENCE_BIT - 1;
+
   /**
-  uint32_t m = (n & UINT32_C(0xC1F07C1F)) + ((n >> 5) & UINT32_C(0xC1F07C1F));
-  m = (m >> 15) + (m & UINT32_C(0x00007FFF));
-  if (m <= 31)
-      return m == 31 ? 0 : m;
-  m = (m >> 5) + (m & UINT32_C(0x0000001F));
-  if (m <= 31)
-      return m == 31 ? 0 : m;
-  m = (m >> 5) + (m & UINT32_C(0x0000001F));
-  if (m <= 31)
-      return m == 31 ? 0 : m;
-  m = (m >> 5) + (m & UINT32_C(0x0000001F));
-  if (m <= 31)
-      return m == 31 ? 0 : m;
-  m = (m >> 5) + (m & UINT32_C(0x0000001F));
-  if (m <= 31)
-      return m == 31 ? 0 : m;
-  m = (m >> 5) + (m & UINT32_C(0x0000001F));
-  return m == 31 ? 0 : m;
-  **/
-}
-
-/**
- * Calculates the multiplication by 31 in a faster way than using n * 31
+   * The highest representable integer: the longest Concise sequence bounds
+   * 32-bit words, and 64-bit words are bounded by the (signed) last element
+   */
+  static constexpr uint32_t MAX_ALLOWED_INTEGER =
+      (uint64_t)MAX_LITERAL_LENGTH * ((uint64_t)CONCISE_COUNT_MASK + 1) +
+                  MAX_LITERAL_LENGTH - 1 <=
+              (uint64_t)INT32_MAX
+          ? (uint32_t)((uint64_t)MAX_LITERAL_LENGTH *
+                           ((uint64_t)CONCISE_COUNT_MASK + 1) +
+                       MAX_LITERAL_LENGTH - 1)
+          : (uint32_t)INT32_MAX;
+
+  static int popcount(word_t word) {
+    return WORD_BITS == 64 ? __builtin_popcountll(word)
+                           : __builtin_popcount((uint32_t)word);
+  }
+
+  /** number of trailing zeros, word must not be 0 */
+  static int ctz(word_t word) {
+    return WORD_BITS == 64 ? __builtin_ctzll(word)
+                           : __builtin_ctz((uint32_t)word);
+  }
+
+  /** number of leading zeros, word must not be 0 */
+  static int clz(word_t word) {
+    return WORD_BITS == 64 ? __builtin_clzll(word)
+                           : __builtin_clz((uint32_t)word);
+  }
+};
+
+template <class word_t> constexpr uint32_t ConciseWord<word_t>::WORD_BITS;
+template <class word_t>
+constexpr uint32_t ConciseWord<word_t>::MAX_LITERAL_LENGTH;
+template <class word_t> constexpr word_t ConciseWord<word_t>::ALL_ONES_LITERAL;
+template <class word_t>
+constexpr word_t ConciseWord<word_t>::ALL_ZEROS_LITERAL;
+template <class word_t>
+constexpr word_t ConciseWord<word_t>::ALL_ONES_WITHOUT_MSB;
+template <class word_t> constexpr word_t ConciseWord<word_t>::SEQUENCE_BIT;
+template <class word_t> constexpr word_t ConciseWord<word_t>::TYPE_MASK;
+template <class word_t>
+constexpr uint32_t ConciseWord<word_t>::FLIPPED_BIT_WIDTH;
+template <class word_t>
+constexpr uint32_t ConciseWord<word_t>::FLIPPED_BIT_SHIFT;
+template <class word_t> constexpr word_t ConciseWord<word_t>::FLIPPED_BIT_MASK;
+template <class word_t>
+constexpr word_t ConciseWord<word_t>::CONCISE_COUNT_MASK;
+template <class word_t> constexpr word_t ConciseWord<word_t>::WAH_COUNT_MASK;
+template <class word_t>
+constexpr uint32_t ConciseWord<word_t>::MAX_ALLOWED_INTEGER;
+
+/**
+ * Calculates the modulus division by 31 (63 for 64-bit words)
  */
+template <class word_t = uint32_t>
+static inline uint32_t maxLiteralLengthModulus(uint32_t n) {
+  // Compilers can compile n % 31 to something faster than a division.
+  return n % ConciseWord<word_t>::MAX_LITERAL_LENGTH;
+}
+
+/**
+ * Calculates the multiplication by 31 (63 for 64-bit words)
+ */
+template <class word_t = uint32_t>
 static inline uint32_t maxLiteralLengthMultiplication(uint32_t n) {
-  return (n << 5) - n; // a good compiler should do this on its own
+  // a good compiler turns this into a shift and a subtraction
+  return n * ConciseWord<word_t>::MAX_LITERAL_LENGTH;
 }
 
 /**
- * Calculates the division by 31
+ * Calculates the division by 31 (63 for 64-bit words)
  */
-static inline uint32_t maxLiteralLengthDivision(uint32_t n) { return n / 31; }
+template <class word_t = uint32_t>
+static inline uint32_t maxLiteralLengthDivision(uint32_t n) {
+  return n / ConciseWord<word_t>::MAX_LITERAL_LENGTH;
+}
 
 /**
  * Checks whether a word is a literal one
  */
-static inline bool isLiteral(uint32_t word) {
+template <class word_t> static inline bool isLiteral(word_t word) {
   // "word" must be 1*
   // NOTE: this is faster than "return (word & 0x80000000) == 0x80000000"
-  return (word & UINT32_C(0x80000000)) != 0;
+  return (word & ConciseWord<word_t>::ALL_ZEROS_LITERAL) != 0;
 }
 
 /**
  * Checks whether a word contains a sequence of 1's
  */
-static inline bool isOneSequence(uint32_t word) {
+template <class word_t> static inline bool isOneSequence(word_t word) {
   // "word" must be 01*
-  return (word & UINT32_C(0xC0000000)) == SEQUENCE_BIT;
+  return (word & ConciseWord<word_t>::TYPE_MASK) ==
+         ConciseWord<word_t>::SEQUENCE_BIT;
 }
 
 /**
  * Checks whether a word contains a sequence of 0's
  */
-static inline bool isZeroSequence(uint32_t word) {
+template <class word_t> static inline bool isZeroSequence(word_t word) {
   // "word" must be 00*
-  return (word & UINT32_C(0xC0000000)) == 0;
+  return (word & ConciseWord<word_t>::TYPE_MASK) == 0;
 }
 
 /**
  * Checks whether a word contains a sequence of 0's with no set bit, or 1's
  * with no unset bit.
  */
-static inline bool isSequenceWithNoBits(uint32_t word) {
+template <class word_t> static inline bool isSequenceWithNoBits(word_t word) {
   // "word" must be 0?00000*
-  return (word & UINT32_C(0xBE000000)) == UINT32_C(0x00000000);
+  return (word & (ConciseWord<word_t>::ALL_ZEROS_LITERAL |
+                  (ConciseWord<word_t>::FLIPPED_BIT_MASK
+                   << ConciseWord<word_t>::FLIPPED_BIT_SHIFT))) == 0;
 }
 
 /**
  * Gets the number of blocks of 1's or 0's stored in a sequence word
  */
-template <bool wah_mode>
-static inline uint32_t getSequenceCount(uint32_t word) {
-  // get the 25 LSB bits
-  return word & (wah_mode? UINT32_C(0x3FFFFFFF) : UINT32_C(0x01FFFFFF));
+template <bool wah_mode, class word_t>
+static inline word_t getSequenceCount(word_t word) {
+  // get the 25 LSB bits (56 with 64-bit words)
+  return word & (wah_mode ? ConciseWord<word_t>::WAH_COUNT_MASK
+                          : ConciseWord<word_t>::CONCISE_COUNT_MASK);
 }
 
 
 /**
  * Clears the (un)set bit in a sequence
  */
-static inline uint32_t getSequenceWithNoBits(uint32_t word) {
+template <class word_t> static inline word_t getSequenceWithNoBits(
+    word_t word) {
   // clear 29 to 25 LSB bits
-  return (word & UINT32_C(0xC1FFFFFF));
+  return word & ~(ConciseWord<word_t>::FLIPPED_BIT_MASK
+                  << ConciseWord<word_t>::FLIPPED_BIT_SHIFT);
 }
 /**
  * Returns true when the given 31-bit literal string (namely,
  * with MSB set) contains only one set bit
  */
-static inline bool containsOnlyOneBit(uint32_t literal) {
+template <class word_t> static inline bool containsOnlyOneBit(word_t literal) {
   return (literal & (literal - 1)) == 0;
 }
 
@@ -137,39 +278,104 @@ static inline bool containsOnlyOneBit(uint32_t literal) {
  * Gets the position of the flipped bit within a sequence word. If the
  * sequence has no set/unset bit, returns -1.
  */
-static inline int getFlippedBit(uint32_t word) {
+template <class word_t> static inline int getFlippedBit(word_t word) {
   // get bits from 30 to 26
   // NOTE: "-1" is required since 00000 represents no bits and 00001 the LSB bit
   // set
-  return ((word >> 25) & UINT32_C(0x0000001F)) - 1;
+  return (int)((word >> ConciseWord<word_t>::FLIPPED_BIT_SHIFT) &
+               ConciseWord<word_t>::FLIPPED_BIT_MASK) -
+         1;
 }
 
-static inline uint32_t concise_xor(uint32_t literal1, uint32_t literal2) {
-  return ALL_ZEROS_LITERAL | (literal1 ^ literal2);
+template <class word_t>
+static inline word_t concise_xor(word_t literal1, word_t literal2) {
+  return ConciseWord<word_t>::ALL_ZEROS_LITERAL | (literal1 ^ literal2);
 }
-static inline uint32_t concise_andnot(uint32_t literal1, uint32_t literal2) {
-  return ALL_ZEROS_LITERAL | (literal1 & (~literal2));
+template <class word_t>
+static inline word_t concise_andnot(word_t literal1, word_t literal2) {
+  return ConciseWord<word_t>::ALL_ZEROS_LITERAL | (literal1 & (~literal2));
 }
 
-static inline uint32_t concise_and(uint32_t literal1, uint32_t literal2) {
-  return ALL_ZEROS_LITERAL | (literal1 & literal2);
+template <class word_t>
+static inline word_t concise_and(word_t literal1, word_t literal2) {
+  return ConciseWord<word_t>::ALL_ZEROS_LITERAL | (literal1 & literal2);
 }
 
 /**
  * Gets the bits contained within the literal word
  */
-static inline uint32_t getLiteralBits(uint32_t word) {
-  return ALL_ONES_WITHOUT_MSB & word;
+template <class word_t> static inline word_t getLiteralBits(word_t word) {
+  return ConciseWord<word_t>::ALL_ONES_WITHOUT_MSB & word;
 }
 /**
  * Gets the number of set bits within the literal word
  */
-static inline int getLiteralBitCount(uint32_t word) {
-  return __builtin_popcount(getLiteralBits(word));
+template <class word_t> static inline int getLiteralBitCount(word_t word) {
+  return ConciseWord<word_t>::popcount(getLiteralBits(word));
 }
 
-static inline bool isLiteralZero(uint32_t word) {
+template <class word_t> static inline bool isLiteralZero(word_t word) {
   return getLiteralBits(word) == 0;
 }
 
+/**
+ * Writes a 32-bit value in little-endian order, whatever the host
+ */
+static inline void writeLittleEndian32(char *out, uint32_t value) {
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+  value = __builtin_bswap32(value);
+#endif
+  memcpy(out, &value, sizeof(value));
+}
+
+/**
+ * Reads a 32-bit value stored in little-endian order, whatever the host
+ */
+static inline uint32_t readLittleEndian32(const char *in) {
+  uint32_t value;
+  memcpy(&value, in, sizeof(value));
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+  value = __builtin_bswap32(value);
+#endif
+  return value;
+}
+
+/**
+ * Writes a 64-bit value in little-endian order, whatever the host
+ */
+static inline void writeLittleEndian64(char *out, uint64_t value) {
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+  value = __builtin_bswap64(value);
+#endif
+  memcpy(out, &value, sizeof(value));
+}
+
+/**
+ * Reads a 64-bit value stored in little-endian order, whatever the host
+ */
+static inline uint64_t readLittleEndian64(const char *in) {
+  uint64_t value;
+  memcpy(&value, in, sizeof(value));
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+  value = __builtin_bswap64(value);
+#endif
+  return value;
+}
+
+/**
+ * Writes or reads a word of either size in little-endian order
+ */
+static inline void writeLittleEndianWord(char *out, uint32_t value) {
+  writeLittleEndian32(out, value);
+}
+static inline void writeLittleEndianWord(char *out, uint64_t value) {
+  writeLittleEndian64(out, value);
+}
+static inline void readLittleEndianWord(const char *in, uint32_t &value) {
+  value = readLittleEndian32(in);
+}
+static inline void readLittleEndianWord(const char *in, uint64_t &value) {
+  value = readLittleEndian64(in);
+}
+
 #endif
@@ -3,6 +3,10 @@
 #include <set>
 
 #include "concise.h"
+#include "concisebatch.h"
+#include "conciseexpr.h"
+#include "conciseparallel.h"
+#include "concisepartitioned.h"
 
 template <bool wahmode> void checkflush() {
   std::cout << "[[[" << __PRETTY_FUNCTION__ << "]]]" << std::endl;
@@ -90,29 +94,30 @@ template <bool wahmode> void checkflush() {
   assert(c.size() == res.size());
 }
 
-template <bool wahmode> void heaportest() {
+template <bool wahmode, class word_t = uint32_t> void heaportest() {
   std::cout << "[[[" << __PRETTY_FUNCTION__ << "]]]" << std::endl;
-  ConciseSet<wahmode> *test[3];
-  ConciseSet<wahmode> test1;
+  ConciseSet<wahmode, word_t> *test[3];
+  ConciseSet<wahmode, word_t> test1;
   for (int k = 0; k < 100; k += 7)
     test1.add(k);
-  ConciseSet<wahmode> test2;
+  ConciseSet<wahmode, word_t> test2;
   for (int k = 0; k < 100; k += 15)
     test2.add(k);
-  ConciseSet<wahmode> test3;
+  ConciseSet<wahmode, word_t> test3;
   for (int k = 0; k < 100; k += 2)
     test3.add(k);
   test[0] = &test1;
   test[1] = &test2;
   test[2] = &test3;
-  ConciseSet<wahmode> answer = ConciseSet<wahmode>::fast_logicalor(
-      3, (const ConciseSet<wahmode> **)&test[0]);
+  ConciseSet<wahmode, word_t> answer =
+      ConciseSet<wahmode, word_t>::fast_logicalor(
+          3, (const ConciseSet<wahmode, word_t> **)&test[0]);
   assert(answer.size() == 60);
   size_t longcounter = 0;
   for (auto i = answer.begin(); i != answer.end(); ++i)
     longcounter++;
   assert(longcounter == 60);
-  ConciseSet<wahmode> tmp;
+  ConciseSet<wahmode, word_t> tmp;
   size_t expectedandsize1 = answer.logicalandCount(test1);
   tmp = answer.logicaland(test1);
   assert(expectedandsize1 == tmp.size());
@@ -127,9 +132,9 @@ template <bool wahmode> void heaportest() {
   assert(tmp.size() == test3.size());
 }
 
-template <bool wahmode> void basictest() {
+template <bool wahmode, class word_t = uint32_t> void basictest() {
   std::cout << "[[[" << __PRETTY_FUNCTION__ << "]]]" << std::endl;
-  ConciseSet<wahmode> test1;
+  ConciseSet<wahmode, word_t> test1;
   test1.add(1);
   assert(test1.contains(1));
   test1.add(2);
@@ -141,7 +146,7 @@ template <bool wahmode> void basictest() {
   test1.add(1000);
   assert(test1.contains(1000));
   assert(test1.size() == 5);
-  ConciseSet<wahmode> test2;
+  ConciseSet<wahmode, word_t> test2;
   test2.add(0);
   assert(test2.contains(0));
   test2.add(2);
@@ -153,7 +158,7 @@ template <bool wahmode> void basictest() {
   test2.add(3000);
   assert(test2.contains(3000));
   assert(test2.size() == 5);
-  ConciseSet<wahmode> tmp;
+  ConciseSet<wahmode, word_t> tmp;
   assert(test1.logicalorCount(test2) == 7);
   tmp = test1.logicalor(test2);
   assert(tmp.size() == 7);
@@ -165,10 +170,10 @@ template <bool wahmode> void basictest() {
   tmp.shrink_to_fit();
 }
 
-template <bool wahmode> void longtest() {
+template <bool wahmode, class word_t = uint32_t> void longtest() {
   std::cout << "[[[" << __PRETTY_FUNCTION__ << "]]]" << std::endl;
 
-  ConciseSet<wahmode> testc;
+  ConciseSet<wahmode, word_t> testc;
   for (int k = 0; k < 1000; ++k) {
     testc.add(k * 2);
     testc.add(k * 2 + 1);
@@ -178,7 +183,7 @@ template <bool wahmode> void longtest() {
     assert(testc.contains(k * 2));
     assert(testc.contains(k * 2 + 1));
   }
-  ConciseSet<wahmode> test1;
+  ConciseSet<wahmode, word_t> test1;
   for (int k = 0; k < 1000; ++k) {
     test1.add(k * 2);
   }
@@ -187,7 +192,7 @@ template <bool wahmode> void longtest() {
     assert(!test1.contains(k * 2 + 1));
   }
   assert(test1.size() == 1000);
-  ConciseSet<wahmode> shouldbetest1;
+  ConciseSet<wahmode, word_t> shouldbetest1;
   assert(testc.logicalandCount(test1) == 1000);
   shouldbetest1 = testc.logicaland(test1);
   assert(shouldbetest1.size() == 1000);
@@ -195,7 +200,7 @@ template <bool wahmode> void longtest() {
     assert(shouldbetest1.contains(k * 2));
     assert(!shouldbetest1.contains(k * 2 + 1));
   }
-  ConciseSet<wahmode> test2;
+  ConciseSet<wahmode, word_t> test2;
   for (int k = 0; k < 1000; ++k) {
     test2.add(k * 2 + 1);
   }
@@ -205,7 +210,7 @@ template <bool wahmode> void longtest() {
   }
   assert(test2.size() == 1000);
 
-  ConciseSet<wahmode> tmp;
+  ConciseSet<wahmode, word_t> tmp;
   assert(test1.logicalorCount(test2) == 2000);
   tmp = test1.logicalor(test2);
   assert(tmp.size() == 2000);
@@ -270,8 +275,8 @@ static std::set<uint32_t> intersect(std::set<uint32_t> s1,
   return answer;
 }
 
-template <bool wahmode>
-static bool equals(std::set<uint32_t> s, ConciseSet<wahmode> c) {
+template <bool wahmode, class word_t>
+static bool equals(std::set<uint32_t> s, ConciseSet<wahmode, word_t> c) {
   if (s.size() != c.size())
     return false;
   // we go one way
@@ -299,11 +304,11 @@ static bool equals(std::set<uint32_t> s, ConciseSet<wahmode> c) {
   return true;
 }
 
-template <bool wahmode> void toytest() {
+template <bool wahmode, class word_t = uint32_t> void toytest() {
 
   std::cout << "[[[" << __PRETTY_FUNCTION__ << "]]]" << std::endl;
 
-  ConciseSet<wahmode> test1;
+  ConciseSet<wahmode, word_t> test1;
   std::set<uint32_t> set1;
 
   for (int k = 0; k < 30; k += 3) {
@@ -311,7 +316,7 @@ template <bool wahmode> void toytest() {
     set1.insert(k);
   }
 
-  ConciseSet<wahmode> test2;
+  ConciseSet<wahmode, word_t> test2;
   std::set<uint32_t> set2;
   for (int k = 0; k < 30; k += 5) {
     test2.add(k);
@@ -321,36 +326,36 @@ template <bool wahmode> void toytest() {
   std::set<uint32_t> trueinter = intersect(set1, set2);
   std::set<uint32_t> truesubtract = subtract(set1, set2);
   std::set<uint32_t> truesymsubtract = symmetrically_subtract(set1, set2);
-  ConciseSet<wahmode> union1;
-  ConciseSet<wahmode> union2;
+  ConciseSet<wahmode, word_t> union1;
+  ConciseSet<wahmode, word_t> union2;
   size_t expunion1 = test1.logicalorCount(test2);
   union1 = test1.logicalor(test2);
   assert(union1.size() == expunion1);
   union2 = test1.logicalor(test2);
   assert(equals(trueunion, union1));
   assert(equals(trueunion, union2));
-  ConciseSet<wahmode> intersect1;
-  ConciseSet<wahmode> intersect2;
+  ConciseSet<wahmode, word_t> intersect1;
+  ConciseSet<wahmode, word_t> intersect2;
   size_t expinter1 = test1.logicalandCount(test2);
   intersect1 = test1.logicaland(test2);
   assert(expinter1 == intersect1.size());
   intersect2 = test1.logicaland(test2);
   assert(equals(trueinter, intersect1));
   assert(equals(trueinter, intersect2));
-  ConciseSet<wahmode> symsubtract1;
-  ConciseSet<wahmode> symsubtract2;
+  ConciseSet<wahmode, word_t> symsubtract1;
+  ConciseSet<wahmode, word_t> symsubtract2;
   symsubtract1 = test1.logicalxor(test2);
   symsubtract2 = test1.logicalxor(test2);
   assert(equals(truesymsubtract, symsubtract1));
   assert(equals(truesymsubtract, symsubtract2));
-  ConciseSet<wahmode> subtract1;
-  ConciseSet<wahmode> subtract2;
+  ConciseSet<wahmode, word_t> subtract1;
+  ConciseSet<wahmode, word_t> subtract2;
   subtract1 = test1.logicalandnot(test2);
   subtract2 = test1.logicalandnot(test2);
   assert(equals(truesubtract, subtract1));
   assert(equals(truesubtract, subtract2));
 }
-template <bool wahmode> void iteratortest() {
+template <bool wahmode, class word_t = uint32_t> void iteratortest() {
   std::cout << "[[[" << __PRETTY_FUNCTION__ << "]]]" << std::endl;
 
   uint32_t data[] = {3515,   5185,   7796,   33347,  45641,  51779,  53188,
@@ -358,7 +363,7 @@ template <bool wahmode> void iteratortest() {
                      111016, 116633, 117789, 119044, 119103, 146771, 159597,
                      163210, 181124, 182343, 187302, 187876, 191494};
   const int N = sizeof(data) / sizeof(uint32_t);
-  ConciseSet<wahmode> test1;
+  ConciseSet<wahmode, word_t> test1;
   for (int k = 0; k < N; ++k) {
     test1.add(data[k]);
   }
@@ -372,11 +377,11 @@ template <bool wahmode> void iteratortest() {
   assert(c == N);
 }
 
-template <bool wahmode> void variedtest() {
+template <bool wahmode, class word_t = uint32_t> void variedtest() {
 
   std::cout << "[[[" << __PRETTY_FUNCTION__ << "]]]" << std::endl;
 
-  ConciseSet<wahmode> test1;
+  ConciseSet<wahmode, word_t> test1;
   std::set<uint32_t> set1;
 
   for (int k = 0; k < 1000; ++k) {
@@ -396,7 +401,7 @@ template <bool wahmode> void variedtest() {
     set1.insert(k);
   }
 
-  ConciseSet<wahmode> test2;
+  ConciseSet<wahmode, word_t> test2;
   std::set<uint32_t> set2;
   for (int k = 0; k < 1100; k += 3) {
     test2.add(k);
@@ -419,37 +424,37 @@ template <bool wahmode> void variedtest() {
   std::set<uint32_t> truesubtract = subtract(set1, set2);
   std::set<uint32_t> truesymsubtract = symmetrically_subtract(set1, set2);
 
-  ConciseSet<wahmode> union1;
-  ConciseSet<wahmode> union2;
+  ConciseSet<wahmode, word_t> union1;
+  ConciseSet<wahmode, word_t> union2;
   size_t expunion1 = test1.logicalorCount(test2);
   union1 = test1.logicalor(test2);
   assert(union1.size() == expunion1);
   union2 = test1.logicalor(test2);
   assert(equals(trueunion, union1));
   assert(equals(trueunion, union2));
-  ConciseSet<wahmode> intersect1;
-  ConciseSet<wahmode> intersect2;
+  ConciseSet<wahmode, word_t> intersect1;
+  ConciseSet<wahmode, word_t> intersect2;
   size_t expinter1 = test1.logicalandCount(test2);
   intersect1 = test1.logicaland(test2);
   assert(expinter1 == intersect1.size());
   intersect2 = test1.logicaland(test2);
   assert(equals(trueinter, intersect1));
   assert(equals(trueinter, intersect2));
-  ConciseSet<wahmode> symsubtract1;
-  ConciseSet<wahmode> symsubtract2;
+  ConciseSet<wahmode, word_t> symsubtract1;
+  ConciseSet<wahmode, word_t> symsubtract2;
   symsubtract1 = test1.logicalxor(test2);
   symsubtract2 = test1.logicalxor(test2);
   assert(equals(truesymsubtract, symsubtract1));
   assert(equals(truesymsubtract, symsubtract2));
-  ConciseSet<wahmode> subtract1;
-  ConciseSet<wahmode> subtract2;
+  ConciseSet<wahmode, word_t> subtract1;
+  ConciseSet<wahmode, word_t> subtract2;
   subtract1 = test1.logicalandnot(test2);
   subtract2 = test1.logicalandnot(test2);
   assert(equals(truesubtract, subtract1));
   assert(equals(truesubtract, subtract2));
 }
 
-template <bool wahmode> void realtest() {
+template <bool wahmode, class word_t = uint32_t> void realtest() {
 
   std::cout << "[[[" << __PRETTY_FUNCTION__ << "]]]" << std::endl;
 
@@ -552,7 +557,7 @@ template <bool wahmode> void realtest() {
       622, 623, 625, 626, 628, 629, 630, 631, 632, 634, 635, 636};
   const int N2 = sizeof(data2) / sizeof(uint32_t);
 
-  ConciseSet<wahmode> test1;
+  ConciseSet<wahmode, word_t> test1;
   std::set<uint32_t> set1;
 
   for (int k = 0; k < N1; ++k) {
@@ -560,7 +565,7 @@ template <bool wahmode> void realtest() {
     set1.insert(data1[k]);
   }
 
-  ConciseSet<wahmode> test2;
+  ConciseSet<wahmode, word_t> test2;
   std::set<uint32_t> set2;
   for (int k = 0; k < N2; ++k) {
     test2.add(data2[k]);
@@ -578,8 +583,8 @@ template <bool wahmode> void realtest() {
   std::set<uint32_t> truesubtract = subtract(set1, set2);
   std::set<uint32_t> truesymsubtract = symmetrically_subtract(set1, set2);
 
-  ConciseSet<wahmode> union1;
-  ConciseSet<wahmode> union2;
+  ConciseSet<wahmode, word_t> union1;
+  ConciseSet<wahmode, word_t> union2;
 
   size_t expunion1 = test1.logicalorCount(test2);
   union1 = test1.logicalor(test2);
@@ -587,28 +592,1487 @@ template <bool wahmode> void realtest() {
   union2 = test1.logicalor(test2);
   assert(equals(trueunion, union1));
   assert(equals(trueunion, union2));
-  ConciseSet<wahmode> intersect1;
-  ConciseSet<wahmode> intersect2;
+  ConciseSet<wahmode, word_t> intersect1;
+  ConciseSet<wahmode, word_t> intersect2;
   size_t expinter1 = test1.logicalandCount(test2);
   intersect1 = test1.logicaland(test2);
   assert(expinter1 == intersect1.size());
   intersect2 = test1.logicaland(test2);
   assert(equals(trueinter, intersect1));
   assert(equals(trueinter, intersect2));
-  ConciseSet<wahmode> symsubtract1;
-  ConciseSet<wahmode> symsubtract2;
+  ConciseSet<wahmode, word_t> symsubtract1;
+  ConciseSet<wahmode, word_t> symsubtract2;
   symsubtract1 = test1.logicalxor(test2);
   symsubtract2 = test1.logicalxor(test2);
   assert(equals(truesymsubtract, symsubtract1));
   assert(equals(truesymsubtract, symsubtract2));
-  ConciseSet<wahmode> subtract1;
-  ConciseSet<wahmode> subtract2;
+  ConciseSet<wahmode, word_t> subtract1;
+  ConciseSet<wahmode, word_t> subtract2;
   subtract1 = test1.logicalandnot(test2);
   subtract2 = test1.logicalandnot(test2);
   assert(equals(truesubtract, subtract1));
   assert(equals(truesubtract, subtract2));
 }
 
+/**
+ * Whether the skip index of c holds one exact entry every
+ * SKIP_INDEX_INTERVAL words, up to its last word
+ */
+template <bool wahmode, class word_t>
+static bool currentSkipIndex(const ConciseSet<wahmode, word_t> &c) {
+  typedef ConciseSet<wahmode, word_t> set_t;
+  uint32_t block = 0, rank = 0;
+  size_t entry = 0;
+  for (int32_t i = 0; i <= c.lastWordIndex; ++i) {
+    if (i % SKIP_INDEX_INTERVAL == 0 &&
+        c.lastWordIndex >= (int32_t)SKIP_INDEX_INTERVAL) {
+      if (entry >= c.skipIndex.size())
+        return false;
+      const typename set_t::SkipEntry &e = c.skipIndex[entry++];
+      if (e.wordIndex != i || e.block != block || e.rank != rank)
+        return false;
+    }
+    block += set_t::getBlockCount(c.words[i]);
+    rank += set_t::getWordCardinality(c.words[i]);
+  }
+  return entry == c.skipIndex.size();
+}
+
+template <bool wahmode, class word_t = uint32_t> void skipindextest() {
+  std::cout << "[[[" << __PRETTY_FUNCTION__ << "]]]" << std::endl;
+  ConciseSet<wahmode, word_t> test1;
+  std::set<uint32_t> set1;
+  uint32_t x = 0;
+  uint32_t seed = 1234;
+  for (int k = 0; k < 5000; ++k) {
+    seed = seed * 1103515245 + 12345;
+    // alternate sparse gaps (fills) with dense runs (full literals)
+    x += ((k / 100) % 2 == 0) ? 1 + (seed >> 16) % 200 : 1;
+    test1.add(x);
+    set1.insert(x);
+    if (k % 500 == 0) {
+      // the index grows with the set
+      for (uint32_t y = 0; y <= x + 40; ++y)
+        assert(test1.contains(y) == (set1.find(y) != set1.end()));
+    }
+  }
+  assert(test1.lastWordIndex > 4 * (int32_t)SKIP_INDEX_INTERVAL);
+  for (uint32_t y = 0; y <= x + 40; ++y) {
+    const bool expected = set1.find(y) != set1.end();
+    assert(test1.contains(y) == expected);
+    assert(test1.containsFromWord(y, 0, 0) == expected);
+  }
+  // out-of-order insertions go through the index as well
+  for (uint32_t y = 3; y < x; y += 97) {
+    test1.add(y);
+    set1.insert(y);
+  }
+  assert(equals(set1, test1));
+  assert(currentSkipIndex(test1));
+  for (uint32_t y = 5; y < x; y += 89)
+    test1.remove(y);
+  assert(currentSkipIndex(test1));
+  // binary operations copy the long tail of test1 as-is
+  ConciseSet<wahmode, word_t> head;
+  head.add(3);
+  assert(currentSkipIndex(head | test1));
+  assert(currentSkipIndex(head ^ test1));
+  assert(currentSkipIndex(test1 - head));
+  assert((head | test1).skipIndex.size() == test1.skipIndex.size());
+  // const queries only read the index, so threads may share the set
+  const ConciseSet<wahmode, word_t> &shared = test1;
+  std::vector<size_t> found(4, 0);
+  parallelFor(4, 4, [&](size_t t) {
+    for (uint32_t y = (uint32_t)t; y <= x; y += 4)
+      found[t] += shared.contains(y) + shared.rank(y);
+  });
+  size_t expected = 0;
+  for (uint32_t y = 0; y <= x; ++y)
+    expected += shared.contains(y) + shared.rank(y);
+  assert(found[0] + found[1] + found[2] + found[3] == expected);
+}
+
+template <bool wahmode, class word_t>
+static uint32_t recount(const ConciseSet<wahmode, word_t> &c) {
+  uint32_t answer = 0;
+  for (int32_t i = 0; i <= c.lastWordIndex; ++i)
+    answer += ConciseSet<wahmode, word_t>::getWordCardinality(c.words[i]);
+  return answer;
+}
+
+template <bool wahmode, class word_t = uint32_t> void cardinalitytest() {
+  std::cout << "[[[" << __PRETTY_FUNCTION__ << "]]]" << std::endl;
+  ConciseSet<wahmode, word_t> test1;
+  ConciseSet<wahmode, word_t> test2;
+  assert(test1.size() == 0);
+  for (int k = 0; k < 3000; ++k) {
+    // runs of 31 consecutive values turn literals into 1's sequences
+    if ((k / 200) % 2 == 0)
+      test1.add(k);
+    else if (k % 7 == 0)
+      test1.add(k);
+    if (k % 3 == 0 || (k > 1000 && k < 1500))
+      test2.add(k);
+    assert(test1.size() == recount(test1));
+  }
+  // out-of-order additions, both in place and through logicalor
+  for (int k = 1; k < 3000; k += 11)
+    test1.add(k);
+  assert(test1.cardinality >= 0);
+  assert(test1.size() == recount(test1));
+  ConciseSet<wahmode, word_t> res;
+  test1.logicalorToContainer(test2, res);
+  assert(res.cardinality >= 0 && res.size() == recount(res));
+  assert(res.size() == test1.logicalorCount(test2));
+  // containers are reused without being cleared first
+  test1.logicalandToContainer(test2, res);
+  assert(res.cardinality >= 0 && res.size() == recount(res));
+  assert(res.size() == test1.logicalandCount(test2));
+  test1.logicalxorToContainer(test2, res);
+  assert(res.cardinality >= 0 && res.size() == recount(res));
+  assert(res.size() == test1.logicalxorCount(test2));
+  test1.logicalandnotToContainer(test2, res);
+  assert(res.cardinality >= 0 && res.size() == recount(res));
+  assert(res.size() == test1.logicalandnotCount(test2));
+  test2.logicalandnotToContainer(test1, res);
+  assert(res.size() == recount(res));
+  assert(res.size() == test2.logicalandnotCount(test1));
+  ConciseSet<wahmode, word_t> empty;
+  assert(test1.logicalorCount(empty) == test1.size());
+  assert(empty.logicalxorCount(test2) == test2.size());
+  assert(test1.logicalandnotCount(empty) == test1.size());
+}
+
+template <bool wahmode, class word_t = uint32_t> void rankselecttest() {
+  std::cout << "[[[" << __PRETTY_FUNCTION__ << "]]]" << std::endl;
+  ConciseSet<wahmode, word_t> test1;
+  uint32_t seed = 99;
+  for (uint32_t x = 0; x < 200000; ++x) {
+    seed = seed * 1103515245 + 12345;
+    // dense runs, 1's sequences with a missing bit and sparse stretches
+    const uint32_t mode = (x / 1000) % 4;
+    if ((mode == 0 && (seed >> 16) % 3 != 0) || (mode == 1 && x % 97 != 5) ||
+        (mode == 2 && (seed >> 16) % 211 == 0))
+      test1.add(x);
+  }
+  // in-place additions also update the rank directory
+  for (uint32_t x = 3; x < 200000; x += 4001)
+    test1.add(x);
+  assert(test1.lastWordIndex > 4 * (int32_t)SKIP_INDEX_INTERVAL);
+  std::vector<uint32_t> values;
+  for (auto i = test1.begin(); i != test1.end(); ++i)
+    values.push_back(*i);
+  assert(values.size() == test1.size());
+  for (uint32_t k = 0; k < values.size(); ++k)
+    assert(test1.select(k) == values[k]);
+  uint32_t expected = 0;
+  for (uint32_t x = 0; x <= (uint32_t)test1.last + 2; ++x) {
+    assert(test1.rank(x) == expected);
+    if (expected < values.size() && values[expected] == x)
+      expected++;
+  }
+  assert(test1.rank(MAX_ALLOWED_INTEGER) == test1.size());
+  bool thrown = false;
+  try {
+    test1.select(test1.size());
+  } catch (std::runtime_error &) {
+    thrown = true;
+  }
+  assert(thrown);
+  ConciseSet<wahmode, word_t> empty;
+  assert(empty.rank(10) == 0);
+}
+
+template <bool wahmode, class word_t = uint32_t> void serializationtest() {
+  std::cout << "[[[" << __PRETTY_FUNCTION__ << "]]]" << std::endl;
+  ConciseSet<wahmode, word_t> test1;
+  ConciseSet<wahmode, word_t> test2;
+  for (int k = 0; k < 10000; k += 3)
+    test1.add(k);
+  for (int k = 5000; k < 20000; k += (k < 8000 ? 1 : 101))
+    test2.add(k);
+  // words are aligned, as they would be in a memory-mapped file
+  std::vector<word_t> buffer1(test1.serializedSizeInBytes() / sizeof(word_t));
+  std::vector<word_t> buffer2(test2.serializedSizeInBytes() / sizeof(word_t));
+  assert(test1.serialize((char *)buffer1.data()) ==
+         test1.serializedSizeInBytes());
+  test2.serialize((char *)buffer2.data());
+
+  ConciseSet<wahmode, word_t> copy1 = ConciseSet<wahmode, word_t>::deserialize(
+      (const char *)buffer1.data(), test1.serializedSizeInBytes());
+  assert(copy1.equals(test1));
+  assert(copy1.size() == test1.size() && copy1.last == test1.last);
+
+  ConciseView<wahmode, word_t> view1 = ConciseView<wahmode, word_t>::fromBuffer(
+      (const uint32_t *)buffer1.data(), test1.serializedSizeInBytes());
+  ConciseView<wahmode, word_t> view2 = ConciseView<wahmode, word_t>::fromBuffer(
+      (const uint32_t *)buffer2.data(), test2.serializedSizeInBytes());
+  assert((const char *)view1.words ==
+         (const char *)buffer1.data() +
+             CONCISE_SERIAL_HEADER_WORDS * sizeof(uint32_t));
+  assert(view1.size() == test1.size());
+  for (uint32_t x = 0; x < 21000; ++x)
+    assert(view2.contains(x) == test2.contains(x));
+  auto j = test2.begin();
+  for (auto i = view2.begin(); i != view2.end(); ++i, ++j)
+    assert(*i == *j);
+  assert(view1.logicaland(view2).equals(test1.logicaland(test2)));
+  assert(view1.logicalor(test2).equals(test1.logicalor(test2)));
+  assert(test1.logicalxor(view2).equals(test1.logicalxor(test2)));
+  assert((view1 - view2).equals(test1.logicalandnot(test2)));
+  assert((view2 - view1).equals(test2.logicalandnot(test1)));
+  assert(view1.logicalandCount(view2) == test1.logicalandCount(test2));
+  assert(view1.logicalorCount(view2) == test1.logicalorCount(test2));
+  assert(view1.logicalxorCount(view2) == test1.logicalxorCount(test2));
+  assert(view1.logicalandnotCount(view2) == test1.logicalandnotCount(test2));
+  assert(view1.intersects(view2));
+  assert(view1.equals(test1) && !view1.equals(view2));
+
+  ConciseSet<wahmode, word_t> empty;
+  std::vector<word_t> emptybuffer(empty.serializedSizeInBytes() /
+                                  sizeof(word_t));
+  empty.serialize((char *)emptybuffer.data());
+  ConciseView<wahmode, word_t> emptyview =
+      ConciseView<wahmode, word_t>::fromBuffer(
+          (const uint32_t *)emptybuffer.data(), empty.serializedSizeInBytes());
+  assert(emptyview.isEmpty() && emptyview.size() == 0);
+  assert(view1.logicalor(emptyview).equals(test1));
+
+  // malformed input is rejected
+  size_t failures = 0;
+  try {
+    ConciseView<!wahmode, word_t>::fromBuffer((const uint32_t *)buffer1.data(),
+                                              test1.serializedSizeInBytes());
+  } catch (std::runtime_error &) {
+    failures++;
+  }
+  typedef typename std::conditional<sizeof(word_t) == 8, uint32_t,
+                                    uint64_t>::type other_word_t;
+  try {
+    ConciseSet<wahmode, other_word_t>::deserialize(
+        (const char *)buffer1.data(), test1.serializedSizeInBytes());
+  } catch (std::runtime_error &) {
+    failures++;
+  }
+  try {
+    ConciseSet<wahmode, word_t>::deserialize((const char *)buffer1.data(),
+                                     test1.serializedSizeInBytes() - 4);
+  } catch (std::runtime_error &) {
+    failures++;
+  }
+  buffer1[0] = 0;
+  try {
+    ConciseView<wahmode, word_t>::fromBuffer((const uint32_t *)buffer1.data(),
+                                             test1.serializedSizeInBytes());
+  } catch (std::runtime_error &) {
+    failures++;
+  }
+  assert(failures == 4);
+}
+
+template <bool wahmode, class word_t>
+static bool sameWords(const ConciseSet<wahmode, word_t> &a,
+                      const ConciseSet<wahmode, word_t> &b) {
+  if (a.lastWordIndex != b.lastWordIndex || a.last != b.last)
+    return false;
+  for (int32_t i = 0; i <= a.lastWordIndex; ++i)
+    if (a.words[i] != b.words[i])
+      return false;
+  return true;
+}
+
+template <bool wahmode, class word_t = uint32_t> void fromsortedtest() {
+  std::cout << "[[[" << __PRETTY_FUNCTION__ << "]]]" << std::endl;
+  std::vector<uint32_t> values;
+  uint32_t seed = 7;
+  uint32_t x = 40;
+  for (int k = 0; k < 20000; ++k) {
+    seed = seed * 1103515245 + 12345;
+    const uint32_t mode = (k / 500) % 4;
+    if (mode == 0)
+      x += 1; // 1's sequences
+    else if (mode == 1)
+      x += (seed >> 16) % 3; // dense literals, with duplicates
+    else if (mode == 2)
+      x += (k % 31 == 0) ? 5000 : 1 + (seed >> 16) % 40; // fills
+    else
+      x += (k % 31 == 7) ? 0 : 1; // 1's sequences with flipped bits
+    values.push_back(x);
+  }
+  ConciseSet<wahmode, word_t> expected;
+  for (uint32_t v : values)
+    expected.add(v);
+  ConciseSet<wahmode, word_t> test1 =
+      ConciseSet<wahmode, word_t>::fromSorted(values.data(),
+                                              values.data() + values.size());
+  assert(sameWords(test1, expected));
+  assert(test1.size() == expected.size() && test1.size() == recount(test1));
+
+  // appending in batches, starting in the middle of literals
+  ConciseSet<wahmode, word_t> test2;
+  size_t start = 0;
+  while (start < values.size()) {
+    size_t stop = std::min(values.size(), start + 777);
+    while (stop < values.size() && values[stop] == values[stop - 1])
+      stop++; // batches must go past last
+    test2.addMany(values.data() + start, values.data() + stop);
+    start = stop;
+  }
+  assert(sameWords(test2, expected));
+  assert(test2.size() == expected.size());
+
+  // batches below last are merged
+  std::vector<uint32_t> older = {1, 2, 3, 100, 1000, 5000};
+  test2.addMany(older.data(), older.data() + older.size());
+  for (uint32_t v : older)
+    expected.add(v);
+  assert(test2.equals(expected) && test2.size() == expected.size());
+
+  std::vector<uint32_t> unsorted = {1, 5, 3};
+  bool thrown = false;
+  try {
+    ConciseSet<wahmode, word_t>::fromSorted(unsorted.data(),
+                                    unsorted.data() + unsorted.size());
+  } catch (std::runtime_error &) {
+    thrown = true;
+  }
+  assert(thrown);
+  ConciseSet<wahmode, word_t> empty =
+      ConciseSet<wahmode, word_t>::fromSorted(unsorted.data(), unsorted.data());
+  assert(empty.isEmpty());
+}
+
+template <bool wahmode, class word_t = uint32_t> void outofordertest() {
+  std::cout << "[[[" << __PRETTY_FUNCTION__ << "]]]" << std::endl;
+  ConciseSet<wahmode, word_t> test1;
+  std::set<uint32_t> set1;
+  uint32_t seed = 31337;
+  // sparse and dense regions, with 1's sequences to be completed
+  for (uint32_t x = 0; x < 60000; ++x) {
+    seed = seed * 1103515245 + 12345;
+    const uint32_t mode = (x / 3000) % 3;
+    if ((mode == 0 && (seed >> 16) % 500 == 0) ||
+        (mode == 1 && (seed >> 16) % 40 != 0) || (mode == 2 && x % 62 == 0)) {
+      test1.add(x);
+      set1.insert(x);
+    }
+  }
+  for (int k = 0; k < 6000; ++k) {
+    seed = seed * 1103515245 + 12345;
+    const uint32_t x = (seed >> 8) % 60000;
+    test1.add(x);
+    set1.insert(x);
+    if (k % 1000 == 0)
+      assert(test1.contains(x) && test1.rank(x + 1) == test1.rank(x) + 1);
+  }
+  assert(equals(set1, test1));
+  assert(test1.size() == recount(test1));
+  // the encoding is the one we would get by appending the values in order
+  std::vector<uint32_t> sorted(set1.begin(), set1.end());
+  ConciseSet<wahmode, word_t> expected =
+      ConciseSet<wahmode, word_t>::fromSorted(sorted.data(),
+                                              sorted.data() + sorted.size());
+  assert(sameWords(test1, expected));
+
+  // batches of unsorted values
+  ConciseSet<wahmode, word_t> test2;
+  std::set<uint32_t> set2;
+  std::vector<uint32_t> batch;
+  for (int round = 0; round < 5; ++round) {
+    batch.clear();
+    for (int k = 0; k < 3000; ++k) {
+      seed = seed * 1103515245 + 12345;
+      batch.push_back((seed >> 8) % (20000 * (round + 1)));
+    }
+    test2.addUnsorted(batch.data(), batch.data() + batch.size());
+    set2.insert(batch.begin(), batch.end());
+  }
+  assert(equals(set2, test2));
+  assert(test2.size() == recount(test2));
+}
+
+// sparse sets, dense runs (one fills), isolated bits (flipped sequences)
+// and empty sets
+template <bool wahmode, class word_t>
+static std::vector<ConciseSet<wahmode, word_t>> multiwayInputs() {
+  std::vector<ConciseSet<wahmode, word_t>> sets(150);
+  uint32_t seed = 12345;
+  for (size_t i = 0; i < sets.size(); ++i) {
+    seed = seed * 1103515245 + 12345;
+    const uint32_t offset = (seed >> 8) % 5000;
+    switch (i % 5) {
+    case 0:
+      for (uint32_t x = offset; x < offset + 100000; x += 1 + (seed >> 20) % 97)
+        sets[i].add(x);
+      break;
+    case 1:
+      for (uint32_t x = offset; x < offset + 3000; ++x)
+        sets[i].add(x);
+      break;
+    case 2:
+      for (uint32_t x = offset; x < 200000; x += 2000 + i)
+        sets[i].add(x);
+      break;
+    case 3:
+      for (uint32_t x = offset; x < 60000; x += 40) {
+        for (uint32_t y = x; y < x + 20; ++y)
+          sets[i].add(y);
+      }
+      break;
+    default:
+      break;
+    }
+  }
+  return sets;
+}
+
+template <bool wahmode, class word_t = uint32_t> void multiwaytest() {
+  std::cout << "[[[" << __PRETTY_FUNCTION__ << "]]]" << std::endl;
+  std::vector<ConciseSet<wahmode, word_t>> sets =
+      multiwayInputs<wahmode, word_t>();
+  const ConciseSet<wahmode, word_t> *inputs[150];
+  for (size_t i = 0; i < sets.size(); ++i)
+    inputs[i] = &sets[i];
+  const size_t counts[] = {0, 1, 2, 3, 5, 17, 64, 150};
+  for (size_t n : counts) {
+    ConciseSet<wahmode, word_t> expected;
+    for (size_t i = 0; i < n; ++i)
+      expected = expected.logicalor(sets[i]);
+    ConciseSet<wahmode, word_t> multiway =
+        ConciseSet<wahmode, word_t>::multiway_logicalor(n, inputs);
+    ConciseSet<wahmode, word_t> pairwise =
+        ConciseSet<wahmode, word_t>::pairwise_logicalor(n, inputs);
+    ConciseSet<wahmode, word_t> fast =
+        ConciseSet<wahmode, word_t>::fast_logicalor(n, inputs);
+    assert(sameWords(multiway, expected));
+    assert(sameWords(pairwise, expected));
+    assert(sameWords(fast, expected));
+    assert(multiway.size() == expected.size());
+    assert(multiway.size() == recount(multiway));
+    // the output may be one of the inputs
+    if (n > 0) {
+      ConciseSet<wahmode, word_t> first = sets[0];
+      inputs[0] = &first;
+      ConciseSet<wahmode, word_t>::multiway_logicalorToContainer(n, inputs,
+                                                                 first);
+      assert(sameWords(first, expected));
+      inputs[0] = &sets[0];
+    }
+  }
+}
+
+template <bool wahmode, class word_t = uint32_t> void multiwayopstest() {
+  std::cout << "[[[" << __PRETTY_FUNCTION__ << "]]]" << std::endl;
+  typedef ConciseSet<wahmode, word_t> concise_set;
+  std::vector<ConciseSet<wahmode, word_t>> sets =
+      multiwayInputs<wahmode, word_t>();
+  // AND needs overlapping inputs: leave out the empty ones and add a set
+  // that covers everything
+  std::vector<ConciseSet<wahmode, word_t>> nonempty;
+  ConciseSet<wahmode, word_t> full;
+  for (uint32_t x = 0; x < 300000; ++x)
+    full.add(x);
+  nonempty.push_back(full);
+  for (size_t i = 0; i < sets.size(); ++i)
+    if (i % 5 != 4 && i % 5 != 2)
+      nonempty.push_back(sets[i]);
+  const size_t counts[] = {1, 2, 3, 4, 7, 20, 60};
+  for (size_t n : counts) {
+    const ConciseSet<wahmode, word_t> *inputs[60];
+    const ConciseSet<wahmode, word_t> *overlapping[60];
+    for (size_t i = 0; i < n; ++i) {
+      inputs[i] = &sets[i];
+      overlapping[i] = &nonempty[i];
+    }
+    ConciseSet<wahmode, word_t> expectedand = nonempty[0];
+    ConciseSet<wahmode, word_t> expectedxor = sets[0];
+    ConciseSet<wahmode, word_t> expectedandnot = sets[0];
+    ConciseSet<wahmode, word_t> expectedunion;
+    for (size_t i = 1; i < n; ++i) {
+      expectedand = expectedand.logicaland(nonempty[i]);
+      expectedxor = expectedxor.logicalxor(sets[i]);
+      expectedunion = expectedunion.logicalor(sets[i]);
+    }
+    expectedandnot = expectedandnot.logicalandnot(expectedunion);
+    ConciseSet<wahmode, word_t> answer =
+        concise_set::fast_logicaland(n, overlapping);
+    assert(sameWords(answer, expectedand));
+    assert(answer.size() == recount(answer));
+    assert(concise_set::fast_logicalandCount(n, overlapping) ==
+           expectedand.size());
+    answer = concise_set::fast_logicalxor(n, inputs);
+    assert(sameWords(answer, expectedxor));
+    assert(answer.size() == recount(answer));
+    assert(concise_set::fast_logicalxorCount(n, inputs) ==
+           expectedxor.size());
+    answer = concise_set::fast_logicalandnot(n, inputs);
+    assert(sameWords(answer, expectedandnot));
+    assert(answer.size() == recount(answer));
+    assert(concise_set::fast_logicalandnotCount(n, inputs) ==
+           expectedandnot.size());
+    // the first input minus the others, where the first input is dense
+    answer = concise_set::fast_logicalandnot(n, overlapping);
+    ConciseSet<wahmode, word_t> expected = nonempty[0];
+    for (size_t i = 1; i < n; ++i)
+      expected = expected.logicalandnot(nonempty[i]);
+    assert(sameWords(answer, expected));
+    assert(concise_set::fast_logicalandnotCount(n, overlapping) ==
+           expected.size());
+    assert(concise_set::fast_logicalorCount(n, inputs) ==
+           concise_set::fast_logicalor(n, inputs).size());
+    // the output may be one of the inputs
+    ConciseSet<wahmode, word_t> first = nonempty[0];
+    overlapping[0] = &first;
+    concise_set::fast_logicalandToContainer(n, overlapping, first);
+    assert(sameWords(first, expectedand));
+  }
+  // an empty input makes the intersection empty
+  const ConciseSet<wahmode, word_t> *withempty[3] = {&nonempty[0], &sets[4],
+                                                     &nonempty[1]};
+  assert(concise_set::fast_logicaland(3, withempty).isEmpty());
+  assert(concise_set::fast_logicalandCount(3, withempty) == 0);
+}
+
+template <bool wahmode, class word_t = uint32_t> void paralleltest() {
+  std::cout << "[[[" << __PRETTY_FUNCTION__ << "]]]" << std::endl;
+  std::vector<ConciseSet<wahmode, word_t>> sets =
+      multiwayInputs<wahmode, word_t>();
+  const ConciseSet<wahmode, word_t> *inputs[150];
+  for (size_t i = 0; i < sets.size(); ++i)
+    inputs[i] = &sets[i];
+  const size_t counts[] = {0, 1, 10, 64, 100, 150};
+  const size_t threads[] = {0, 1, 2, 3, 8, 64};
+  for (size_t n : counts) {
+    ConciseSet<wahmode, word_t> expected =
+        ConciseSet<wahmode, word_t>::fast_logicalor(n, inputs);
+    for (size_t t : threads) {
+      ConciseSet<wahmode, word_t> answer = parallel_logicalor(n, inputs, t);
+      assert(sameWords(answer, expected));
+      assert(answer.size() == expected.size());
+    }
+  }
+  // the same sets repeated many times, read by several threads at once
+  const ConciseSet<wahmode, word_t> *repeated[128];
+  for (size_t i = 0; i < 128; ++i)
+    repeated[i] = inputs[i % 4];
+  const ConciseSet<wahmode, word_t> distinct =
+      ConciseSet<wahmode, word_t>::fast_logicalor(4, inputs);
+  assert(sameWords(parallel_logicalor(128, repeated, 4), distinct));
+  // every task runs exactly once
+  std::vector<std::atomic<int>> runs(1000);
+  for (auto &r : runs)
+    r = 0;
+  parallelFor(runs.size(), 4, [&](size_t t) { runs[t]++; });
+  for (auto &r : runs)
+    assert(r == 1);
+}
+
+template <bool wahmode, class word_t = uint32_t> void partitionedtest() {
+  std::cout << "[[[" << __PRETTY_FUNCTION__ << "]]]" << std::endl;
+  // large enough to go through the threads, spread over the whole 32-bit
+  // range, with dense runs
+  PartitionedConciseSet<wahmode, word_t> a(20), b(20);
+  std::set<uint32_t> sa, sb;
+  uint32_t seed = 7;
+  for (int k = 0; k < 150000; ++k) {
+    seed = seed * 1103515245 + 12345;
+    const uint32_t x = seed ^ (seed >> 7);
+    a.add(x);
+    sa.insert(x);
+    seed = seed * 1103515245 + 12345;
+    const uint32_t y = (seed % 4 == 0) ? x : (seed >> 2) % 50000000;
+    b.add(y);
+    sb.insert(y);
+  }
+  for (uint32_t x = 4000000000u; x < 4000100000u; ++x) {
+    a.add(x);
+    sa.insert(x);
+    if (x % 3 == 0) {
+      b.add(x);
+      sb.insert(x);
+    }
+  }
+  assert(a.size() == sa.size() && b.size() == sb.size());
+  std::vector<uint32_t> values(a.begin(), a.end());
+  assert(values == std::vector<uint32_t>(sa.begin(), sa.end()));
+  for (uint32_t x : sa)
+    assert(a.contains(x));
+  assert(!a.contains(4000100000u) && !a.contains(3999999999u));
+  const size_t threads[] = {1, 4};
+  for (size_t t : threads) {
+    std::vector<uint32_t> expected;
+    std::set_intersection(sa.begin(), sa.end(), sb.begin(), sb.end(),
+                          std::back_inserter(expected));
+    PartitionedConciseSet<wahmode, word_t> res = a.logicaland(b, t);
+    assert(std::vector<uint32_t>(res.begin(), res.end()) == expected);
+    assert(a.logicalandCount(b, t) == expected.size());
+    expected.clear();
+    std::set_union(sa.begin(), sa.end(), sb.begin(), sb.end(),
+                   std::back_inserter(expected));
+    res = a.logicalor(b, t);
+    assert(std::vector<uint32_t>(res.begin(), res.end()) == expected);
+    assert(a.logicalorCount(b, t) == expected.size());
+    expected.clear();
+    std::set_symmetric_difference(sa.begin(), sa.end(), sb.begin(), sb.end(),
+                                  std::back_inserter(expected));
+    res = a.logicalxor(b, t);
+    assert(std::vector<uint32_t>(res.begin(), res.end()) == expected);
+    assert(a.logicalxorCount(b, t) == expected.size());
+    expected.clear();
+    std::set_difference(sa.begin(), sa.end(), sb.begin(), sb.end(),
+                        std::back_inserter(expected));
+    res = a.logicalandnot(b, t);
+    assert(std::vector<uint32_t>(res.begin(), res.end()) == expected);
+    assert(a.logicalandnotCount(b, t) == expected.size());
+  }
+  // no empty partition is kept, and the output may be an operand
+  PartitionedConciseSet<wahmode, word_t> c = a;
+  c.logicalxorToContainer(a, c);
+  assert(c.isEmpty() && c.size() == 0 && c.begin() == c.end());
+  assert((a & b).equals(b & a));
+  PartitionedConciseSet<wahmode, word_t> other(16);
+  bool thrown = false;
+  try {
+    a.logicaland(other);
+  } catch (std::runtime_error &) {
+    thrown = true;
+  }
+  assert(thrown);
+}
+
+template <bool wahmode, class word_t = uint32_t> void partitionedkeystest() {
+  std::cout << "[[[" << __PRETTY_FUNCTION__ << "]]]" << std::endl;
+  typedef PartitionedConciseSet<wahmode, word_t, uint64_t> wide_set;
+  const uint32_t maxbits = wide_set::maxPartitionBits();
+  assert(maxbits == (sizeof(word_t) == 8 ? 31 : 29));
+  bool thrown = false;
+  try {
+    wide_set bad(maxbits + 1);
+  } catch (std::runtime_error &) {
+    thrown = true;
+  }
+  assert(thrown);
+  // the extremes of both value types, no remapping needed
+  PartitionedConciseSet<wahmode, word_t> narrow(maxbits);
+  narrow.add(0);
+  narrow.add(UINT32_MAX);
+  narrow.add(UINT32_MAX - 1);
+  assert(narrow.size() == 3 && narrow.contains(UINT32_MAX));
+  assert(std::vector<uint32_t>(narrow.begin(), narrow.end()) ==
+         std::vector<uint32_t>({0, UINT32_MAX - 1, UINT32_MAX}));
+  wide_set a(maxbits), b(maxbits);
+  std::set<uint64_t> sa, sb;
+  uint64_t seed = 11;
+  for (int k = 0; k < 20000; ++k) {
+    seed = seed * UINT64_C(6364136223846793005) + UINT64_C(1442695040888963407);
+    // a few hundred distinct partitions, some values shared
+    const uint64_t x = ((seed >> 40) % 300) << 40 | (seed & 0xFFFFF);
+    a.add(x);
+    sa.insert(x);
+    const uint64_t y = (k % 3 == 0) ? x : x ^ (UINT64_C(1) << 63);
+    b.add(y);
+    sb.insert(y);
+  }
+  a.add(UINT64_MAX);
+  sa.insert(UINT64_MAX);
+  assert(a.size() == sa.size() && b.size() == sb.size());
+  assert(std::vector<uint64_t>(a.begin(), a.end()) ==
+         std::vector<uint64_t>(sa.begin(), sa.end()));
+  assert(a.contains(UINT64_MAX) && !b.contains(UINT64_MAX));
+  std::vector<uint64_t> expected;
+  std::set_intersection(sa.begin(), sa.end(), sb.begin(), sb.end(),
+                        std::back_inserter(expected));
+  const wide_set i = a & b;
+  assert(std::vector<uint64_t>(i.begin(), i.end()) == expected);
+  assert(a.logicalandCount(b) == expected.size());
+  expected.clear();
+  std::set_union(sa.begin(), sa.end(), sb.begin(), sb.end(),
+                 std::back_inserter(expected));
+  const wide_set u = a | b;
+  assert(std::vector<uint64_t>(u.begin(), u.end()) == expected);
+  assert(a.logicalorCount(b) == expected.size());
+  expected.clear();
+  std::set_symmetric_difference(sa.begin(), sa.end(), sb.begin(), sb.end(),
+                                std::back_inserter(expected));
+  assert(a.logicalxorCount(b) == expected.size());
+  expected.clear();
+  std::set_difference(sa.begin(), sa.end(), sb.begin(), sb.end(),
+                      std::back_inserter(expected));
+  const wide_set d = a - b;
+  assert(std::vector<uint64_t>(d.begin(), d.end()) == expected);
+  assert(a.logicalandnotCount(b) == expected.size());
+}
+
+template <bool wahmode, class word_t = uint32_t> void toarraytest() {
+  std::cout << "[[[" << __PRETTY_FUNCTION__ << "]]]" << std::endl;
+  std::vector<ConciseSet<wahmode, word_t>> sets(5);
+  uint32_t seed = 3;
+  for (int k = 0; k < 5000; ++k) {
+    seed = seed * 1103515245 + 12345;
+    sets[1].add(seed >> 6);
+  }
+  // fills of ones, with and without a missing first bit, then sparse values
+  // and a dense tail ending in a short literal
+  for (uint32_t x = 1; x < 100000; ++x)
+    if (x != 500)
+      sets[2].add(x);
+  for (uint32_t x = 100000; x < 10000000; x += 1000)
+    sets[2].add(x);
+  for (uint32_t x = 10000000; x < 10000070; ++x)
+    sets[2].add(x);
+  sets[3].add(7);
+  sets[3].add(ConciseWord<word_t>::MAX_ALLOWED_INTEGER);
+  for (uint32_t x = 0; x < 200; x += 2)
+    sets[4].add(x);
+  for (const ConciseSet<wahmode, word_t> &set : sets) {
+    const std::vector<uint32_t> expected(set.begin(), set.end());
+    assert(set.toVector() == expected);
+    // nothing is written past the last value
+    std::vector<uint32_t> out(expected.size() + 1, 0xDEADBEEF);
+    assert(set.toArray(out.data()) == expected.size());
+    assert(out.back() == 0xDEADBEEF);
+    out.pop_back();
+    assert(out == expected);
+    out.assign(expected.size(), 0);
+    const ConciseView<wahmode, word_t> view(set);
+    assert(view.template decode<ScalarDecoder>(out.data()) == expected.size());
+    assert(out == expected);
+#ifdef CONCISE_X86_DECODE
+    if (useAVX2Decoder()) {
+      out.assign(expected.size() + 1, 0xDEADBEEF);
+      assert(view.decodeAVX2(out.data()) == expected.size());
+      assert(out.back() == 0xDEADBEEF);
+      out.pop_back();
+      assert(out == expected);
+    }
+#endif
+  }
+}
+
+template <bool wahmode, class word_t = uint32_t> void batchiteratortest() {
+  std::cout << "[[[" << __PRETTY_FUNCTION__ << "]]]" << std::endl;
+  ConciseSet<wahmode, word_t> set;
+  uint32_t seed = 5;
+  for (int k = 0; k < 3000; ++k) {
+    seed = seed * 1103515245 + 12345;
+    set.add(seed >> 8);
+  }
+  // fills of ones, one missing its first bit, and a lone bit in a zero fill
+  for (uint32_t x = 10; x < 50000; ++x)
+    if (x != 20)
+      set.add(x);
+  set.add(ConciseWord<word_t>::MAX_ALLOWED_INTEGER);
+  const std::vector<uint32_t> expected(set.begin(), set.end());
+  const size_t caps[] = {1, 3, 31, 256, 1024, 100000};
+  for (size_t cap : caps) {
+    ConciseSetBatchIterator<wahmode, word_t> it(set);
+    std::vector<uint32_t> buf(cap), values;
+    size_t n;
+    while ((n = it.nextBatch(buf.data(), cap)) == cap)
+      values.insert(values.end(), buf.begin(), buf.end());
+    values.insert(values.end(), buf.begin(), buf.begin() + n);
+    assert(values == expected);
+    assert(it.exhausted() && it.nextBatch(buf.data(), cap) == 0);
+  }
+  ConciseSet<wahmode, word_t> empty;
+  ConciseSetBatchIterator<wahmode, word_t> it(empty);
+  uint32_t value;
+  assert(it.nextBatch(&value, 1) == 0 && it.exhausted());
+}
+
+template <bool wahmode, class word_t = uint32_t> void skiptotest() {
+  std::cout << "[[[" << __PRETTY_FUNCTION__ << "]]]" << std::endl;
+  // literals, long fills of zeros and of ones, flipped bits
+  ConciseSet<wahmode, word_t> set;
+  std::set<uint32_t> values;
+  uint32_t seed = 9;
+  for (int k = 0; k < 2000; ++k) {
+    seed = seed * 1103515245 + 12345;
+    const uint32_t x = (seed >> 8) % 2000000;
+    set.add(x);
+    values.insert(x);
+  }
+  for (uint32_t x = 3000000; x < 3100000; ++x) {
+    if (x == 3000001)
+      continue;
+    set.add(x);
+    values.insert(x);
+  }
+  set.add(90000000);
+  values.insert(90000000);
+  // every target from a fresh iterator lands on the lower bound
+  for (int k = 0; k < 3000; ++k) {
+    seed = seed * 1103515245 + 12345;
+    const uint32_t x = k < 1000 ? (seed >> 8) % 2000000
+                                : k < 2000 ? 2999990 + (seed >> 8) % 100020
+                                           : (seed >> 5);
+    auto it = set.begin();
+    it.skipTo(x);
+    auto expected = values.lower_bound(x);
+    if (expected == values.end()) {
+      assert(it == set.end());
+    } else {
+      assert(it != set.end() && *it == *expected);
+      // the iterator carries on from there
+      ++it;
+      ++expected;
+      assert(expected == values.end() ? it == set.end() : *it == *expected);
+    }
+  }
+  // intersection with a sorted list, skipping forward only
+  std::vector<uint32_t> list;
+  for (uint32_t x = 0; x < 100000000; x += 1 + (x % 7) * 5000)
+    list.push_back(x);
+  std::vector<uint32_t> expected, got;
+  std::set_intersection(values.begin(), values.end(), list.begin(), list.end(),
+                        std::back_inserter(expected));
+  auto it = set.begin();
+  for (uint32_t x : list) {
+    it.skipTo(x);
+    if (it == set.end())
+      break;
+    if (*it == x)
+      got.push_back(x);
+  }
+  assert(got == expected);
+  // skipping backward does nothing
+  it = set.begin();
+  it.skipTo(3000000);
+  it.skipTo(5);
+  assert(*it == 3000000);
+}
+
+template <bool wahmode, class word_t = uint32_t> void reverseiteratortest() {
+  std::cout << "[[[" << __PRETTY_FUNCTION__ << "]]]" << std::endl;
+  std::vector<ConciseSet<wahmode, word_t>> sets(4);
+  uint32_t seed = 13;
+  for (int k = 0; k < 3000; ++k) {
+    seed = seed * 1103515245 + 12345;
+    sets[1].add(seed >> 6);
+  }
+  // a fill of ones missing its first bit, a lone bit in a zero fill, and a
+  // set ending on a fill of ones
+  for (uint32_t x = 0; x < 40000; ++x)
+    if (x != 1)
+      sets[2].add(x);
+  sets[2].add(5000000);
+  for (uint32_t x = 6000000; x < 6000620; ++x)
+    sets[2].add(x);
+  sets[3].add(ConciseWord<word_t>::MAX_ALLOWED_INTEGER);
+  for (const ConciseSet<wahmode, word_t> &set : sets) {
+    std::vector<uint32_t> expected(set.begin(), set.end());
+    std::reverse(expected.begin(), expected.end());
+    assert(std::vector<uint32_t>(set.rbegin(), set.rend()) == expected);
+    const ConciseView<wahmode, word_t> view(set);
+    assert(std::vector<uint32_t>(view.rbegin(), view.rend()) == expected);
+    // the five largest values, without visiting the others
+    std::vector<uint32_t> top;
+    for (auto i = set.rbegin(); i != set.rend() && top.size() < 5; ++i)
+      top.push_back(*i);
+    assert(top == std::vector<uint32_t>(
+                      expected.begin(),
+                      expected.begin() + std::min<size_t>(5, expected.size())));
+  }
+  assert(sets[0].rbegin() == sets[0].rend());
+}
+
+template <bool wahmode, class word_t = uint32_t> void runiteratortest() {
+  std::cout << "[[[" << __PRETTY_FUNCTION__ << "]]]" << std::endl;
+  ConciseSet<wahmode, word_t> set;
+  uint32_t seed = 17;
+  for (int k = 0; k < 3000; ++k) {
+    seed = seed * 1103515245 + 12345;
+    set.add((seed >> 8) % 1000000);
+  }
+  // runs across literals and fills, one of them starting mid-block, one
+  // broken by the flipped bit of a fill
+  for (uint32_t x = 2000005; x < 3000000; ++x)
+    if (x != 2000100)
+      set.add(x);
+  for (uint32_t x = 3000031; x < 3000040; ++x)
+    set.add(x);
+  set.add(ConciseWord<word_t>::MAX_ALLOWED_INTEGER);
+  std::vector<std::pair<uint32_t, uint32_t>> expected;
+  for (uint32_t x : set) {
+    if (!expected.empty() && expected.back().second == x)
+      expected.back().second++;
+    else
+      expected.push_back(std::make_pair(x, x + 1));
+  }
+  std::vector<std::pair<uint32_t, uint32_t>> runs, rawruns;
+  ConciseSetRunIterator<wahmode, word_t> it(set);
+  uint32_t start, end;
+  while (it.nextRun(start, end))
+    runs.push_back(std::make_pair(start, end));
+  assert(runs == expected);
+  assert(!it.nextRun(start, end));
+  ConciseSetRunIterator<wahmode, word_t> raw(set);
+  size_t total = 0;
+  while (raw.nextRawRun(start, end)) {
+    assert(start < end);
+    assert(rawruns.empty() || rawruns.back().second <= start);
+    rawruns.push_back(std::make_pair(start, end));
+    total += end - start;
+  }
+  assert(total == set.size() && rawruns.size() > runs.size());
+  ConciseSet<wahmode, word_t> empty;
+  ConciseSetRunIterator<wahmode, word_t> none(empty);
+  assert(!none.nextRun(start, end) && !none.nextRawRun(start, end));
+}
+
+template <bool wahmode, class word_t = uint32_t> void rangetest() {
+  std::cout << "[[[" << __PRETTY_FUNCTION__ << "]]]" << std::endl;
+  const uint32_t maxint = ConciseWord<word_t>::MAX_ALLOWED_INTEGER;
+  ConciseSet<wahmode, word_t> set;
+  std::set<uint32_t> expected;
+  uint32_t seed = 19;
+  for (int k = 0; k < 2000; ++k) {
+    seed = seed * 1103515245 + 12345;
+    set.add((seed >> 8) % 300000);
+    expected.insert((seed >> 8) % 300000);
+  }
+  for (int k = 0; k < 300; ++k) {
+    seed = seed * 1103515245 + 12345;
+    const uint32_t lo = (seed >> 8) % 300000;
+    seed = seed * 1103515245 + 12345;
+    // within a block, across a few blocks, or over long fills
+    const uint32_t span = (seed >> 8) % (k % 3 == 0 ? 40 : k % 3 == 1 ? 200
+                                                                   : 100000);
+    const uint32_t hi = lo + span;
+    if (k % 3 == 0) {
+      set.addRange(lo, hi);
+      for (uint32_t x = lo; x < hi; ++x)
+        expected.insert(x);
+    } else if (k % 3 == 1) {
+      set.removeRange(lo, hi);
+      expected.erase(expected.lower_bound(lo), expected.lower_bound(hi));
+    } else {
+      set.flipRange(lo, hi);
+      for (uint32_t x = lo; x < hi; ++x)
+        if (!expected.erase(x))
+          expected.insert(x);
+    }
+    if (k % 50 == 0) {
+      assert(set.size() == expected.size());
+      assert(std::vector<uint32_t>(set.begin(), set.end()) ==
+             std::vector<uint32_t>(expected.begin(), expected.end()));
+    }
+  }
+  assert(std::vector<uint32_t>(set.begin(), set.end()) ==
+         std::vector<uint32_t>(expected.begin(), expected.end()));
+  assert(set.last == (expected.empty() ? -1 : (int32_t)*expected.rbegin()));
+  // ranges reaching the bounds, empty ranges
+  ConciseSet<wahmode, word_t> full = ConciseSet<wahmode, word_t>::fromRange(
+      0, maxint + 1);
+  assert(full.size() == maxint + 1 && full.contains(maxint) &&
+         full.last == (int32_t)maxint && full.lastWordIndex <= 1);
+  full.removeRange(1, maxint);
+  assert(full.size() == 2 && full.contains(0) && full.contains(maxint));
+  full.flipRange(0, maxint + 1);
+  assert(full.size() == maxint - 1 && !full.contains(0));
+  full.removeRange(0, maxint + 1);
+  assert(full.isEmpty());
+  full.addRange(5, 5);
+  assert(full.isEmpty());
+  bool thrown = false;
+  try {
+    full.addRange(0, maxint + 2);
+  } catch (std::runtime_error &) {
+    thrown = true;
+  }
+  assert(thrown);
+}
+
+template <bool wahmode, class word_t = uint32_t> void removetest() {
+  std::cout << "[[[" << __PRETTY_FUNCTION__ << "]]]" << std::endl;
+  ConciseSet<wahmode, word_t> set;
+  std::set<uint32_t> expected;
+  uint32_t seed = 23;
+  // literals, fills of ones, flipped bits, isolated values far apart
+  for (int k = 0; k < 3000; ++k) {
+    seed = seed * 1103515245 + 12345;
+    expected.insert((seed >> 8) % 200000);
+  }
+  for (uint32_t x = 300000; x < 310000; ++x)
+    expected.insert(x);
+  expected.insert(5000000);
+  expected.insert(9000000);
+  for (uint32_t x : expected)
+    set.add(x);
+  set.size(); // the cardinality is kept up to date from now on
+  for (int k = 0; k < 4000; ++k) {
+    seed = seed * 1103515245 + 12345;
+    uint32_t x = k % 4 == 0   ? (seed >> 8) % 200000
+                 : k % 4 == 1 ? 300000 + (seed >> 8) % 10000
+                 : k % 4 == 2 ? (seed >> 8) % 10000000
+                              : (expected.empty() ? 0 : *expected.rbegin());
+    set.remove(x);
+    expected.erase(x);
+    if (k % 400 == 0) {
+      const std::vector<uint32_t> values(expected.begin(), expected.end());
+      assert(std::vector<uint32_t>(set.begin(), set.end()) == values);
+      assert(set.size() == expected.size() && set.size() == recount(set));
+      // the words are those of a set built from scratch
+      assert(sameWords(set, ConciseSet<wahmode, word_t>::fromSorted(
+                                values.data(), values.data() + values.size())));
+      for (uint32_t v : values)
+        assert(set.contains(v));
+    }
+  }
+  // down to the empty set
+  const std::vector<uint32_t> rest(expected.begin(), expected.end());
+  for (uint32_t x : rest)
+    set.remove(x);
+  assert(set.isEmpty() && set.size() == 0 && set.last == -1);
+  set.remove(3);
+  assert(set.isEmpty());
+}
+
+template <bool wahmode, class word_t = uint32_t> void slicetest() {
+  std::cout << "[[[" << __PRETTY_FUNCTION__ << "]]]" << std::endl;
+  ConciseSet<wahmode, word_t> a, b;
+  std::set<uint32_t> sa, sb;
+  uint32_t seed = 29;
+  for (int k = 0; k < 5000; ++k) {
+    seed = seed * 1103515245 + 12345;
+    sa.insert((seed >> 8) % 500000);
+    seed = seed * 1103515245 + 12345;
+    sb.insert((seed >> 8) % 500000);
+  }
+  // fills of ones, one with a flipped bit, and lone bits in zero fills
+  for (uint32_t x = 600000; x < 700000; ++x)
+    if (x != 600001)
+      sa.insert(x);
+  for (uint32_t x = 650000; x < 800000; x += 2)
+    sb.insert(x);
+  sa.insert(3000000);
+  sb.insert(4000000);
+  for (uint32_t x : sa)
+    a.add(x);
+  for (uint32_t x : sb)
+    b.add(x);
+  for (int k = 0; k < 400; ++k) {
+    seed = seed * 1103515245 + 12345;
+    const uint32_t lo = k == 0 ? 0 : (seed >> 8) % 900000;
+    seed = seed * 1103515245 + 12345;
+    const uint32_t hi =
+        k == 0 ? 5000000 : lo + (seed >> 8) % (k % 2 ? 100 : 200000);
+    std::vector<uint32_t> wa(sa.lower_bound(lo), sa.lower_bound(hi));
+    std::vector<uint32_t> wb(sb.lower_bound(lo), sb.lower_bound(hi));
+    const ConciseSet<wahmode, word_t> slice = a.slice(lo, hi);
+    assert(std::vector<uint32_t>(slice.begin(), slice.end()) == wa);
+    assert(slice.size() == wa.size() && slice.size() == recount(slice));
+    assert(sameWords(slice, ConciseSet<wahmode, word_t>::fromSorted(
+                                wa.data(), wa.data() + wa.size())));
+    assert(a.countInRange(lo, hi) == wa.size());
+    std::vector<uint32_t> expected;
+    std::set_intersection(wa.begin(), wa.end(), wb.begin(), wb.end(),
+                          std::back_inserter(expected));
+    assert(a.logicalandCount(b, lo, hi) == expected.size());
+    expected.clear();
+    std::set_union(wa.begin(), wa.end(), wb.begin(), wb.end(),
+                   std::back_inserter(expected));
+    assert(a.logicalorCount(b, lo, hi) == expected.size());
+    expected.clear();
+    std::set_symmetric_difference(wa.begin(), wa.end(), wb.begin(), wb.end(),
+                                  std::back_inserter(expected));
+    assert(a.logicalxorCount(b, lo, hi) == expected.size());
+    expected.clear();
+    std::set_difference(wa.begin(), wa.end(), wb.begin(), wb.end(),
+                        std::back_inserter(expected));
+    assert(a.logicalandnotCount(b, lo, hi) == expected.size());
+  }
+  assert(a.countInRange(10, 10) == 0 && a.slice(10, 5).isEmpty());
+  const ConciseSet<wahmode, word_t> empty;
+  assert(empty.slice(0, 100).isEmpty() && empty.countInRange(0, 100) == 0);
+  // the other operand may be a view, or empty
+  const ConciseView<wahmode, word_t> view(b);
+  const ConciseSimilarity whole = a.similarity(view, 0, 5000000);
+  const ConciseSimilarity expectedWhole = a.similarity(b);
+  assert(whole.intersection == expectedWhole.intersection);
+  assert(whole.leftOnly == expectedWhole.leftOnly);
+  assert(whole.rightOnly == expectedWhole.rightOnly);
+  // a set is reached through its skip index, a view word by word
+  for (uint32_t lo = 0; lo < 900000; lo += 70001) {
+    const ConciseSimilarity bySet = a.similarity(b, lo, lo + 150000);
+    const ConciseSimilarity byView = a.similarity(view, lo, lo + 150000);
+    assert(bySet.intersection == byView.intersection);
+    assert(bySet.leftOnly == byView.leftOnly);
+    assert(bySet.rightOnly == byView.rightOnly);
+  }
+  assert(a.logicalorCount(empty, 1000, 700000) == a.countInRange(1000, 700000));
+  assert(empty.logicalxorCount(view, 5, 650003) == b.countInRange(5, 650003));
+  assert(empty.logicalandCount(empty, 0, 100) == 0);
+  // the largest element, which is INT32_MAX with 64-bit words
+  const uint32_t maxint = ConciseWord<word_t>::MAX_ALLOWED_INTEGER;
+  ConciseSet<wahmode, word_t> top;
+  top.add(5);
+  top.add(maxint);
+  assert(top.countInRange(maxint, maxint + 1) == 1);
+  assert(top.slice(0, maxint + 1).size() == 2);
+  assert(top.similarity(top, maxint, maxint + 1).intersection == 1);
+  assert(top.logicalorCount(empty, 0, maxint + 1) == 2);
+}
+
+template <bool wahmode, class word_t = uint32_t> void subsettest() {
+  std::cout << "[[[" << __PRETTY_FUNCTION__ << "]]]" << std::endl;
+  typedef ConciseSet<wahmode, word_t> set_t;
+  uint32_t seed = 31;
+  for (int k = 0; k < 300; ++k) {
+    // big: clustered values, a run of ones and a lone bit far away
+    std::set<uint32_t> big;
+    for (int i = 0; i < 2000; ++i) {
+      seed = seed * 1103515245 + 12345;
+      big.insert((seed >> 8) % (k % 3 == 0 ? 5000 : 300000));
+    }
+    for (uint32_t x = 400000; x < 400000 + 1000 * (uint32_t)(k % 7); ++x)
+      big.insert(x);
+    big.insert(2000000);
+    // small: mostly drawn from big, sometimes with one extra value
+    std::set<uint32_t> small;
+    for (uint32_t x : big) {
+      seed = seed * 1103515245 + 12345;
+      if ((seed >> 8) % 4 == 0)
+        small.insert(x);
+    }
+    if (k % 2 == 1) {
+      seed = seed * 1103515245 + 12345;
+      small.insert((seed >> 8) % 2100000);
+    }
+    // other: values that may or may not meet big
+    std::set<uint32_t> other;
+    for (int i = 0; i < (k % 5) * 10; ++i) {
+      seed = seed * 1103515245 + 12345;
+      other.insert(300000 + (seed >> 8) % (k % 4 == 0 ? 100000 : 200000));
+    }
+    set_t b, s, o;
+    for (uint32_t x : big)
+      b.add(x);
+    for (uint32_t x : small)
+      s.add(x);
+    for (uint32_t x : other)
+      o.add(x);
+    const bool subset =
+        std::includes(big.begin(), big.end(), small.begin(), small.end());
+    assert(s.isSubsetOf(b) == subset);
+    assert(b.isSupersetOf(s) == subset);
+    assert(b.isSubsetOf(s) == (subset && small.size() == big.size()));
+    assert(b.isSubsetOf(b) && b.isSupersetOf(b));
+    assert(o.isSubsetOf(b) ==
+           std::includes(big.begin(), big.end(), other.begin(), other.end()));
+    std::vector<uint32_t> common;
+    std::set_intersection(big.begin(), big.end(), other.begin(), other.end(),
+                          std::back_inserter(common));
+    assert(b.isDisjoint(o) == common.empty());
+    assert(o.isDisjoint(b) == common.empty());
+  }
+  const set_t empty;
+  const set_t full = set_t::fromRange(0, 1000000);
+  set_t holed = full;
+  holed.remove(777777);
+  assert(empty.isSubsetOf(full) && !full.isSubsetOf(empty));
+  assert(empty.isDisjoint(full) && empty.isSubsetOf(empty));
+  assert(holed.isSubsetOf(full) && !full.isSubsetOf(holed));
+  assert(full.isSupersetOf(holed) && !holed.isDisjoint(full));
+  assert(set_t::fromRange(10, 20).isSubsetOf(holed));
+  assert(!set_t::fromRange(777770, 777780).isSubsetOf(holed));
+  assert(set_t::fromRange(777777, 777778).isDisjoint(holed));
+}
+
+template <bool wahmode, class word_t = uint32_t> void similaritytest() {
+  std::cout << "[[[" << __PRETTY_FUNCTION__ << "]]]" << std::endl;
+  typedef ConciseSet<wahmode, word_t> set_t;
+  uint32_t seed = 37;
+  for (int k = 0; k < 200; ++k) {
+    std::set<uint32_t> sa, sb;
+    for (int i = 0; i < (k % 4) * 700; ++i) {
+      seed = seed * 1103515245 + 12345;
+      sa.insert((seed >> 8) % 100000);
+      seed = seed * 1103515245 + 12345;
+      sb.insert((seed >> 8) % (k % 3 == 0 ? 5000 : 150000));
+    }
+    // overlapping runs of ones, one of them with a hole
+    for (uint32_t x = 200000; x < 200000 + 3000 * (uint32_t)(k % 5); ++x)
+      if (x != 200100)
+        sa.insert(x);
+    for (uint32_t x = 201000; x < 201000 + 2000 * (uint32_t)(k % 3); ++x)
+      sb.insert(x);
+    if (k % 2 == 0)
+      sb.insert(1000000 + (uint32_t)k);
+    set_t a, b;
+    for (uint32_t x : sa)
+      a.add(x);
+    for (uint32_t x : sb)
+      b.add(x);
+    std::vector<uint32_t> common;
+    std::set_intersection(sa.begin(), sa.end(), sb.begin(), sb.end(),
+                          std::back_inserter(common));
+    const ConciseSimilarity sim = a.similarity(b);
+    assert(sim.intersection == common.size());
+    assert(sim.leftOnly == sa.size() - common.size());
+    assert(sim.rightOnly == sb.size() - common.size());
+    assert(sim.unionCount() == a.logicalorCount(b));
+    assert(sim.xorCount() == a.logicalxorCount(b));
+    const ConciseSimilarity reverse = b.similarity(a);
+    assert(reverse.intersection == sim.intersection);
+    assert(reverse.leftOnly == sim.rightOnly);
+    assert(reverse.rightOnly == sim.leftOnly);
+    const double u = (double)sim.unionCount();
+    assert(a.jaccard(b) == (u == 0 ? 0 : common.size() / u));
+    const double total = (double)(sa.size() + sb.size());
+    assert(a.dice(b) == (total == 0 ? 0 : 2 * common.size() / total));
+    const double smaller = (double)std::min(sa.size(), sb.size());
+    assert(a.overlap(b) == (smaller == 0 ? 0 : common.size() / smaller));
+    const double c = a.cosine(b);
+    assert(c >= 0 && c <= 1.0000001 && (c == 0) == common.empty());
+  }
+  const set_t empty;
+  const set_t range = set_t::fromRange(10, 1000);
+  assert(empty.jaccard(empty) == 0 && empty.similarity(range).rightOnly == 990);
+  assert(range.jaccard(range) == 1 && range.dice(range) == 1);
+  assert(range.overlap(set_t::fromRange(500, 900)) == 1);
+}
+
+template <bool wahmode, class word_t>
+static ConciseExpression<wahmode, word_t>
+randomExpression(const std::vector<ConciseSet<wahmode, word_t>> &sets,
+                 size_t lo, size_t hi, uint32_t &seed,
+                 ConciseSet<wahmode, word_t> &eager) {
+  if (hi - lo == 1) {
+    eager = sets[lo];
+    return lazy(sets[lo]);
+  }
+  seed = seed * 1103515245 + 12345;
+  const size_t mid = lo + 1 + (seed >> 8) % (hi - lo - 1);
+  ConciseSet<wahmode, word_t> left, right;
+  const ConciseExpression<wahmode, word_t> l =
+      randomExpression(sets, lo, mid, seed, left);
+  const ConciseExpression<wahmode, word_t> r =
+      randomExpression(sets, mid, hi, seed, right);
+  seed = seed * 1103515245 + 12345;
+  switch ((seed >> 8) % 4) {
+  case 0:
+    eager = left & right;
+    return l & r;
+  case 1:
+    eager = left | right;
+    return l | r;
+  case 2:
+    eager = left ^ right;
+    return l ^ r;
+  default:
+    eager = left - right;
+    return l - r;
+  }
+}
+
+template <bool wahmode, class word_t = uint32_t> void expressiontest() {
+  std::cout << "[[[" << __PRETTY_FUNCTION__ << "]]]" << std::endl;
+  typedef ConciseSet<wahmode, word_t> set_t;
+  uint32_t seed = 41;
+  std::vector<set_t> sets(24);
+  for (size_t i = 0; i < sets.size(); ++i) {
+    // sparse, clustered and dense sets, runs of ones, and an empty set
+    if (i == 5)
+      continue;
+    const uint32_t gap = i % 3 == 0 ? 2000 : (i % 3 == 1 ? 40 : 3);
+    for (uint32_t x = (uint32_t)i; x < 400000 + 37 * (uint32_t)i;) {
+      sets[i].add(x);
+      seed = seed * 1103515245 + 12345;
+      x += 1 + (seed >> 8) % gap;
+    }
+    if (i % 4 == 0)
+      sets[i].addRange(100000 * (uint32_t)(i % 5), 150000 + 1000 * (uint32_t)i);
+    if (i % 7 == 0)
+      sets[i].add(3000000 + (uint32_t)i);
+  }
+  for (int k = 0; k < 300; ++k) {
+    seed = seed * 1103515245 + 12345;
+    const size_t leaves = 1 + (seed >> 8) % 20;
+    seed = seed * 1103515245 + 12345;
+    const size_t lo = (seed >> 8) % (sets.size() - leaves + 1);
+    set_t eager;
+    const ConciseExpression<wahmode, word_t> e =
+        randomExpression(sets, lo, lo + leaves, seed, eager);
+    const set_t answer = e.evaluate();
+    assert(sameWords(answer, eager));
+    assert(answer.size() == recount(answer));
+    assert(e.count() == eager.size());
+    assert(e.isEmpty() == eager.isEmpty());
+  }
+  // mixed operands, a result written over one of its leaves
+  set_t a = sets[1], b = sets[2], c = sets[3], d = sets[4];
+  const set_t expected = (a & b) | (c - d);
+  ((lazy(a) & b) | (lazy(c) - d)).toContainer(a);
+  assert(sameWords(a, expected));
+  assert(sameWords((b & (lazy(c) ^ d)).evaluate(), b & (c ^ d)));
+  assert((lazy(sets[5]) & sets[0]).isEmpty());
+  assert((lazy(b) - b).isEmpty() && (lazy(b) ^ b).count() == 0);
+  // threads evaluating expressions over the same sets
+  std::vector<ConciseExpression<wahmode, word_t>> shared;
+  std::vector<set_t> expectedValues(8);
+  for (size_t t = 0; t < expectedValues.size(); ++t)
+    shared.push_back(randomExpression(sets, t, t + 12, seed,
+                                      expectedValues[t]));
+  std::vector<set_t> values(shared.size());
+  parallelFor(shared.size(), 4,
+              [&](size_t t) { shared[t].toContainer(values[t]); });
+  for (size_t t = 0; t < shared.size(); ++t)
+    assert(sameWords(values[t], expectedValues[t]));
+}
+
+template <bool wahmode, class word_t = uint32_t> void batchtest() {
+  std::cout << "[[[" << __PRETTY_FUNCTION__ << "]]]" << std::endl;
+  typedef ConciseSet<wahmode, word_t> set_t;
+  uint32_t seed = 43;
+  std::vector<set_t> sets(12);
+  for (size_t i = 0; i < sets.size(); ++i) {
+    const uint32_t gap = i % 2 == 0 ? 500 : 7;
+    for (uint32_t x = (uint32_t)i; x < 300000;) {
+      sets[i].add(x);
+      seed = seed * 1103515245 + 12345;
+      x += 1 + (seed >> 8) % gap;
+    }
+  }
+  const set_t &a = sets[0], &b = sets[1], &c = sets[2], &d = sets[3];
+  std::vector<ConciseExpression<wahmode, word_t>> queries;
+  queries.push_back((lazy(a) & b) | c);
+  queries.push_back((lazy(b) & a) - d);
+  queries.push_back((lazy(a) & b) | c);
+  queries.push_back(lazy(d));
+  queries.push_back(c | (lazy(b) & a));
+  ConciseBatch<wahmode, word_t> shared(queries);
+  // a & b, (a & b) | c and (a & b) - d
+  assert(shared.operationCount() == 3);
+  // random queries over the sets, sharing many terms
+  for (int k = 0; k < 200; ++k) {
+    seed = seed * 1103515245 + 12345;
+    const size_t leaves = 1 + (seed >> 8) % 8;
+    seed = seed * 1103515245 + 12345;
+    const size_t lo = (seed >> 8) % (sets.size() - leaves + 1);
+    set_t eager;
+    queries.push_back(randomExpression(sets, lo, lo + leaves, seed, eager));
+  }
+  ConciseBatch<wahmode, word_t> batch(queries);
+  for (size_t threads = 1; threads <= 4; threads += 3) {
+    const std::vector<set_t> results = batch.execute(threads);
+    assert(results.size() == queries.size());
+    for (size_t q = 0; q < queries.size(); ++q)
+      assert(sameWords(results[q], queries[q].evaluate()));
+  }
+  const ConciseBatch<wahmode, word_t> empty;
+  assert(empty.execute().empty());
+}
+
+template <bool wahmode, class word_t = uint32_t> void inplacetest() {
+  std::cout << "[[[" << __PRETTY_FUNCTION__ << "]]]" << std::endl;
+  std::vector<ConciseSet<wahmode, word_t>> inputs(20);
+  for (size_t i = 0; i < inputs.size(); ++i)
+    for (uint32_t x = (uint32_t)i; x < 50000; x += 3 + 7 * (uint32_t)i)
+      inputs[i].add(x);
+  ConciseSet<wahmode, word_t> expectedor, expectedxor, expectedand,
+      expectedandnot;
+  ConciseSet<wahmode, word_t> accor, accxor, accand, accandnot;
+  expectedand = inputs[0];
+  accand = inputs[0];
+  expectedandnot = inputs[0];
+  accandnot = inputs[0];
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    expectedor = expectedor.logicalor(inputs[i]);
+    accor |= inputs[i];
+    assert(accor.equals(expectedor) && accor.size() == expectedor.size());
+    expectedxor = expectedxor.logicalxor(inputs[i]);
+    accxor ^= inputs[i];
+    assert(accxor.equals(expectedxor) && accxor.size() == expectedxor.size());
+    if (i % 5 == 0) {
+      expectedand = expectedand.logicaland(inputs[i] | inputs[i + 1]);
+      accand &= inputs[i] | inputs[i + 1];
+      assert(accand.equals(expectedand) && accand.size() == expectedand.size());
+    }
+    if (i > 0) {
+      expectedandnot = expectedandnot.logicalandnot(inputs[i]);
+      accandnot -= inputs[i];
+      assert(accandnot.equals(expectedandnot));
+      assert(accandnot.size() == expectedandnot.size());
+    }
+  }
+  // once warmed up, the accumulator only trades its two buffers
+  ConciseSet<wahmode, word_t> acc = inputs[0];
+  acc |= inputs[1];
+  acc |= inputs[1];
+  const word_t *buffer1 = acc.words.data();
+  const word_t *buffer2 = acc.scratch.data();
+  for (int k = 0; k < 10; ++k) {
+    acc |= inputs[1];
+    assert(acc.words.data() == buffer1 || acc.words.data() == buffer2);
+    assert(acc.scratch.data() == buffer1 || acc.scratch.data() == buffer2);
+  }
+  assert(acc.equals(inputs[0] | inputs[1]));
+  ConciseSet<wahmode, word_t> empty;
+  acc &= empty;
+  assert(acc.isEmpty() && acc.size() == 0);
+}
+
+template <bool wahmode> void widewordtest() {
+  std::cout << "[[[" << __PRETTY_FUNCTION__ << "]]]" << std::endl;
+  typedef ConciseWord<uint64_t> traits;
+  // a literal holds 63 bits, and two full literals make a single fill
+  ConciseSet<wahmode, uint64_t> ones;
+  for (uint32_t x = 0; x < 126; ++x)
+    ones.add(x);
+  assert(ones.lastWordIndex == 0 && isOneSequence(ones.words[0]));
+  assert(getSequenceCount<wahmode>(ones.words[0]) == 1);
+  assert(ones.size() == 126 && ones.last == 125);
+  // the flipped bit of a Concise sequence may be the last bit of a literal
+  ConciseSet<wahmode, uint64_t> flipped;
+  flipped.add(62);
+  flipped.add(63 * 100);
+  if (!wahmode) {
+    assert(flipped.lastWordIndex == 1 && isZeroSequence(flipped.words[0]));
+    assert(getFlippedBit(flipped.words[0]) == 62);
+  }
+  assert(flipped.contains(62) && flipped.contains(6300) && flipped.size() == 2);
+  assert(!flipped.contains(61) && !flipped.contains(63));
+  // the universe goes past what 32-bit words can represent
+  assert(traits::MAX_ALLOWED_INTEGER > MAX_ALLOWED_INTEGER);
+  const uint32_t large[] = {5, MAX_ALLOWED_INTEGER + 1, 2000000000,
+                            traits::MAX_ALLOWED_INTEGER};
+  ConciseSet<wahmode, uint64_t> wide;
+  for (uint32_t x : large)
+    wide.add(x);
+  for (uint32_t x : large)
+    assert(wide.contains(x));
+  assert(wide.size() == 4 && !wide.contains(2000000001));
+  std::vector<uint32_t> values(wide.begin(), wide.end());
+  assert(values == std::vector<uint32_t>({5, MAX_ALLOWED_INTEGER + 1,
+                                          2000000000,
+                                          traits::MAX_ALLOWED_INTEGER}));
+  assert(wide.select(3) == traits::MAX_ALLOWED_INTEGER &&
+         wide.rank(2000000001) == 3);
+  assert((wide | ones).size() == 129 && (wide & ones).size() == 1);
+  bool thrown = false;
+  try {
+    ConciseSet<wahmode> narrow;
+    narrow.add(MAX_ALLOWED_INTEGER + 1);
+  } catch (std::runtime_error &) {
+    thrown = true;
+  }
+  assert(thrown);
+  // both word sizes hold the same values
+  ConciseSet<wahmode> narrow;
+  uint32_t seed = 2024;
+  for (uint32_t x = 0; x < 100000; ++x) {
+    seed = seed * 1103515245 + 12345;
+    if ((x / 5000) % 2 == 0 ? (seed >> 16) % 3 != 0 : (seed >> 16) % 300 == 0) {
+      narrow.add(x);
+      wide.add(x);
+    }
+  }
+  values.assign(wide.begin(), wide.end());
+  values.resize(values.size() - 3);
+  assert(values == std::vector<uint32_t>(narrow.begin(), narrow.end()));
+}
+
 int main() {
   checkflush<false>();
   // checkflush<true>();// not actually safe (limitation in original code)
@@ -626,6 +2090,118 @@ int main() {
   variedtest<false>();
   realtest<true>();
   realtest<false>();
+  skipindextest<true>();
+  skipindextest<false>();
+  cardinalitytest<true>();
+  cardinalitytest<false>();
+  rankselecttest<true>();
+  rankselecttest<false>();
+  serializationtest<true>();
+  serializationtest<false>();
+  fromsortedtest<true>();
+  fromsortedtest<false>();
+  outofordertest<true>();
+  outofordertest<false>();
+  inplacetest<true>();
+  inplacetest<false>();
+  multiwaytest<true>();
+  multiwaytest<false>();
+  multiwayopstest<true>();
+  multiwayopstest<false>();
+  paralleltest<true>();
+  paralleltest<false>();
+  partitionedtest<true>();
+  partitionedtest<false>();
+  partitionedkeystest<true>();
+  partitionedkeystest<false>();
+  toarraytest<true>();
+  toarraytest<false>();
+  batchiteratortest<true>();
+  batchiteratortest<false>();
+  skiptotest<true>();
+  skiptotest<false>();
+  reverseiteratortest<true>();
+  reverseiteratortest<false>();
+  runiteratortest<true>();
+  runiteratortest<false>();
+  rangetest<true>();
+  rangetest<false>();
+  removetest<true>();
+  removetest<false>();
+  slicetest<true>();
+  slicetest<false>();
+  subsettest<true>();
+  subsettest<false>();
+  similaritytest<true>();
+  similaritytest<false>();
+  expressiontest<true>();
+  expressiontest<false>();
+  batchtest<true>();
+  batchtest<false>();
+  widewordtest<true>();
+  widewordtest<false>();
+  iteratortest<true, uint64_t>();
+  iteratortest<false, uint64_t>();
+  heaportest<true, uint64_t>();
+  heaportest<false, uint64_t>();
+  basictest<true, uint64_t>();
+  basictest<false, uint64_t>();
+  longtest<true, uint64_t>();
+  longtest<false, uint64_t>();
+  toytest<true, uint64_t>();
+  toytest<false, uint64_t>();
+  variedtest<true, uint64_t>();
+  variedtest<false, uint64_t>();
+  realtest<true, uint64_t>();
+  realtest<false, uint64_t>();
+  skipindextest<true, uint64_t>();
+  skipindextest<false, uint64_t>();
+  cardinalitytest<true, uint64_t>();
+  cardinalitytest<false, uint64_t>();
+  rankselecttest<true, uint64_t>();
+  rankselecttest<false, uint64_t>();
+  serializationtest<true, uint64_t>();
+  serializationtest<false, uint64_t>();
+  fromsortedtest<true, uint64_t>();
+  fromsortedtest<false, uint64_t>();
+  outofordertest<true, uint64_t>();
+  outofordertest<false, uint64_t>();
+  inplacetest<true, uint64_t>();
+  inplacetest<false, uint64_t>();
+  multiwaytest<true, uint64_t>();
+  multiwaytest<false, uint64_t>();
+  multiwayopstest<true, uint64_t>();
+  multiwayopstest<false, uint64_t>();
+  paralleltest<true, uint64_t>();
+  paralleltest<false, uint64_t>();
+  partitionedtest<true, uint64_t>();
+  partitionedtest<false, uint64_t>();
+  partitionedkeystest<true, uint64_t>();
+  partitionedkeystest<false, uint64_t>();
+  toarraytest<true, uint64_t>();
+  toarraytest<false, uint64_t>();
+  batchiteratortest<true, uint64_t>();
+  batchiteratortest<false, uint64_t>();
+  skiptotest<true, uint64_t>();
+  skiptotest<false, uint64_t>();
+  reverseiteratortest<true, uint64_t>();
+  reverseiteratortest<false, uint64_t>();
+  runiteratortest<true, uint64_t>();
+  runiteratortest<false, uint64_t>();
+  rangetest<true, uint64_t>();
+  rangetest<false, uint64_t>();
+  removetest<true, uint64_t>();
+  removetest<false, uint64_t>();
+  slicetest<true, uint64_t>();
+  slicetest<false, uint64_t>();
+  subsettest<true, uint64_t>();
+  subsettest<false, uint64_t>();
+  similaritytest<true, uint64_t>();
+  similaritytest<false, uint64_t>();
+  expressiontest<true, uint64_t>();
+  expressiontest<false, uint64_t>();
+  batchtest<true, uint64_t>();
+  batchtest<false, uint64_t>();
 
   std::cout << "code might be ok" << std::endl;
 }